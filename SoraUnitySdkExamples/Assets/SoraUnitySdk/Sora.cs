@@ -170,6 +170,16 @@ public class Sora : IDisposable
         public int VideoHeight = 480;
         public int VideoFps = 30;
         public UnityEngine.Texture? Texture;
+        /// <summary>
+        /// Unity カメラやテクスチャの内容が変わった時だけ読み出すかどうか
+        /// </summary>
+        /// <remarks>
+        /// true の場合、Sora.MarkVideoSourceDirty() を呼んだ後のフレームでだけテクスチャを読み出して送信します。
+        /// それ以外のフレームでは読み出しを行わず、KeepaliveIntervalMs 毎に前回の映像を送り直します。
+        /// 静止画や UI のように、たまにしか変化しないテクスチャを送信する場合に CPU 負荷とビットレートを下げられます。
+        /// </remarks>
+        public bool CaptureOnMarkDirty = false;
+        public int KeepaliveIntervalMs = 1000;
 
         public static CameraConfig FromUnityCamera(UnityEngine.Camera unityCamera, int unityCameraRenderTargetDepthBuffer, int videoWidth, int videoHeight, int videoFps)
         {
@@ -214,6 +224,70 @@ public class Sora : IDisposable
         }
     }
 
+    /// <summary>
+    /// AddVideoSource() で追加する映像ソースの設定
+    /// </summary>
+    /// <remarks>
+    /// MaxBitrateBps, MaxFramerate, ScaleResolutionDownBy は、このソースを送信している間だけ適用されるエンコードパラメータです。
+    /// 0 の場合は変更しません。
+    /// </remarks>
+    public class VideoSourceConfig
+    {
+        public CameraConfig CameraConfig = new CameraConfig();
+        public int MaxBitrateBps = 0;
+        public double MaxFramerate = 0;
+        public double ScaleResolutionDownBy = 0;
+    }
+
+    /// <summary>
+    /// 送信する映像のエンコーディング毎のパラメータ
+    /// </summary>
+    /// <remarks>
+    /// null の項目は変更しません。
+    /// MaxBitrateBps, MaxFramerate, ScaleResolutionDownBy に 0 を指定すると制限を解除します。
+    /// </remarks>
+    public class VideoEncoding
+    {
+        // サイマルキャストの場合は対象の rid を指定する。
+        // 空の場合は Encodings の何番目に指定したかで対象を決める
+        public string Rid = "";
+        public bool? Active;
+        public int? MaxBitrateBps;
+        public double? MaxFramerate;
+        public double? ScaleResolutionDownBy;
+    }
+
+    /// <summary>
+    /// SetVideoEncodingParameters() で変更するエンコードパラメータ
+    /// </summary>
+    public class VideoEncodingParameters
+    {
+        public List<VideoEncoding> Encodings = new List<VideoEncoding>();
+        public DegradationPreference? DegradationPreference;
+    }
+
+    /// <summary>
+    /// StartReceiveQualityController() の設定
+    /// </summary>
+    /// <remarks>
+    /// 0 や空文字の場合はデフォルト値を使います。
+    /// </remarks>
+    public class ReceiveQualityControllerConfig
+    {
+        // 判定する間隔（ミリ秒）。デフォルトは 1000
+        public int IntervalMs = 0;
+        // テクスチャの高さがこれ以下なら r0 を受信する。デフォルトは 180
+        public int R0MaxHeight = 0;
+        // テクスチャの高さがこれ以下なら r1、より大きければ r2 を受信する。デフォルトは 360
+        public int R1MaxHeight = 0;
+        // この時間（ミリ秒）テクスチャが更新されていない映像は見えていないとして r0 を受信する。デフォルトは 2000
+        public int InvisibleTimeoutMs = 0;
+        // 何回連続して同じ rid が選ばれたら切り替えるか。デフォルトは 2
+        public int StableCount = 0;
+        // rid の変更に使う JSON-RPC のメソッド名。デフォルトは "2025.2.0/RequestSimulcastRid"
+        public string RpcMethod = "";
+    }
+
     public enum VideoCodecImplementation
     {
         // Internal は libwebrtc の内部で実装されているエンコーダー/デコーダーを利用する
@@ -293,10 +367,7 @@ public class Sora : IDisposable
         public string ToJson()
         {
             var vcc = ConvertToInternalVideoCodecCapability(this);
-            var size = sora_video_codec_capability_to_json_size(Jsonif.Json.ToJson(vcc));
-            var buf = new byte[size];
-            sora_video_codec_capability_to_json(Jsonif.Json.ToJson(vcc), buf, size);
-            return System.Text.Encoding.UTF8.GetString(buf);
+            return TakeResult(sora_video_codec_capability_to_json(Jsonif.Json.ToJson(vcc)));
         }
     }
 
@@ -316,10 +387,7 @@ public class Sora : IDisposable
         public string ToJson()
         {
             var vcp = ConvertToInternalVideoCodecPreference(this);
-            var size = sora_video_codec_preference_to_json_size(Jsonif.Json.ToJson(vcp));
-            var buf = new byte[size];
-            sora_video_codec_preference_to_json(Jsonif.Json.ToJson(vcp), buf, size);
-            return System.Text.Encoding.UTF8.GetString(buf);
+            return TakeResult(sora_video_codec_preference_to_json(Jsonif.Json.ToJson(vcp)));
         }
         // この VideoCodecPreference が、どれかのコーデックでこの implementation を使うように要求しているかどうか
         public bool HasImplementation(VideoCodecImplementation implementation)
@@ -332,10 +400,8 @@ public class Sora : IDisposable
         {
             var vcp = ConvertToInternalVideoCodecPreference(this);
             var vcp2 = ConvertToInternalVideoCodecPreference(preference);
-            var size = sora_video_codec_preference_merge_size(Jsonif.Json.ToJson(vcp), Jsonif.Json.ToJson(vcp2));
-            var buf = new byte[size];
-            sora_video_codec_preference_merge(Jsonif.Json.ToJson(vcp), Jsonif.Json.ToJson(vcp2), buf, size);
-            var vcpr = Jsonif.Json.FromJson<SoraConf.Internal.VideoCodecPreference>(System.Text.Encoding.UTF8.GetString(buf));
+            var json = TakeResult(sora_video_codec_preference_merge(Jsonif.Json.ToJson(vcp), Jsonif.Json.ToJson(vcp2)));
+            var vcpr = Jsonif.Json.FromJson<SoraConf.Internal.VideoCodecPreference>(json);
             var result = ConvertToVideoCodecPreference(vcpr);
             this.Codecs = result.Codecs;
         }
@@ -343,10 +409,8 @@ public class Sora : IDisposable
         public static VideoCodecPreference CreateFromImplementation(VideoCodecCapability capability, VideoCodecImplementation implementation)
         {
             var vcc = ConvertToInternalVideoCodecCapability(capability);
-            var size = sora_create_video_codec_preference_from_implementation_size(Jsonif.Json.ToJson(vcc), VideoCodecImplementationToString(implementation));
-            var buf = new byte[size];
-            sora_create_video_codec_preference_from_implementation(Jsonif.Json.ToJson(vcc), VideoCodecImplementationToString(implementation), buf, size);
-            var vcpr = Jsonif.Json.FromJson<SoraConf.Internal.VideoCodecPreference>(System.Text.Encoding.UTF8.GetString(buf));
+            var json = TakeResult(sora_create_video_codec_preference_from_implementation(Jsonif.Json.ToJson(vcc), VideoCodecImplementationToString(implementation)));
+            var vcpr = Jsonif.Json.FromJson<SoraConf.Internal.VideoCodecPreference>(json);
             return ConvertToVideoCodecPreference(vcpr);
         }
 
@@ -438,11 +502,41 @@ public class Sora : IDisposable
         /// 指定したデバイスのスピーカーを利用することが出来ます。
         /// </remarks>
         public string AudioPlayoutDevice = "";
+        // SharedContext を使う場合は無視される。SharedContextConfig で指定すること
         public double? AudioSpeakerVolume = null;
         public double? AudioMicrophoneVolume = null;
         public AudioCodecType? AudioCodecType;
         public int AudioBitRate = 0;
         public string AudioStreamingLanguageCode = "";
+        /// <summary>
+        /// 受信した映像のデコードを止めるまでのフレーム数
+        /// </summary>
+        /// <remarks>
+        /// RenderTrackToTexture() によるテクスチャの更新がこのフレーム数の間無かった映像は、デコードを止めます。
+        /// 再びテクスチャが更新されるとキーフレームを要求してデコードを再開します。
+        /// 0 の場合はデコードを止めません。
+        /// </remarks>
+        public int DecodePauseIdleFrames = 0;
+        /// <summary>
+        /// 受信した映像の VideoSink を自動で作らないかどうか
+        /// </summary>
+        /// <remarks>
+        /// true の場合、受信した映像に対して OnAddTrack は呼ばれません。
+        /// 描画などで必要な映像だけ、OnMediaStreamTrack で受け取ったトラックを AddVideoSink() に渡して VideoSink を作って下さい。
+        /// 映像を描画しない大量の参加者を 1 台で動かす場合に、映像毎の処理を減らせます。
+        /// </remarks>
+        public bool ManualVideoSink = false;
+        /// <summary>
+        /// VideoSink を作っていない受信映像をデコードしないかどうか
+        /// </summary>
+        /// <remarks>
+        /// ManualVideoSink と合わせて使います。
+        /// 映像のパケットは受信しますが、AddVideoSink() を呼ぶまでデコードしません。
+        /// デコードしていない間も送信側にキーフレームを要求することはないので、
+        /// 大量の参加者で使っても送信側の負荷は増えません。
+        /// AddVideoSink() でデコードを始める時にだけキーフレームを 1 回要求します。
+        /// </remarks>
+        public bool NoVideoDecode = false;
 
         // DataChannelSignaling を有効にするかどうか
         public bool EnableDataChannelSignaling = false;
@@ -481,6 +575,118 @@ public class Sora : IDisposable
         public string? ClientCert;
         public string? ClientKey;
         public string? CACert;
+
+        // 複数の Sora インスタンスでスレッドや PeerConnectionFactory を共有する場合に指定する
+        // 指定した場合、VideoCodecPreference や NoAudioDevice などの設定は SharedContext 作成時のものが使われ、
+        // UnityAudioInput と UnityAudioOutput は無視される
+        public SharedContext? SharedContext;
+    }
+
+    /// <summary>
+    /// 負荷試験用の設定
+    /// </summary>
+    /// <remarks>
+    /// カメラの代わりに生成した映像を送り、映像と音声のエンコード結果を全ての接続で共有します。
+    /// 全ての接続は同じコーデックと設定で送信する必要があり、ビットレートは最初に送信を始めた接続のものに従います。
+    /// </remarks>
+    public class LoadGeneratorConfig
+    {
+        public int VideoWidth = 640;
+        public int VideoHeight = 480;
+        public int VideoFps = 30;
+        // 指定した場合は Y4M ファイルの映像を繰り返し送る。解像度とフレームレートはファイルの値が使われる
+        public string Y4mFile = "";
+    }
+
+    public class SharedContextConfig
+    {
+        public bool NoAudioDevice = false;
+        public string AudioRecordingDevice = "";
+        public string AudioPlayoutDevice = "";
+        public VideoCodecCapabilityConfig VideoCodecCapabilityConfig;
+        // null の場合は VideoCodecImplementation.Internal な実装のみ利用する
+        public VideoCodecPreference? VideoCodecPreference;
+        // 指定した場合は、この SharedContext を使う全ての接続が負荷試験用のクライアントになる
+        public LoadGeneratorConfig? LoadGenerator;
+        // オーディオデバイスは全ての接続で共通なので、音量もここで指定する
+        public double? AudioSpeakerVolume = null;
+        public double? AudioMicrophoneVolume = null;
+    }
+
+    /// <summary>
+    /// 複数の Sora インスタンスで共有するスレッドや PeerConnectionFactory、オーディオデバイス
+    /// </summary>
+    /// <remarks>
+    /// 接続ごとにスレッドやコーデックの初期化を行わないので、同時に多数の接続を行う場合の負荷が下がります。
+    /// Dispose() を呼んでも、この SharedContext を使って接続中の Sora インスタンスが全て破棄されるまで実体は残ります。
+    /// </remarks>
+    public class SharedContext : IDisposable
+    {
+        internal IntPtr p;
+
+        public SharedContext(SharedContextConfig config)
+        {
+            var c = new SoraConf.Internal.SharedContextConfig();
+            c.no_audio_device = config.NoAudioDevice;
+            c.audio_recording_device = config.AudioRecordingDevice;
+            c.audio_playout_device = config.AudioPlayoutDevice;
+            c.video_codec_capability_config = ConvertToInternalVideoCodecCapabilityConfig(config.VideoCodecCapabilityConfig);
+            if (config.VideoCodecPreference != null)
+            {
+                c.SetVideoCodecPreference(ConvertToInternalVideoCodecPreference(config.VideoCodecPreference));
+            }
+            if (config.LoadGenerator != null)
+            {
+                var lg = new SoraConf.Internal.LoadGeneratorConfig();
+                lg.video_width = config.LoadGenerator.VideoWidth;
+                lg.video_height = config.LoadGenerator.VideoHeight;
+                lg.video_fps = config.LoadGenerator.VideoFps;
+                lg.y4m_file = config.LoadGenerator.Y4mFile;
+                c.SetLoadGenerator(lg);
+            }
+            if (config.AudioSpeakerVolume.HasValue)
+            {
+                c.SetAudioSpeakerVolume(config.AudioSpeakerVolume.Value);
+            }
+            if (config.AudioMicrophoneVolume.HasValue)
+            {
+                c.SetAudioMicrophoneVolume(config.AudioMicrophoneVolume.Value);
+            }
+            p = sora_shared_context_create(Jsonif.Json.ToJson(c));
+            if (p == IntPtr.Zero)
+            {
+                throw new InvalidOperationException("Failed to create SharedContext");
+            }
+        }
+
+        /// <summary>
+        /// この SharedContext を使う全ての接続のスピーカーの音量を設定します。
+        /// </summary>
+        /// <param name="volume">音量。[0.0, 1.0] の範囲で設定して下さい。</param>
+        /// <returns>設定に成功した場合は true を返します。</returns>
+        public bool SetSpeakerVolume(double volume)
+        {
+            return sora_shared_context_set_speaker_volume(p, volume) != 0;
+        }
+
+        /// <summary>
+        /// この SharedContext を使う全ての接続のマイクの音量を設定します。
+        /// </summary>
+        /// <param name="volume">音量。[0.0, 1.0] の範囲で設定して下さい。</param>
+        /// <returns>設定に成功した場合は true を返します。</returns>
+        public bool SetMicrophoneVolume(double volume)
+        {
+            return sora_shared_context_set_microphone_volume(p, volume) != 0;
+        }
+
+        public void Dispose()
+        {
+            if (p != IntPtr.Zero)
+            {
+                sora_shared_context_destroy(p);
+                p = IntPtr.Zero;
+            }
+        }
     }
 
     IntPtr p;
@@ -497,8 +703,18 @@ public class Sora : IDisposable
     Action<string>? onDataChannel;
     Action<short[], int, int>? onHandleAudio;
     Action<SoraConf.VideoFrame>? onCapturerFrame;
+    Action<DeviceKind>? onDeviceChange;
     UnityEngine.Rendering.CommandBuffer commandBuffer;
     UnityEngine.Camera? unityCamera;
+    // SwitchCamera() で切り替え中の Unity カメラ
+    UnityEngine.Camera? pendingUnityCamera;
+    bool switchingCamera = false;
+    Action<bool, string>? onSwitchCamera;
+    Action<int, uint>? onAddVideoSource;
+    // AddVideoSource() で追加した Unity カメラ
+    Dictionary<int, UnityEngine.Camera> sourceUnityCameras = new Dictionary<int, UnityEngine.Camera>();
+    bool prepared = false;
+    IntPtr preparedCameraTexture = IntPtr.Zero;
 
     // RPC リクエストの結果の種類
     public enum RpcResultKind
@@ -604,14 +820,66 @@ public class Sora : IDisposable
         }
     }
 
-    public Sora()
+    public Sora() : this(false)
     {
-        p = sora_create();
+    }
+
+    /// <summary>
+    /// Sora を作成する
+    /// </summary>
+    /// <remarks>
+    /// headless が true の場合、-batchmode -nographics のようにグラフィックスデバイスが無い環境でも作成できます。
+    /// その場合 Unity カメラのキャプチャやテクスチャへの描画は利用できません。
+    /// </remarks>
+    public Sora(bool headless)
+    {
+        p = headless ? sora_create_headless() : sora_create();
         selfHandle = GCHandle.Alloc(this);
         commandBuffer = new UnityEngine.Rendering.CommandBuffer();
         sora_set_on_rpc(p, RpcCallback, GCHandle.ToIntPtr(selfHandle));
     }
 
+    /// <summary>
+    /// 接続に依存しない準備を事前に行います。
+    /// </summary>
+    /// <remarks>
+    /// コンテキストやオーディオデバイス、キャプチャラ、トラックの作成を行うので、ローディング画面の間などに呼び出しておくと、
+    /// その後の Connect() ではすぐにシグナリングを開始します。
+    /// Connect() には Prepare() と同じ Config を渡してください。
+    /// 各フェーズにかかった時間は GetPrepareTimings() で取得できます。
+    /// </remarks>
+    public bool Prepare(Config config)
+    {
+        var cc = CreateConnectConfig(config);
+        if (config.SharedContext != null)
+        {
+            prepared = sora_prepare_with_shared_context(p, config.SharedContext.p, Jsonif.Json.ToJson(cc)) != 0;
+        }
+        else
+        {
+            prepared = sora_prepare(p, Jsonif.Json.ToJson(cc)) != 0;
+        }
+        return prepared;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct PrepareTimings
+    {
+        // 各フェーズにかかった時間（マイクロ秒）
+        public long ContextUs;
+        public long AdmUs;
+        public long CapturerUs;
+        public long TracksUs;
+        public long TotalUs;
+    }
+
+    public PrepareTimings GetPrepareTimings()
+    {
+        PrepareTimings timings;
+        sora_get_prepare_timings(p, out timings);
+        return timings;
+    }
+
     /// <summary>
     /// Sora に接続します。
     /// </summary>
@@ -619,9 +887,28 @@ public class Sora : IDisposable
     /// この関数を呼び出した後は、エラー時や切断時に必ず１回だけ OnDisconnect コールバックが呼ばれます。
     /// </remarks>
     public void Connect(Config config)
+    {
+        var cc = CreateConnectConfig(config);
+        prepared = false;
+        if (config.SharedContext != null)
+        {
+            sora_connect_with_shared_context(p, config.SharedContext.p, Jsonif.Json.ToJson(cc));
+        }
+        else
+        {
+            sora_connect(p, Jsonif.Json.ToJson(cc));
+        }
+    }
+
+    SoraConf.Internal.ConnectConfig CreateConnectConfig(Config config)
     {
         IntPtr unityCameraTexture = IntPtr.Zero;
-        if (config.CameraConfig.CapturerType == CapturerType.UnityCamera)
+        if (prepared)
+        {
+            // Prepare() の時に作ったテクスチャでキャプチャラが作られているので、それを使い続ける
+            unityCameraTexture = preparedCameraTexture;
+        }
+        else if (config.CameraConfig.CapturerType == CapturerType.UnityCamera)
         {
             if (config.CameraConfig.UnityCamera == null)
             {
@@ -697,6 +984,8 @@ public class Sora : IDisposable
         cc.camera_config.video_width = config.CameraConfig.VideoWidth;
         cc.camera_config.video_height = config.CameraConfig.VideoHeight;
         cc.camera_config.video_fps = config.CameraConfig.VideoFps;
+        cc.camera_config.capture_on_mark_dirty = config.CameraConfig.CaptureOnMarkDirty;
+        cc.camera_config.keepalive_interval_ms = config.CameraConfig.KeepaliveIntervalMs;
         cc.video_codec_type = config.VideoCodecType == null ? "" : config.VideoCodecType.ToString();
         cc.video_vp9_params = config.VideoVp9Params;
         cc.video_av1_params = config.VideoAv1Params;
@@ -704,24 +993,13 @@ public class Sora : IDisposable
         cc.video_bit_rate = config.VideoBitRate;
         if (config.DegradationPreference.HasValue)
         {
-            switch (config.DegradationPreference.Value)
-            {
-                case DegradationPreference.Disabled:
-                    cc.SetDegradationPreference(SoraConf.Internal.DegradationPreference.DISABLED);
-                    break;
-                case DegradationPreference.MaintainFramerate:
-                    cc.SetDegradationPreference(SoraConf.Internal.DegradationPreference.MAINTAIN_FRAMERATE);
-                    break;
-                case DegradationPreference.MaintainResolution:
-                    cc.SetDegradationPreference(SoraConf.Internal.DegradationPreference.MAINTAIN_RESOLUTION);
-                    break;
-                case DegradationPreference.Balanced:
-                    cc.SetDegradationPreference(SoraConf.Internal.DegradationPreference.BALANCED);
-                    break;
-            }
+            cc.SetDegradationPreference(ConvertToInternalDegradationPreference(config.DegradationPreference.Value));
         }
         cc.unity_audio_input = config.UnityAudioInput;
         cc.unity_audio_output = config.UnityAudioOutput;
+        cc.decode_pause_idle_frames = config.DecodePauseIdleFrames;
+        cc.manual_video_sink = config.ManualVideoSink;
+        cc.no_video_decode = config.NoVideoDecode;
         cc.audio_recording_device = config.AudioRecordingDevice;
         cc.audio_playout_device = config.AudioPlayoutDevice;
         if (config.AudioSpeakerVolume.HasValue)
@@ -816,7 +1094,8 @@ public class Sora : IDisposable
             cc.SetCaCert(config.CACert);
         }
 
-        sora_connect(p, Jsonif.Json.ToJson(cc));
+        preparedCameraTexture = unityCameraTexture;
+        return cc;
     }
     /// <summary>
     /// Sora から切断します。
@@ -829,6 +1108,35 @@ public class Sora : IDisposable
         sora_disconnect(p);
     }
 
+    static SoraConf.Internal.DegradationPreference ConvertToInternalDegradationPreference(DegradationPreference dp)
+    {
+        switch (dp)
+        {
+            case DegradationPreference.Disabled:
+                return SoraConf.Internal.DegradationPreference.DISABLED;
+            case DegradationPreference.MaintainFramerate:
+                return SoraConf.Internal.DegradationPreference.MAINTAIN_FRAMERATE;
+            case DegradationPreference.MaintainResolution:
+                return SoraConf.Internal.DegradationPreference.MAINTAIN_RESOLUTION;
+            default:
+                return SoraConf.Internal.DegradationPreference.BALANCED;
+        }
+    }
+    static DegradationPreference ConvertFromInternalDegradationPreference(SoraConf.Internal.DegradationPreference dp)
+    {
+        switch (dp)
+        {
+            case SoraConf.Internal.DegradationPreference.DISABLED:
+                return DegradationPreference.Disabled;
+            case SoraConf.Internal.DegradationPreference.MAINTAIN_FRAMERATE:
+                return DegradationPreference.MaintainFramerate;
+            case SoraConf.Internal.DegradationPreference.MAINTAIN_RESOLUTION:
+                return DegradationPreference.MaintainResolution;
+            default:
+                return DegradationPreference.Balanced;
+        }
+    }
+
     static SoraConf.Internal.ForwardingFilter ConvertToInternalForwardingFilter(ForwardingFilter filter)
     {
         var ff = new SoraConf.Internal.ForwardingFilter();
@@ -978,16 +1286,34 @@ public class Sora : IDisposable
     /// 接続中のカメラを別のカメラに切り替えます。
     /// この時、NoVideoDevice の設定は無視されます。
     /// つまり NoVideoDevice = false かつ Video = true で接続した後に SwitchCamera() を呼び出すと、指定したカメラに切り替わります。
+    ///
+    /// 切り替えは非同期に行われます。新しいカメラから最初のフレームが届いた時点で送信する映像を差し替え、
+    /// その後で古いカメラを停止するため、切り替え中も映像が途切れません。
+    /// ただし 2 つのカメラを同時に開けないデバイスでは、古いカメラを停止してから新しいカメラを開くため、
+    /// 切り替え中は映像が途切れます。
+    /// 切り替えが完了すると OnSwitchCamera コールバックが呼ばれます。
+    /// 切り替えが完了する前に再度 SwitchCamera() を呼び出すことはできません。
     /// </remarks>
     public void SwitchCamera(CameraConfig config)
     {
-        if (unityCamera != null)
+        if (switchingCamera)
         {
-            unityCamera.enabled = false;
-            unityCamera.targetTexture = null;
-            unityCamera = null;
+            throw new InvalidOperationException("SwitchCamera() の完了前に SwitchCamera() を呼び出すことはできません。");
         }
 
+        var cc = CreateInternalCameraConfig(config);
+        if (config.CapturerType == CapturerType.UnityCamera)
+        {
+            pendingUnityCamera = config.UnityCamera;
+        }
+        switchingCamera = true;
+        sora_set_on_switch_camera(p, SwitchCameraCallback, GCHandle.ToIntPtr(selfHandle));
+        sora_switch_camera(p, Jsonif.Json.ToJson(cc));
+    }
+
+    // CapturerType が UnityCamera の場合は、レンダーターゲットを設定して Unity カメラを有効にする
+    static SoraConf.Internal.CameraConfig CreateInternalCameraConfig(CameraConfig config)
+    {
         IntPtr unityCameraTexture = IntPtr.Zero;
         if (config.CapturerType == CapturerType.UnityCamera)
         {
@@ -995,10 +1321,9 @@ public class Sora : IDisposable
             {
                 throw new ArgumentNullException(nameof(config.UnityCamera), "CapturerType が UnityCamera の場合は UnityCamera を指定してください。");
             }
-            unityCamera = config.UnityCamera;
             var texture = new UnityEngine.RenderTexture(config.VideoWidth, config.VideoHeight, config.UnityCameraRenderTargetDepthBuffer, UnityEngine.RenderTextureFormat.BGRA32);
-            unityCamera.targetTexture = texture;
-            unityCamera.enabled = true;
+            config.UnityCamera.targetTexture = texture;
+            config.UnityCamera.enabled = true;
             unityCameraTexture = texture.GetNativeTexturePtr();
         }
         else if (config.CapturerType == CapturerType.Texture)
@@ -1016,7 +1341,109 @@ public class Sora : IDisposable
         cc.video_width = config.VideoWidth;
         cc.video_height = config.VideoHeight;
         cc.video_fps = config.VideoFps;
-        sora_switch_camera(p, Jsonif.Json.ToJson(cc));
+        cc.capture_on_mark_dirty = config.CaptureOnMarkDirty;
+        cc.keepalive_interval_ms = config.KeepaliveIntervalMs;
+        return cc;
+    }
+
+    /// <summary>
+    /// 接続中に映像ソースを追加します。
+    /// </summary>
+    /// <remarks>
+    /// 追加した映像ソースは常にキャプチャされ、SetSendingVideoSource() で指定している間だけ送信されます。
+    /// Sora との接続で送信できる映像は 1 つなので、複数のソースを同時に送信することはできませんが、
+    /// 再ネゴシエーション無しで送信する映像を即座に切り替えることができます。
+    ///
+    /// ソースの映像を描画できるようになると OnAddVideoSource コールバックが呼ばれるので、
+    /// 渡された videoSinkId を RenderTrackToTexture() に指定してください。
+    ///
+    /// 戻り値はソースの ID で、失敗した場合は 0 を返します。
+    /// </remarks>
+    public int AddVideoSource(VideoSourceConfig config)
+    {
+        var vsc = new SoraConf.Internal.VideoSourceConfig();
+        vsc.camera_config = CreateInternalCameraConfig(config.CameraConfig);
+        vsc.max_bitrate_bps = config.MaxBitrateBps;
+        vsc.max_framerate = config.MaxFramerate;
+        vsc.scale_resolution_down_by = config.ScaleResolutionDownBy;
+        int sourceId = sora_add_video_source(p, Jsonif.Json.ToJson(vsc));
+        if (config.CameraConfig.CapturerType == CapturerType.UnityCamera)
+        {
+            if (sourceId != 0)
+            {
+                sourceUnityCameras[sourceId] = config.CameraConfig.UnityCamera!;
+            }
+            else
+            {
+                config.CameraConfig.UnityCamera!.enabled = false;
+                config.CameraConfig.UnityCamera!.targetTexture = null;
+            }
+        }
+        return sourceId;
+    }
+
+    /// <summary>
+    /// AddVideoSource() で追加した映像ソースを削除します。
+    /// </summary>
+    /// <remarks>
+    /// 送信中のソースを削除した場合、接続時の映像の送信に戻ります。
+    /// </remarks>
+    public bool RemoveVideoSource(int sourceId)
+    {
+        if (sourceUnityCameras.TryGetValue(sourceId, out var camera))
+        {
+            camera.enabled = false;
+            camera.targetTexture = null;
+            sourceUnityCameras.Remove(sourceId);
+        }
+        return sora_remove_video_source(p, sourceId) != 0;
+    }
+
+    /// <summary>
+    /// 送信する映像ソースを切り替えます。
+    /// </summary>
+    /// <remarks>
+    /// AddVideoSource() の戻り値を指定します。0 を指定すると接続時の映像の送信に戻ります。
+    /// </remarks>
+    public bool SetSendingVideoSource(int sourceId)
+    {
+        return sora_set_sending_video_source(p, sourceId) != 0;
+    }
+
+    /// <summary>
+    /// Unity カメラやテクスチャの内容が変わったことを通知します。
+    /// </summary>
+    /// <remarks>
+    /// CameraConfig.CaptureOnMarkDirty が true の映像ソースにだけ効果があります。
+    /// AddVideoSource() の戻り値を指定します。0 を指定すると接続時の映像になります。
+    /// </remarks>
+    public bool MarkVideoSourceDirty(int sourceId = 0)
+    {
+        return sora_mark_video_source_dirty(p, sourceId) != 0;
+    }
+
+    private delegate void AddVideoSourceCallbackDelegate(int sourceId, uint videoSinkId, IntPtr userdata);
+
+    [AOT.MonoPInvokeCallback(typeof(AddVideoSourceCallbackDelegate))]
+    static private void AddVideoSourceCallback(int sourceId, uint videoSinkId, IntPtr userdata)
+    {
+        var sora = GCHandle.FromIntPtr(userdata).Target as Sora;
+        sora!.onAddVideoSource!(sourceId, videoSinkId);
+    }
+
+    /// <summary>
+    /// AddVideoSource() で追加した映像ソースを描画できるようになった時に呼ばれるコールバックです。
+    /// </summary>
+    /// <remarks>
+    /// 引数はソースの ID と videoSinkId です。
+    /// </remarks>
+    public Action<int, uint>? OnAddVideoSource
+    {
+        set
+        {
+            onAddVideoSource = value;
+            sora_set_on_add_video_source(p, value == null ? null : AddVideoSourceCallback, GCHandle.ToIntPtr(selfHandle));
+        }
     }
 
     /// <summary>
@@ -1031,6 +1458,19 @@ public class Sora : IDisposable
         UnityEngine.GL.IssuePluginEvent(sora_get_render_callback(), sora_get_render_callback_event_id(p));
     }
 
+    /// <summary>
+    /// ManualVideoSink を指定して接続した場合に、受信した映像のトラックの VideoSink を作る
+    /// </summary>
+    /// <remarks>
+    /// 作成した VideoSink の videoSinkId を返し、OnAddTrack も呼ばれます。
+    /// NoVideoDecode を指定していた場合は、ここからデコードを始めます。
+    /// 既に作っている場合はその videoSinkId を返し、失敗した場合は 0 を返します。
+    /// </remarks>
+    public uint AddVideoSink(MediaStreamTrack track)
+    {
+        return sora_add_video_sink(p, track.p);
+    }
+
     /// <summary>
     /// videoSinkId から対応する VideoTrack を取得する
     /// </summary>
@@ -1058,6 +1498,156 @@ public class Sora : IDisposable
         commandBuffer.Clear();
     }
 
+    /// <summary>
+    /// videoSinkId で受信した映像を、texture に直接アップロードするように登録する
+    /// </summary>
+    /// <remarks>
+    /// 登録したテクスチャは UpdateNativeTextures() を呼んだ時にまとめて更新されます。
+    /// RenderTrackToTexture() と違い、テクスチャ毎の CommandBuffer の発行や Unity 側でのコピーが発生せず、
+    /// 新しいフレームが来ていないテクスチャは更新しません。
+    /// texture は RGBA32 のテクスチャを指定して下さい。
+    /// 今のところ Ubuntu の OpenGL Core でのみ利用でき、それ以外の環境では false を返します。
+    /// その場合は RenderTrackToTexture() を使って下さい。
+    /// </remarks>
+    public static bool RegisterNativeTexture(uint videoSinkId, UnityEngine.Texture texture)
+    {
+        return sora_register_native_texture(videoSinkId, texture.GetNativeTexturePtr(), texture.width, texture.height) != 0;
+    }
+
+    /// <summary>
+    /// RegisterNativeTexture() で登録したテクスチャの登録を解除する
+    /// </summary>
+    public static void UnregisterNativeTexture(uint videoSinkId, UnityEngine.Texture texture)
+    {
+        sora_unregister_native_texture(videoSinkId, texture.GetNativeTexturePtr());
+    }
+
+    /// <summary>
+    /// texture をセルに区切り、videoSinkIds[i] で受信した映像を cells[i] の領域に直接アップロードするように登録する
+    /// </summary>
+    /// <remarks>
+    /// 大量の映像をグリッド表示する場合に、映像毎にテクスチャを用意する代わりに 1 枚のテクスチャにまとめるためのものです。
+    /// 映像はセルの大きさに拡大縮小され、UpdateNativeTextures() を呼んだ時に新しいフレームが来ていたセルだけが更新されます。
+    /// 各セルを描画する時のテクスチャ座標は GetNativeTextureAtlasUV() で取得できます。
+    /// 同じ texture で呼び直した場合はレイアウトを置き換えます。
+    /// texture は RGBA32 のテクスチャを指定して下さい。
+    /// 今のところ Ubuntu の OpenGL Core でのみ利用でき、それ以外の環境では false を返します。
+    /// </remarks>
+    public static bool RegisterNativeTextureAtlas(UnityEngine.Texture texture, uint[] videoSinkIds, UnityEngine.RectInt[] cells)
+    {
+        if (videoSinkIds.Length != cells.Length)
+        {
+            throw new ArgumentException("videoSinkIds and cells must have the same length");
+        }
+        var rects = new int[cells.Length * 4];
+        for (int i = 0; i < cells.Length; i++)
+        {
+            rects[i * 4 + 0] = cells[i].x;
+            rects[i * 4 + 1] = cells[i].y;
+            rects[i * 4 + 2] = cells[i].width;
+            rects[i * 4 + 3] = cells[i].height;
+        }
+        return sora_register_native_texture_atlas(texture.GetNativeTexturePtr(), texture.width, texture.height, videoSinkIds, rects, cells.Length) != 0;
+    }
+
+    /// <summary>
+    /// RegisterNativeTextureAtlas() で登録したテクスチャの登録を解除する
+    /// </summary>
+    public static void UnregisterNativeTextureAtlas(UnityEngine.Texture texture)
+    {
+        sora_unregister_native_texture_atlas(texture.GetNativeTexturePtr());
+    }
+
+    /// <summary>
+    /// RegisterNativeTextureAtlas() で登録したテクスチャの、videoSinkId のセルのテクスチャ座標を取得する
+    /// </summary>
+    /// <remarks>
+    /// 全てのセルを同じマテリアルで描画する場合に、タイル毎の mainTextureOffset や UV に利用できます。
+    /// videoSinkId のセルが無い場合は false を返します。
+    /// </remarks>
+    public static bool GetNativeTextureAtlasUV(UnityEngine.Texture texture, uint videoSinkId, out UnityEngine.Rect uv)
+    {
+        var buf = new float[4];
+        if (sora_get_native_texture_atlas_uv(texture.GetNativeTexturePtr(), videoSinkId, buf) == 0)
+        {
+            uv = default;
+            return false;
+        }
+        uv = new UnityEngine.Rect(buf[0], buf[1], buf[2], buf[3]);
+        return true;
+    }
+
+    /// <summary>
+    /// RegisterNativeTexture() で登録した全てのテクスチャを更新する
+    /// </summary>
+    /// <remarks>
+    /// 1 フレームに 1 回呼び出して下さい。
+    /// </remarks>
+    public static void UpdateNativeTextures()
+    {
+        UnityEngine.GL.IssuePluginEvent(sora_get_native_texture_update_callback(), 0);
+    }
+
+    public enum VideoFrameFormat
+    {
+        I420 = 0,
+        NV12 = 1,
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct VideoFrame
+    {
+        // 新しいフレームが来るたびに増える
+        public ulong Serial;
+        public int Width;
+        public int Height;
+        public VideoFrameFormat Format;
+        // I420 の場合は Y, U, V の順で、NV12 の場合は Y, UV の順で DataY と DataU に入る
+        public IntPtr DataY;
+        public IntPtr DataU;
+        public IntPtr DataV;
+        public int StrideY;
+        public int StrideU;
+        public int StrideV;
+    }
+
+    /// <summary>
+    /// videoSinkId で受信した最新のフレームを、CPU から読めるように参照する
+    /// </summary>
+    /// <remarks>
+    /// テクスチャを経由せずにデコードしたフレームのメモリを直接参照するので、機械学習などで映像を解析する場合に利用できます。
+    /// 戻り値のハンドルを UnlockVideoFrame() に渡すまで、frame のポインタが指す内容は書き換えられません。
+    /// I420 と NV12 のフレームはコピーせずにそのまま返し、それ以外は I420 に変換して返します。
+    /// downscaled に true を指定した場合は SetVideoFrameDownscale() で指定した大きさに縮小したフレームを返します。
+    /// 任意のスレッドから呼び出して構いません。
+    /// フレームがまだ無い場合は IntPtr.Zero を返します。
+    /// </remarks>
+    public static IntPtr LockVideoFrame(uint videoSinkId, bool downscaled, out VideoFrame frame)
+    {
+        return sora_lock_video_frame(videoSinkId, downscaled ? 1 : 0, out frame);
+    }
+
+    /// <summary>
+    /// LockVideoFrame() で参照したフレームを解放する
+    /// </summary>
+    public static void UnlockVideoFrame(IntPtr handle)
+    {
+        sora_unlock_video_frame(handle);
+    }
+
+    /// <summary>
+    /// videoSinkId で新しいフレームを受信するたびに、ワーカースレッドで width x height に縮小したフレームを作るようにする
+    /// </summary>
+    /// <remarks>
+    /// 縮小したフレームは LockVideoFrame() に downscaled = true を指定して取得します。
+    /// 縮小が追いつかない場合は途中のフレームを飛ばします。
+    /// width か height に 0 を指定すると縮小を止めます。
+    /// </remarks>
+    public static void SetVideoFrameDownscale(uint videoSinkId, int width, int height)
+    {
+        sora_set_video_frame_downscale(videoSinkId, width, height);
+    }
+
     private delegate void AddTrackCallbackDelegate(uint track_id, string connection_id, IntPtr userdata);
 
     [AOT.MonoPInvokeCallback(typeof(AddTrackCallbackDelegate))]
@@ -1385,8 +1975,37 @@ public class Sora : IDisposable
     {
         set
         {
-            onDataChannel = value;
-            sora_set_on_data_channel(p, value == null ? null : DataChannelCallback, GCHandle.ToIntPtr(selfHandle));
+            onDataChannel = value;
+            sora_set_on_data_channel(p, value == null ? null : DataChannelCallback, GCHandle.ToIntPtr(selfHandle));
+        }
+    }
+
+    private delegate void DeviceChangeCallbackDelegate(int kind, IntPtr userdata);
+
+    [AOT.MonoPInvokeCallback(typeof(DeviceChangeCallbackDelegate))]
+    static private void DeviceChangeCallback(int kind, IntPtr userdata)
+    {
+        var sora = GCHandle.FromIntPtr(userdata).Target as Sora;
+        sora!.onDeviceChange!((DeviceKind)kind);
+    }
+
+    /// <summary>
+    /// カメラやマイク、スピーカーの抜き差しを検出した時に呼ばれるコールバックです。
+    /// </summary>
+    /// <remarks>
+    /// DispatchEvents() を呼び出したスレッドで呼ばれます。
+    /// このコールバックが呼ばれた後に GetVideoCapturerDevices() などを呼び出すと、新しいデバイスの一覧が取得できます。
+    /// 一度も一覧を取得していない種類のデバイスについては通知されません。
+    /// 
+    /// OS のデバイスの抜き差しの通知を使って検出します。Android では通知を受け取れないので、
+    /// RefreshDevices() を呼び出して確認して下さい。
+    /// </remarks>
+    public Action<DeviceKind>? OnDeviceChange
+    {
+        set
+        {
+            onDeviceChange = value;
+            sora_set_on_device_change(p, value == null ? null : DeviceChangeCallback, GCHandle.ToIntPtr(selfHandle));
         }
     }
 
@@ -1449,6 +2068,53 @@ public class Sora : IDisposable
         }
     }
 
+    private delegate void SwitchCameraCallbackDelegate(int success, string message, IntPtr userdata);
+
+    [AOT.MonoPInvokeCallback(typeof(SwitchCameraCallbackDelegate))]
+    static private void SwitchCameraCallback(int success, string message, IntPtr userdata)
+    {
+        var sora = GCHandle.FromIntPtr(userdata).Target as Sora;
+        sora!.FinishSwitchCamera(success != 0, message);
+    }
+
+    void FinishSwitchCamera(bool success, string message)
+    {
+        // 成功した場合は古い Unity カメラを、失敗した場合は切り替え先の Unity カメラを止める
+        var stopCamera = success ? unityCamera : pendingUnityCamera;
+        var keepCamera = success ? pendingUnityCamera : unityCamera;
+        if (stopCamera != null && stopCamera != keepCamera)
+        {
+            stopCamera.enabled = false;
+            stopCamera.targetTexture = null;
+        }
+        unityCamera = keepCamera;
+        pendingUnityCamera = null;
+        switchingCamera = false;
+
+        if (onSwitchCamera != null)
+        {
+            onSwitchCamera(success, message);
+        }
+    }
+
+    /// <summary>
+    /// SwitchCamera() が完了した時に呼ばれるコールバックです。
+    /// </summary>
+    /// <remarks>
+    /// 引数は切り替えに成功したかどうかと、メッセージです。
+    /// 成功した場合のメッセージは、新しいカメラを開いてから古いカメラを停止した場合は "make-before-break"、
+    /// 古いカメラを停止してから新しいカメラを開いた場合は "break-before-make" です。
+    /// 失敗した場合のメッセージは失敗した理由で、元のカメラのまま送信を続けます。
+    /// ただし古いカメラを停止してから失敗した場合は、映像は送信されなくなります。
+    /// </remarks>
+    public Action<bool, string>? OnSwitchCamera
+    {
+        set
+        {
+            onSwitchCamera = value;
+        }
+    }
+
     private delegate void CapturerFrameCallbackDelegate(string data, IntPtr userdata);
 
     [AOT.MonoPInvokeCallback(typeof(CapturerFrameCallbackDelegate))]
@@ -1498,6 +2164,199 @@ public class Sora : IDisposable
         sora_get_stats(p, StatsCallback, GCHandle.ToIntPtr(handle));
     }
 
+    /// <summary>
+    /// GetFilteredStats() に渡す、取得する統計情報の指定
+    /// </summary>
+    public class StatsFilter
+    {
+        // 対象にする RTCStats の type (例: "inbound-rtp", "outbound-rtp")
+        // 空の場合は全ての type を対象にする
+        public List<string> Types = new List<string>();
+        // 取得するフィールド名 (例: "bytesReceived", "jitter", "packetsLost", "framesDecoded")
+        public List<string> Fields = new List<string>();
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct StatsRecord
+    {
+        // StatsFilter.Types のインデックス（Types が空の場合は常に 0）
+        public int TypeIndex;
+        // ssrc を持たない統計情報の場合は 0
+        public uint Ssrc;
+        public long TimestampUs;
+    }
+
+    public class FilteredStats
+    {
+        public StatsRecord[] Records = new StatsRecord[0];
+        // Records.Length * NumFields 個の値を持つ行優先の配列
+        // 値が存在しないフィールドは double.NaN になる
+        public double[] Values = new double[0];
+        public int NumFields;
+
+        public double GetValue(int recordIndex, int fieldIndex)
+        {
+            return Values[recordIndex * NumFields + fieldIndex];
+        }
+    }
+
+    private delegate void FilteredStatsCallbackDelegate(IntPtr records, int numRecords, IntPtr values, int numFields, IntPtr userdata);
+
+    [AOT.MonoPInvokeCallback(typeof(FilteredStatsCallbackDelegate))]
+    static private void FilteredStatsCallback(IntPtr records, int numRecords, IntPtr values, int numFields, IntPtr userdata)
+    {
+        GCHandle handle = GCHandle.FromIntPtr(userdata);
+        var callback = handle.Target as Action<FilteredStats>;
+        var stats = new FilteredStats();
+        stats.NumFields = numFields;
+        stats.Records = new StatsRecord[numRecords];
+        int recordSize = Marshal.SizeOf<StatsRecord>();
+        for (int i = 0; i < numRecords; i++)
+        {
+            stats.Records[i] = Marshal.PtrToStructure<StatsRecord>(records + i * recordSize);
+        }
+        stats.Values = new double[numRecords * numFields];
+        if (stats.Values.Length != 0)
+        {
+            Marshal.Copy(values, stats.Values, 0, stats.Values.Length);
+        }
+        callback!(stats);
+        handle.Free();
+    }
+
+    /// <summary>
+    /// 指定した type とフィールドの統計情報だけを取得します。
+    /// </summary>
+    /// <remarks>
+    /// GetStats() と違い JSON を経由しないため、トラック数が多い場合でも軽量に統計情報を取得できます。
+    /// 数値として表現できないフィールド（文字列など）は double.NaN になります。
+    /// onGetStats は DispatchEvents() の中から呼ばれます。
+    /// </remarks>
+    public void GetFilteredStats(StatsFilter filter, Action<FilteredStats> onGetStats)
+    {
+        var f = new SoraConf.Internal.StatsFilter();
+        foreach (var t in filter.Types)
+        {
+            f.types.Add(t);
+        }
+        foreach (var field in filter.Fields)
+        {
+            f.fields.Add(field);
+        }
+        GCHandle handle = GCHandle.Alloc(onGetStats);
+        sora_get_filtered_stats(p, Jsonif.Json.ToJson(f), FilteredStatsCallback, GCHandle.ToIntPtr(handle));
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct StatsSample
+    {
+        public long TimestampUs;
+        public double BitrateBps;
+        public double Framerate;
+        public double PacketLossPercent;
+        // 受信ストリームのみ
+        public double JitterBufferDelayMs;
+        public uint Ssrc;
+        // 0: audio, 1: video
+        public int Kind;
+        // 0: inbound, 1: outbound
+        public int Direction;
+    }
+
+    StatsSample[] statsSamples = new StatsSample[16];
+
+    /// <summary>
+    /// ネイティブ側で統計情報を定期的に取得し、ビットレートなどを計算する処理を開始します。
+    /// </summary>
+    /// <remarks>
+    /// 計算結果は ReadStatsSamples() で取得できます。
+    /// 接続後に呼び出して下さい。
+    /// </remarks>
+    /// <param name="intervalMillis">統計情報を取得する間隔 (ミリ秒)</param>
+    public void StartStatsSampler(int intervalMillis)
+    {
+        sora_start_stats_sampler(p, intervalMillis);
+    }
+
+    public void StopStatsSampler()
+    {
+        sora_stop_stats_sampler(p);
+    }
+
+    /// <summary>
+    /// StartStatsSampler() で計算された最新の値を取得します。
+    /// </summary>
+    /// <remarks>
+    /// ロックを取らずに最新の値を読み出すので、任意のタイミングで呼び出して構いません。
+    /// ただし複数のスレッドから同時に呼び出さないで下さい。
+    /// 前回の値との差分から計算できない値は double.NaN になります。
+    /// </remarks>
+    public StatsSample[] ReadStatsSamples()
+    {
+        while (true)
+        {
+            int n = sora_read_stats_samples(p, statsSamples, statsSamples.Length);
+            if (n <= statsSamples.Length)
+            {
+                var result = new StatsSample[n];
+                Array.Copy(statsSamples, result, n);
+                return result;
+            }
+            statsSamples = new StatsSample[n];
+        }
+    }
+
+    public enum TimelineEventType
+    {
+        ConnectStart = 0,
+        ContextCreated = 1,
+        AdmInitialized = 2,
+        CapturerStarted = 3,
+        // WebSocket の接続を開始した
+        SignalingStart = 4,
+        OfferReceived = 5,
+        // ICE と DTLS の接続が完了した
+        PeerConnected = 6,
+        FirstAudioRtp = 7,
+        FirstVideoRtp = 8,
+        // 以下は VideoSinkId 毎に記録される
+        FirstFrameDecoded = 9,
+        FirstTextureUpdate = 10,
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct TimelineEvent
+    {
+        public TimelineEventType Type;
+        // FirstFrameDecoded, FirstTextureUpdate 以外は 0
+        public uint VideoSinkId;
+        // 単調増加するクロックでの時刻（マイクロ秒）。イベント間の差分を見るために使う
+        public long TimestampUs;
+    }
+
+    /// <summary>
+    /// 接続を開始してから最初のフレームが描画されるまでの各イベントの時刻を取得します。
+    /// </summary>
+    /// <remarks>
+    /// 各イベントは最初の 1 回だけ記録されます。
+    /// Prepare() を呼んだ場合、Prepare() 時のイベントが ConnectStart より前に記録されています。
+    /// </remarks>
+    public TimelineEvent[] ReadConnectTimeline()
+    {
+        var buf = new TimelineEvent[16];
+        while (true)
+        {
+            int n = sora_read_connect_timeline(p, buf, buf.Length);
+            if (n <= buf.Length)
+            {
+                var result = new TimelineEvent[n];
+                Array.Copy(buf, result, n);
+                return result;
+            }
+            buf = new TimelineEvent[n];
+        }
+    }
+
     /// <summary>
     /// 指定した label のデータチャンネルに buf を送信します。
     /// </summary>
@@ -1632,6 +2491,53 @@ public class Sora : IDisposable
         public string DeviceName;
         public string UniqueName;
     }
+
+    /// <summary>
+    /// デバイスの種類です。
+    /// </summary>
+    public enum DeviceKind
+    {
+        VideoCapturer = 0,
+        AudioRecording = 1,
+        AudioPlayout = 2,
+    }
+
+    /// <summary>
+    /// デバイスを列挙し直して、変化があれば OnDeviceChange を呼び出します。
+    /// </summary>
+    /// <remarks>
+    /// OS のデバイスの抜き差しの通知を受け取れない Android 向けのものです。
+    /// OnDeviceChange を設定している Sora が無い場合は何もしません。
+    /// </remarks>
+    public static void RefreshDevices()
+    {
+        sora_refresh_devices();
+    }
+
+    /// <summary>
+    /// 実際のデバイスの代わりに、指定したデバイスを GetVideoCapturerDevices() などで返すようにします。
+    /// </summary>
+    /// <remarks>
+    /// デバイスが無い環境で、デバイスの一覧や OnDeviceChange を使った処理を確認するためのものです。
+    /// 一度呼び出すと、以降は実際のデバイスは列挙されません。
+    /// </remarks>
+    public static void SetFakeDevices(DeviceInfo[] videoCapturers, DeviceInfo[] audioRecordingDevices, DeviceInfo[] audioPlayoutDevices)
+    {
+        var fd = new SoraConf.Internal.FakeDevices();
+        foreach (var d in videoCapturers)
+        {
+            fd.video_capturers.Add(new SoraConf.Internal.FakeDevices.Device() { device_name = d.DeviceName, unique_name = d.UniqueName });
+        }
+        foreach (var d in audioRecordingDevices)
+        {
+            fd.audio_recording_devices.Add(new SoraConf.Internal.FakeDevices.Device() { device_name = d.DeviceName, unique_name = d.UniqueName });
+        }
+        foreach (var d in audioPlayoutDevices)
+        {
+            fd.audio_playout_devices.Add(new SoraConf.Internal.FakeDevices.Device() { device_name = d.DeviceName, unique_name = d.UniqueName });
+        }
+        sora_device_registry_set_fake_devices(Jsonif.Json.ToJson(fd));
+    }
     public static DeviceInfo[]? GetVideoCapturerDevices()
     {
         var list = new System.Collections.Generic.List<DeviceInfo>();
@@ -1709,6 +2615,124 @@ public class Sora : IDisposable
         sora_setenv(name, value);
     }
 
+    /// <summary>
+    /// 送信中の映像のエンコードパラメータを変更します。
+    /// </summary>
+    /// <remarks>
+    /// ビットレートやフレームレート、解像度の縮小率、サイマルキャストの各レイヤーの有効・無効、
+    /// degradation preference を、再ネゴシエーション無しで変更します。
+    /// 変更は非同期に行われます。接続していない場合は false を返します。
+    /// </remarks>
+    public bool SetVideoEncodingParameters(VideoEncodingParameters parameters)
+    {
+        var vep = new SoraConf.Internal.VideoEncodingParameters();
+        foreach (var e in parameters.Encodings)
+        {
+            var ve = new SoraConf.Internal.VideoEncodingParameters.Encoding();
+            ve.rid = e.Rid;
+            if (e.Active.HasValue)
+            {
+                ve.SetActive(e.Active.Value);
+            }
+            if (e.MaxBitrateBps.HasValue)
+            {
+                ve.SetMaxBitrateBps(e.MaxBitrateBps.Value);
+            }
+            if (e.MaxFramerate.HasValue)
+            {
+                ve.SetMaxFramerate(e.MaxFramerate.Value);
+            }
+            if (e.ScaleResolutionDownBy.HasValue)
+            {
+                ve.SetScaleResolutionDownBy(e.ScaleResolutionDownBy.Value);
+            }
+            vep.encodings.Add(ve);
+        }
+        if (parameters.DegradationPreference.HasValue)
+        {
+            vep.SetDegradationPreference(ConvertToInternalDegradationPreference(parameters.DegradationPreference.Value));
+        }
+        return sora_set_video_encoding_parameters(p, Jsonif.Json.ToJson(vep)) != 0;
+    }
+
+    /// <summary>
+    /// 送信中の映像の現在のエンコードパラメータを取得します。
+    /// </summary>
+    /// <remarks>
+    /// 接続していない場合は Encodings が空になります。
+    /// </remarks>
+    public VideoEncodingParameters GetVideoEncodingParameters()
+    {
+        var vep = Jsonif.Json.FromJson<SoraConf.Internal.VideoEncodingParameters>(TakeResult(sora_get_video_encoding_parameters(p)));
+        var result = new VideoEncodingParameters();
+        foreach (var ve in vep.encodings)
+        {
+            var e = new VideoEncoding();
+            e.Rid = ve.rid;
+            if (ve.HasActive())
+            {
+                e.Active = ve.active;
+            }
+            if (ve.HasMaxBitrateBps())
+            {
+                e.MaxBitrateBps = ve.max_bitrate_bps;
+            }
+            if (ve.HasMaxFramerate())
+            {
+                e.MaxFramerate = ve.max_framerate;
+            }
+            if (ve.HasScaleResolutionDownBy())
+            {
+                e.ScaleResolutionDownBy = ve.scale_resolution_down_by;
+            }
+            result.Encodings.Add(e);
+        }
+        if (vep.HasDegradationPreference())
+        {
+            result.DegradationPreference = ConvertFromInternalDegradationPreference(vep.degradation_preference);
+        }
+        return result;
+    }
+
+    /// <summary>
+    /// 受信している映像の描画サイズに合わせて、受信するサイマルキャストの rid を自動で切り替えます。
+    /// </summary>
+    /// <remarks>
+    /// RenderTrackToTexture() で実際に更新されているテクスチャの大きさを見て、
+    /// 小さく表示している映像や描画していない映像は低い rid を、大きく表示している映像は高い rid をリクエストします。
+    /// SetVideoSinkHint() で、画面外にある映像や注目している映像をアプリ側から指定することもできます。
+    ///
+    /// 判定と rid の変更は DispatchEvents() の中で行います。
+    /// rid の変更は DataChannel 経由の JSON-RPC で行うため、DataChannelSignaling を有効にして接続してください。
+    /// </remarks>
+    public void StartReceiveQualityController(ReceiveQualityControllerConfig config)
+    {
+        var c = new SoraConf.Internal.ReceiveQualityControllerConfig();
+        c.interval_ms = config.IntervalMs;
+        c.r0_max_height = config.R0MaxHeight;
+        c.r1_max_height = config.R1MaxHeight;
+        c.invisible_timeout_ms = config.InvisibleTimeoutMs;
+        c.stable_count = config.StableCount;
+        c.rpc_method = config.RpcMethod;
+        sora_start_receive_quality_controller(p, Jsonif.Json.ToJson(c));
+    }
+
+    public void StopReceiveQualityController()
+    {
+        sora_stop_receive_quality_controller(p);
+    }
+
+    /// <summary>
+    /// 映像が画面に見えているか、注目しているかを StartReceiveQualityController() で開始したコントローラに伝えます。
+    /// </summary>
+    /// <remarks>
+    /// visible が false の映像は r0 を、focused が true の映像は r2 を受信します。
+    /// </remarks>
+    public void SetVideoSinkHint(uint videoSinkId, bool visible, bool focused)
+    {
+        sora_set_video_sink_hint(p, videoSinkId, visible ? 1 : 0, focused ? 1 : 0);
+    }
+
     public bool AudioEnabled
     {
         get { return sora_get_audio_enabled(p) != 0; }
@@ -1732,10 +2756,7 @@ public class Sora : IDisposable
     {
         get
         {
-            int size = sora_get_selected_signaling_url_size(p);
-            byte[] buf = new byte[size];
-            sora_get_selected_signaling_url(p, buf, size);
-            return System.Text.Encoding.UTF8.GetString(buf);
+            return TakeResult(sora_get_selected_signaling_url(p));
         }
     }
 
@@ -1751,24 +2772,48 @@ public class Sora : IDisposable
     {
         get
         {
-            int size = sora_get_connected_signaling_url_size(p);
-            byte[] buf = new byte[size];
-            sora_get_connected_signaling_url(p, buf, size);
-            return System.Text.Encoding.UTF8.GetString(buf);
+            return TakeResult(sora_get_connected_signaling_url(p));
         }
     }
 
+    /// <summary>
+    /// ビデオコーデックの対応状況をキャッシュするファイルを指定します。
+    /// </summary>
+    /// <remarks>
+    /// GetVideoCodecCapability() の結果はプロセス内で常にキャッシュされますが、
+    /// ファイルを指定するとディスクにも保存して、次回起動時にエンコーダやデコーダを調べる処理を省略します。
+    /// SDK や GPU ドライバ、OpenH264 のライブラリが変わった場合は再度調べます。
+    /// 例えば UnityEngine.Application.persistentDataPath 以下のファイルを指定してください。
+    /// </remarks>
+    public static void SetVideoCodecCapabilityCacheFile(string path)
+    {
+        sora_set_video_codec_capability_cache_file(path);
+    }
+
     public static VideoCodecCapability GetVideoCodecCapability(VideoCodecCapabilityConfig config)
     {
         var c = ConvertToInternalVideoCodecCapabilityConfig(config);
         var cjson = Jsonif.Json.ToJson(c);
-        int size = sora_get_video_codec_capability_size(cjson);
-        byte[] buf = new byte[size];
-        sora_get_video_codec_capability(cjson, buf, size);
-        var vcc = Jsonif.Json.FromJson<SoraConf.Internal.VideoCodecCapability>(System.Text.Encoding.UTF8.GetString(buf));
+        var vcc = Jsonif.Json.FromJson<SoraConf.Internal.VideoCodecCapability>(TakeResult(sora_get_video_codec_capability(cjson)));
         return ConvertToVideoCodecCapability(vcc);
     }
 
+    // ネイティブ側が返した文字列の結果を取り出して破棄する
+    static string TakeResult(IntPtr result)
+    {
+        try
+        {
+            int size = sora_result_size(result);
+            var buf = new byte[size];
+            Marshal.Copy(sora_result_data(result), buf, 0, size);
+            return System.Text.Encoding.UTF8.GetString(buf);
+        }
+        finally
+        {
+            sora_result_destroy(result);
+        }
+    }
+
 #if UNITY_IOS && !UNITY_EDITOR
     private const string DllName = "__Internal";
 #else
@@ -1778,6 +2823,8 @@ public class Sora : IDisposable
     [DllImport(DllName)]
     private static extern IntPtr sora_create();
     [DllImport(DllName)]
+    private static extern IntPtr sora_create_headless();
+    [DllImport(DllName)]
     private static extern void sora_set_on_add_track(IntPtr p, AddTrackCallbackDelegate? on_add_track, IntPtr userdata);
     [DllImport(DllName)]
     private static extern void sora_set_on_remove_track(IntPtr p, RemoveTrackCallbackDelegate? on_remove_track, IntPtr userdata);
@@ -1804,12 +2851,46 @@ public class Sora : IDisposable
     [DllImport(DllName)]
     private static extern void sora_connect(IntPtr p, string config);
     [DllImport(DllName)]
+    private static extern IntPtr sora_shared_context_create(string config);
+    [DllImport(DllName)]
+    private static extern void sora_shared_context_destroy(IntPtr p);
+    [DllImport(DllName)]
+    private static extern int sora_shared_context_set_speaker_volume(IntPtr p, double volume);
+    [DllImport(DllName)]
+    private static extern int sora_shared_context_set_microphone_volume(IntPtr p, double volume);
+    [DllImport(DllName)]
+    private static extern void sora_connect_with_shared_context(IntPtr p, IntPtr sharedContext, string config);
+    [DllImport(DllName)]
+    private static extern int sora_prepare(IntPtr p, string config);
+    [DllImport(DllName)]
+    private static extern int sora_prepare_with_shared_context(IntPtr p, IntPtr sharedContext, string config);
+    [DllImport(DllName)]
+    private static extern void sora_get_prepare_timings(IntPtr p, out PrepareTimings timings);
+    [DllImport(DllName)]
     private static extern void sora_disconnect(IntPtr p);
     [DllImport(DllName)]
     private static extern void sora_switch_camera(IntPtr p, string config);
     [DllImport(DllName)]
     private static extern IntPtr sora_get_texture_update_callback();
     [DllImport(DllName)]
+    private static extern int sora_register_native_texture(uint video_sink_id, IntPtr native_texture, int width, int height);
+    [DllImport(DllName)]
+    private static extern void sora_unregister_native_texture(uint video_sink_id, IntPtr native_texture);
+    [DllImport(DllName)]
+    private static extern int sora_register_native_texture_atlas(IntPtr native_texture, int width, int height, uint[] video_sink_ids, int[] rects, int count);
+    [DllImport(DllName)]
+    private static extern void sora_unregister_native_texture_atlas(IntPtr native_texture);
+    [DllImport(DllName)]
+    private static extern int sora_get_native_texture_atlas_uv(IntPtr native_texture, uint video_sink_id, [Out] float[] uv);
+    [DllImport(DllName)]
+    private static extern IntPtr sora_get_native_texture_update_callback();
+    [DllImport(DllName)]
+    private static extern IntPtr sora_lock_video_frame(uint video_sink_id, int downscaled, out VideoFrame frame);
+    [DllImport(DllName)]
+    private static extern void sora_unlock_video_frame(IntPtr handle);
+    [DllImport(DllName)]
+    private static extern void sora_set_video_frame_downscale(uint video_sink_id, int width, int height);
+    [DllImport(DllName)]
     private static extern void sora_destroy(IntPtr p);
     [DllImport(DllName)]
     private static extern IntPtr sora_get_render_callback();
@@ -1828,8 +2909,40 @@ public class Sora : IDisposable
     [DllImport(DllName)]
     private static extern void sora_set_on_capturer_frame(IntPtr p, CapturerFrameCallbackDelegate? on_capturer_frame, IntPtr userdata);
     [DllImport(DllName)]
+    private static extern void sora_set_on_switch_camera(IntPtr p, SwitchCameraCallbackDelegate? f, IntPtr userdata);
+    [DllImport(DllName)]
+    private static extern void sora_set_on_add_video_source(IntPtr p, AddVideoSourceCallbackDelegate? f, IntPtr userdata);
+    [DllImport(DllName)]
+    private static extern int sora_add_video_source(IntPtr p, string config);
+    [DllImport(DllName)]
+    private static extern int sora_remove_video_source(IntPtr p, int source_id);
+    [DllImport(DllName)]
+    private static extern int sora_set_sending_video_source(IntPtr p, int source_id);
+    [DllImport(DllName)]
+    private static extern int sora_mark_video_source_dirty(IntPtr p, int source_id);
+    [DllImport(DllName)]
+    private static extern int sora_set_video_encoding_parameters(IntPtr p, string json);
+    [DllImport(DllName)]
+    private static extern IntPtr sora_get_video_encoding_parameters(IntPtr p);
+    [DllImport(DllName)]
+    private static extern void sora_start_receive_quality_controller(IntPtr p, string config);
+    [DllImport(DllName)]
+    private static extern void sora_stop_receive_quality_controller(IntPtr p);
+    [DllImport(DllName)]
+    private static extern void sora_set_video_sink_hint(IntPtr p, uint video_sink_id, int visible, int focused);
+    [DllImport(DllName)]
     private static extern void sora_get_stats(IntPtr p, StatsCallbackDelegate on_get_stats, IntPtr userdata);
     [DllImport(DllName)]
+    private static extern void sora_get_filtered_stats(IntPtr p, string filter, FilteredStatsCallbackDelegate on_get_stats, IntPtr userdata);
+    [DllImport(DllName)]
+    private static extern void sora_start_stats_sampler(IntPtr p, int interval_ms);
+    [DllImport(DllName)]
+    private static extern void sora_stop_stats_sampler(IntPtr p);
+    [DllImport(DllName)]
+    private static extern int sora_read_stats_samples(IntPtr p, [Out] StatsSample[] buf, int size);
+    [DllImport(DllName)]
+    private static extern int sora_read_connect_timeline(IntPtr p, [Out] TimelineEvent[] buf, int size);
+    [DllImport(DllName)]
     private static extern void sora_send_message(IntPtr p, string label, [In] byte[] buf, int size);
     [DllImport(DllName)]
     private static extern int sora_device_enum_video_capturer(DeviceEnumCallbackDelegate f, IntPtr userdata);
@@ -1838,6 +2951,12 @@ public class Sora : IDisposable
     [DllImport(DllName)]
     private static extern int sora_device_enum_audio_playout(DeviceEnumCallbackDelegate f, IntPtr userdata);
     [DllImport(DllName)]
+    private static extern void sora_set_on_device_change(IntPtr p, DeviceChangeCallbackDelegate? f, IntPtr userdata);
+    [DllImport(DllName)]
+    private static extern void sora_refresh_devices();
+    [DllImport(DllName)]
+    private static extern void sora_device_registry_set_fake_devices(string json);
+    [DllImport(DllName)]
     private static extern void sora_setenv(string name, string value);
     [DllImport(DllName)]
     private static extern int sora_get_audio_enabled(IntPtr p);
@@ -1848,43 +2967,33 @@ public class Sora : IDisposable
     [DllImport(DllName)]
     private static extern void sora_set_video_enabled(IntPtr p, int enabled);
     [DllImport(DllName)]
-    private static extern int sora_get_selected_signaling_url_size(IntPtr p);
-    [DllImport(DllName)]
-    private static extern int sora_get_connected_signaling_url_size(IntPtr p);
-    [DllImport(DllName)]
-    private static extern void sora_get_selected_signaling_url(IntPtr p, [Out] byte[] buf, int size);
-    [DllImport(DllName)]
-    private static extern void sora_get_connected_signaling_url(IntPtr p, [Out] byte[] buf, int size);
+    private static extern IntPtr sora_result_data(IntPtr result);
     [DllImport(DllName)]
-    private static extern int sora_get_video_codec_capability_size(string config);
+    private static extern int sora_result_size(IntPtr result);
     [DllImport(DllName)]
-    private static extern void sora_get_video_codec_capability(string config, [Out] byte[] buf, int size);
+    private static extern void sora_result_destroy(IntPtr result);
     [DllImport(DllName)]
-    private static extern int sora_video_codec_preference_has_implementation(string self, string implementation);
-    [DllImport(DllName)]
-    private static extern int sora_video_codec_preference_merge_size(string self, string preference);
+    private static extern IntPtr sora_get_selected_signaling_url(IntPtr p);
     [DllImport(DllName)]
-    private static extern void sora_video_codec_preference_merge(string self, string preference, [Out] byte[] buf, int size);
+    private static extern IntPtr sora_get_connected_signaling_url(IntPtr p);
     [DllImport(DllName)]
-    private static extern int sora_create_video_codec_preference_from_implementation_size(string capability, string implementation);
+    private static extern void sora_set_video_codec_capability_cache_file(string path);
     [DllImport(DllName)]
-    private static extern void sora_create_video_codec_preference_from_implementation(string capability, string implementation, [Out] byte[] buf, int size);
+    private static extern IntPtr sora_get_video_codec_capability(string config);
     [DllImport(DllName)]
-    private static extern int sora_video_codec_capability_to_json_size(string self);
-    [DllImport(DllName)]
-    private static extern void sora_video_codec_capability_to_json(string self, [Out] byte[] buf, int size);
+    private static extern int sora_video_codec_preference_has_implementation(string self, string implementation);
     [DllImport(DllName)]
-    private static extern int sora_video_codec_preference_to_json_size(string self);
+    private static extern IntPtr sora_video_codec_preference_merge(string self, string preference);
     [DllImport(DllName)]
-    private static extern void sora_video_codec_preference_to_json(string self, [Out] byte[] buf, int size);
+    private static extern IntPtr sora_create_video_codec_preference_from_implementation(string capability, string implementation);
     [DllImport(DllName)]
-    private static extern int sora_media_stream_track_get_kind_size(IntPtr p);
+    private static extern IntPtr sora_video_codec_capability_to_json(string self);
     [DllImport(DllName)]
-    private static extern void sora_media_stream_track_get_kind(IntPtr p, [Out] byte[] buf, int size);
+    private static extern IntPtr sora_video_codec_preference_to_json(string self);
     [DllImport(DllName)]
-    private static extern int sora_media_stream_track_get_id_size(IntPtr p);
+    private static extern IntPtr sora_media_stream_track_get_kind(IntPtr p);
     [DllImport(DllName)]
-    private static extern void sora_media_stream_track_get_id(IntPtr p, [Out] byte[] buf, int size);
+    private static extern IntPtr sora_media_stream_track_get_id(IntPtr p);
 
     private delegate void sora_audio_track_on_data_fn(IntPtr buf, int bits_per_sample, int sample_rate, int number_of_channels, int number_of_frames, IntPtr absolute_capture_timestamp_ms, IntPtr userdata);
     private delegate int sora_audio_track_num_preferred_channels_fn(IntPtr userdata);
@@ -1902,15 +3011,15 @@ public class Sora : IDisposable
     [DllImport(DllName)]
     private static extern IntPtr sora_get_video_track_from_video_sink_id(IntPtr p, uint videoSinkId);
     [DllImport(DllName)]
+    private static extern uint sora_add_video_sink(IntPtr p, IntPtr track);
+    [DllImport(DllName)]
     private static extern uint sora_get_video_sink_id_from_video_track(IntPtr p, IntPtr videoTrack);
 
     [DllImport(DllName)]
     private static extern IntPtr sora_rtp_transceiver_get_receiver(IntPtr p);
 
     [DllImport(DllName)]
-    private static extern int sora_rtp_receiver_get_info_size(IntPtr p);
-    [DllImport(DllName)]
-    private static extern void sora_rtp_receiver_get_info(IntPtr p, [Out] byte[] buf, int size);
+    private static extern IntPtr sora_rtp_receiver_get_info(IntPtr p);
 
     public interface IAudioOutputHelper : IDisposable
     {
@@ -2094,10 +3203,7 @@ public class Sora : IDisposable
         {
             get
             {
-                int size = sora_media_stream_track_get_kind_size(p);
-                byte[] buf = new byte[size];
-                sora_media_stream_track_get_kind(p, buf, size);
-                return System.Text.Encoding.UTF8.GetString(buf);
+                return TakeResult(sora_media_stream_track_get_kind(p));
             }
         }
 
@@ -2105,10 +3211,7 @@ public class Sora : IDisposable
         {
             get
             {
-                int size = sora_media_stream_track_get_id_size(p);
-                byte[] buf = new byte[size];
-                sora_media_stream_track_get_id(p, buf, size);
-                return System.Text.Encoding.UTF8.GetString(buf);
+                return TakeResult(sora_media_stream_track_get_id(p));
             }
         }
     }
@@ -2290,6 +3393,9 @@ public class Sora : IDisposable
     /// 
     /// プラットフォームによっては、スピーカーの音量を設定できない場合があります。
     /// その場合、この関数は false を返します。
+    /// 
+    /// SharedContext を使っている場合は全ての接続の音量が変わってしまうので、この関数は false を返します。
+    /// 代わりに SharedContext.SetSpeakerVolume() を使って下さい。
     /// </remarks>
     /// <param name="volume">音量。[0.0, 1.0] の範囲で設定して下さい。</param>
     /// <returns>設定に成功した場合は true を返します。</returns>
@@ -2307,6 +3413,9 @@ public class Sora : IDisposable
     /// 
     /// プラットフォームによっては、マイクの音量を設定できない場合があります。
     /// その場合、この関数は false を返します。
+    /// 
+    /// SharedContext を使っている場合は全ての接続の音量が変わってしまうので、この関数は false を返します。
+    /// 代わりに SharedContext.SetMicrophoneVolume() を使って下さい。
     /// </remarks>
     /// <param name="volume">音量。[0.0, 1.0] の範囲で設定して下さい。</param>
     /// <returns>設定に成功した場合は true を返します。</returns>
@@ -2364,10 +3473,7 @@ public class Sora : IDisposable
 
         internal SoraConf.Internal.RtpReceiverInfo GetInfo()
         {
-            int size = sora_rtp_receiver_get_info_size(p);
-            byte[] buf = new byte[size];
-            sora_rtp_receiver_get_info(p, buf, size);
-            var info = Jsonif.Json.FromJson<SoraConf.Internal.RtpReceiverInfo>(System.Text.Encoding.UTF8.GetString(buf));
+            var info = Jsonif.Json.FromJson<SoraConf.Internal.RtpReceiverInfo>(TakeResult(sora_rtp_receiver_get_info(p)));
             return info;
         }
 
@@ -451,6 +451,11 @@ def _build(args):
         else:
             raise Exception(f"Platform {platform} not supported.")
 
+        if args.test:
+            if platform in ("ios", "android"):
+                raise Exception(f"Tests are not supported on {platform}.")
+            cmake_args.append("-DSORA_UNITY_SDK_BUILD_TEST=ON")
+
         cmd(["cmake", BASE_DIR, *cmake_args])
         cmd(
             [
@@ -462,6 +467,8 @@ def _build(args):
                 configuration,
             ]
         )
+        if args.test:
+            cmd(["ctest", "--output-on-failure", "-C", configuration])
 
     # ビルドしたライブラリを SoraUnitySdkExamples 以下のプロジェクトにコピーする
     plugins_dir = os.path.join(
@@ -630,6 +637,8 @@ def main():
     bp.add_argument("target", choices=AVAILABLE_TARGETS)
     bp.add_argument("--debug", action="store_true")
     bp.add_argument("--relwithdebinfo", action="store_true")
+    # Unity を使わずにプラグインを動かすテストをビルドして実行する
+    bp.add_argument("--test", action="store_true")
     bp.add_argument("--local-webrtc-build-dir", type=os.path.abspath)
     bp.add_argument("--local-webrtc-build-args", default="", type=shlex.split)
     bp.add_argument("--local-sora-cpp-sdk-dir", type=os.path.abspath)
@@ -0,0 +1,13 @@
+#include "../device_watcher.h"
+
+namespace sora_unity_sdk {
+
+// Android のオーディオデバイスは DeviceList で常に 1 個として扱っていて、
+// カメラの抜き差しも Java の API でしか受け取れないので、OS の通知は使わない。
+// デバイスの変化は sora_refresh_devices() で明示的に確認する。
+std::unique_ptr<DeviceWatcher> DeviceWatcher::Create(
+    std::function<void(DeviceKind)> on_change) {
+  return nullptr;
+}
+
+}  // namespace sora_unity_sdk
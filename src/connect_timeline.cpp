@@ -0,0 +1,40 @@
+#include "connect_timeline.h"
+
+#include <algorithm>
+#include <cstring>
+
+// WebRTC
+#include <rtc_base/time_utils.h>
+
+namespace sora_unity_sdk {
+
+void ConnectTimeline::Reset() {
+  std::lock_guard<std::mutex> guard(mutex_);
+  events_.clear();
+}
+
+void ConnectTimeline::Record(int32_t type, ptrid_t video_sink_id) {
+  int64_t now_us = webrtc::TimeMicros();
+  std::lock_guard<std::mutex> guard(mutex_);
+  for (const auto& e : events_) {
+    if (e.type == type && e.video_sink_id == video_sink_id) {
+      return;
+    }
+  }
+  sora_timeline_event_t e;
+  e.type = type;
+  e.video_sink_id = video_sink_id;
+  e.timestamp_us = now_us;
+  events_.push_back(e);
+}
+
+int ConnectTimeline::Read(sora_timeline_event_t* buf, int size) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  int n = std::min(size, (int)events_.size());
+  if (n > 0) {
+    std::memcpy(buf, events_.data(), n * sizeof(sora_timeline_event_t));
+  }
+  return (int)events_.size();
+}
+
+}  // namespace sora_unity_sdk
@@ -0,0 +1,30 @@
+#ifndef SORA_UNITY_SDK_CONNECT_TIMELINE_H_INCLUDED
+#define SORA_UNITY_SDK_CONNECT_TIMELINE_H_INCLUDED
+
+#include <mutex>
+#include <vector>
+
+#include "unity.h"
+
+namespace sora_unity_sdk {
+
+// 接続を開始してから最初のフレームが描画されるまでの各イベントの時刻を記録する。
+//
+// 時刻は webrtc::TimeMicros() の単調増加するクロックで記録する。
+// 同じ種類・同じ video_sink_id のイベントは最初の 1 回だけ記録する。
+// 色々なスレッドから呼ばれるので、全てロックを取って処理する。
+class ConnectTimeline {
+ public:
+  void Reset();
+  void Record(int32_t type, ptrid_t video_sink_id = 0);
+  // 記録したイベントを buf に最大 size 個コピーし、イベントの総数を返す。
+  int Read(sora_timeline_event_t* buf, int size);
+
+ private:
+  std::mutex mutex_;
+  std::vector<sora_timeline_event_t> events_;
+};
+
+}  // namespace sora_unity_sdk
+
+#endif
@@ -0,0 +1,160 @@
+#include "decode_gate.h"
+
+#include <cstring>
+
+// WebRTC
+#include <api/video_codecs/video_decoder.h>
+#include <modules/video_coding/include/video_error_codes.h>
+#include <rtc_base/logging.h>
+
+namespace sora_unity_sdk {
+
+namespace {
+
+// 読み飛ばすフレームのペイロード。
+// 実際のエンコード結果と偶然一致することが無いように、ありえない内容にしている
+const uint8_t kSkippedPayload[] = {0x00, 0x00, 0x00, 0x00, 'S', 'o', 'r',
+                                   'a',  'S',  'k',  'i',  'p', 0x00, 0x00};
+
+class DecodeGateVideoDecoder : public webrtc::VideoDecoder {
+ public:
+  explicit DecodeGateVideoDecoder(
+      std::unique_ptr<webrtc::VideoDecoder> decoder)
+      : decoder_(std::move(decoder)) {}
+
+  bool Configure(const Settings& settings) override {
+    return decoder_->Configure(settings);
+  }
+  int32_t Decode(const webrtc::EncodedImage& input_image,
+                 int64_t render_time_ms) override {
+    // デコード結果は返さないが、フレームはデコード済みとして扱われる
+    if (DecodeGate::IsSkippedFrame(input_image)) {
+      return WEBRTC_VIDEO_CODEC_OK;
+    }
+    return decoder_->Decode(input_image, render_time_ms);
+  }
+  int32_t RegisterDecodeCompleteCallback(
+      webrtc::DecodedImageCallback* callback) override {
+    return decoder_->RegisterDecodeCompleteCallback(callback);
+  }
+  int32_t Release() override { return decoder_->Release(); }
+  DecoderInfo GetDecoderInfo() const override {
+    return decoder_->GetDecoderInfo();
+  }
+  const char* ImplementationName() const override {
+    return decoder_->ImplementationName();
+  }
+
+ private:
+  std::unique_ptr<webrtc::VideoDecoder> decoder_;
+};
+
+}  // namespace
+
+void DecodeGate::SetPaused(bool paused) {
+  if (paused_.exchange(paused) == paused) {
+    return;
+  }
+  RTC_LOG(LS_INFO) << "DecodeGate: paused=" << paused;
+  if (!paused) {
+    waiting_key_frame_ = true;
+  }
+}
+
+bool DecodeGate::IsPaused() const {
+  return paused_;
+}
+
+bool DecodeGate::ShouldDecode(bool is_key_frame) {
+  if (paused_) {
+    return false;
+  }
+  if (waiting_key_frame_) {
+    if (!is_key_frame) {
+      return false;
+    }
+    waiting_key_frame_ = false;
+  }
+  return true;
+}
+
+webrtc::ArrayView<const uint8_t> DecodeGate::SkippedPayload() {
+  return kSkippedPayload;
+}
+
+bool DecodeGate::IsSkippedFrame(const webrtc::EncodedImage& image) {
+  return image.size() == sizeof(kSkippedPayload) &&
+         std::memcmp(image.data(), kSkippedPayload, sizeof(kSkippedPayload)) ==
+             0;
+}
+
+void DecodeGate::Transform(
+    std::unique_ptr<webrtc::TransformableFrameInterface> transformable_frame) {
+  // フレームを捨てるとキーフレームを要求されるので、中身だけ置き換えて渡す
+  auto frame = static_cast<webrtc::TransformableVideoFrameInterface*>(
+      transformable_frame.get());
+  if (!ShouldDecode(frame->IsKeyFrame())) {
+    frame->SetData(SkippedPayload());
+  }
+
+  webrtc::scoped_refptr<webrtc::TransformedFrameCallback> callback;
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto it = sink_callbacks_.find(transformable_frame->GetSsrc());
+    callback = it != sink_callbacks_.end() ? it->second : callback_;
+  }
+  if (callback != nullptr) {
+    callback->OnTransformedFrame(std::move(transformable_frame));
+  }
+}
+
+void DecodeGate::RegisterTransformedFrameCallback(
+    webrtc::scoped_refptr<webrtc::TransformedFrameCallback> callback) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  callback_ = callback;
+}
+
+void DecodeGate::RegisterTransformedFrameSinkCallback(
+    webrtc::scoped_refptr<webrtc::TransformedFrameCallback> callback,
+    uint32_t ssrc) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  sink_callbacks_[ssrc] = callback;
+}
+
+void DecodeGate::UnregisterTransformedFrameCallback() {
+  std::lock_guard<std::mutex> guard(mutex_);
+  callback_ = nullptr;
+}
+
+void DecodeGate::UnregisterTransformedFrameSinkCallback(uint32_t ssrc) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  sink_callbacks_.erase(ssrc);
+}
+
+DecodeGateVideoDecoderFactory::DecodeGateVideoDecoderFactory(
+    std::unique_ptr<webrtc::VideoDecoderFactory> factory)
+    : factory_(std::move(factory)) {}
+
+std::vector<webrtc::SdpVideoFormat>
+DecodeGateVideoDecoderFactory::GetSupportedFormats() const {
+  return factory_->GetSupportedFormats();
+}
+
+webrtc::VideoDecoderFactory::CodecSupport
+DecodeGateVideoDecoderFactory::QueryCodecSupport(
+    const webrtc::SdpVideoFormat& format,
+    bool reference_scaling) const {
+  return factory_->QueryCodecSupport(format, reference_scaling);
+}
+
+std::unique_ptr<webrtc::VideoDecoder> DecodeGateVideoDecoderFactory::Create(
+    const webrtc::Environment& env,
+    const webrtc::SdpVideoFormat& format) {
+  auto decoder = factory_->Create(env, format);
+  if (decoder == nullptr) {
+    return nullptr;
+  }
+  return std::make_unique<DecodeGateVideoDecoder>(std::move(decoder));
+}
+
+}  // namespace sora_unity_sdk
@@ -0,0 +1,83 @@
+#ifndef SORA_UNITY_SDK_DECODE_GATE_H_INCLUDED
+#define SORA_UNITY_SDK_DECODE_GATE_H_INCLUDED
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// WebRTC
+#include <api/array_view.h>
+#include <api/environment/environment.h>
+#include <api/frame_transformer_interface.h>
+#include <api/scoped_refptr.h>
+#include <api/video/encoded_image.h>
+#include <api/video_codecs/video_decoder_factory.h>
+
+namespace sora_unity_sdk {
+
+// 受信した映像のエンコード済みフレームをデコードするかどうかを切り替える。
+//
+// RtpReceiver::SetDepacketizerToDecoderFrameTransformer に設定して使う。
+// フレームを捨てるとフレームバッファにデコードできるフレームが無くなり、
+// 受信ストリームが 200ms 毎にキーフレームを要求してしまうので、フレームは全て渡す。
+// 一時停止中はペイロードを目印に置き換え、DecodeGateVideoDecoderFactory の
+// デコーダが目印のフレームをデコードせずに読み飛ばす。
+// 再開した後は、参照フレームが欠けているのでキーフレームが届くまで読み飛ばす。
+class DecodeGate : public webrtc::FrameTransformerInterface {
+ public:
+  void SetPaused(bool paused);
+  bool IsPaused() const;
+
+  // フレームをデコードするかどうかを返す。キーフレームを待っている状態も更新する
+  bool ShouldDecode(bool is_key_frame);
+  // 読み飛ばすことにしたフレームのペイロードをこれに置き換える
+  static webrtc::ArrayView<const uint8_t> SkippedPayload();
+  // DecodeGate が読み飛ばすことにしたフレームかどうか
+  static bool IsSkippedFrame(const webrtc::EncodedImage& image);
+
+  void Transform(std::unique_ptr<webrtc::TransformableFrameInterface>
+                     transformable_frame) override;
+  void RegisterTransformedFrameCallback(
+      webrtc::scoped_refptr<webrtc::TransformedFrameCallback> callback)
+      override;
+  void RegisterTransformedFrameSinkCallback(
+      webrtc::scoped_refptr<webrtc::TransformedFrameCallback> callback,
+      uint32_t ssrc) override;
+  void UnregisterTransformedFrameCallback() override;
+  void UnregisterTransformedFrameSinkCallback(uint32_t ssrc) override;
+
+ private:
+  std::atomic<bool> paused_{false};
+  std::atomic<bool> waiting_key_frame_{false};
+
+  std::mutex mutex_;
+  webrtc::scoped_refptr<webrtc::TransformedFrameCallback> callback_;
+  std::map<uint32_t, webrtc::scoped_refptr<webrtc::TransformedFrameCallback>>
+      sink_callbacks_;
+};
+
+// DecodeGate が読み飛ばすことにしたフレームを、デコーダに渡さずに捨てる。
+//
+// 捨てたフレームはデコード済みとして扱われるので、フレームバッファは止まらない。
+// DecodeGate を使っていない受信ストリームでは何もしない。
+class DecodeGateVideoDecoderFactory : public webrtc::VideoDecoderFactory {
+ public:
+  explicit DecodeGateVideoDecoderFactory(
+      std::unique_ptr<webrtc::VideoDecoderFactory> factory);
+
+  std::vector<webrtc::SdpVideoFormat> GetSupportedFormats() const override;
+  CodecSupport QueryCodecSupport(const webrtc::SdpVideoFormat& format,
+                                 bool reference_scaling) const override;
+  std::unique_ptr<webrtc::VideoDecoder> Create(
+      const webrtc::Environment& env,
+      const webrtc::SdpVideoFormat& format) override;
+
+ private:
+  std::unique_ptr<webrtc::VideoDecoderFactory> factory_;
+};
+
+}  // namespace sora_unity_sdk
+
+#endif
@@ -0,0 +1,296 @@
+#include "device_registry.h"
+
+// WebRTC
+#include <rtc_base/logging.h>
+#if defined(SORA_UNITY_SDK_WINDOWS)
+#include <rtc_base/win/scoped_com_initializer.h>
+#endif
+
+#include "device_list.h"
+#include "device_watcher.h"
+
+namespace sora_unity_sdk {
+
+// PlatformDeviceBackend
+
+std::optional<std::vector<DeviceInfo>> PlatformDeviceBackend::Enum(
+    DeviceKind kind) {
+  std::vector<DeviceInfo> devices;
+  auto f = [&devices](std::string device_name, std::string unique_name) {
+    devices.push_back({std::move(device_name), std::move(unique_name)});
+  };
+  bool result = false;
+  switch (kind) {
+    case DeviceKind::kVideoCapturer:
+      result = DeviceList::EnumVideoCapturer(f);
+      break;
+    case DeviceKind::kAudioRecording:
+      result = DeviceList::EnumAudioRecording(f);
+      break;
+    case DeviceKind::kAudioPlayout:
+      result = DeviceList::EnumAudioPlayout(f);
+      break;
+  }
+  if (!result) {
+    return std::nullopt;
+  }
+  return devices;
+}
+
+// FakeDeviceBackend
+
+void FakeDeviceBackend::SetDevices(
+    const sora_conf::internal::FakeDevices& devices) {
+  auto convert = [](const std::vector<sora_conf::internal::FakeDevices::Device>&
+                        ds) {
+    std::vector<DeviceInfo> r;
+    for (const auto& d : ds) {
+      r.push_back({d.device_name, d.unique_name});
+    }
+    return r;
+  };
+  std::lock_guard<std::mutex> guard(mutex_);
+  devices_[(int)DeviceKind::kVideoCapturer] = convert(devices.video_capturers);
+  devices_[(int)DeviceKind::kAudioRecording] =
+      convert(devices.audio_recording_devices);
+  devices_[(int)DeviceKind::kAudioPlayout] =
+      convert(devices.audio_playout_devices);
+}
+
+std::optional<std::vector<DeviceInfo>> FakeDeviceBackend::Enum(
+    DeviceKind kind) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return devices_[(int)kind];
+}
+
+// DeviceRegistry
+
+DeviceRegistry& DeviceRegistry::Instance() {
+  static DeviceRegistry registry;
+  return registry;
+}
+
+DeviceRegistry::DeviceRegistry()
+    : DeviceRegistry(std::make_shared<PlatformDeviceBackend>()) {}
+
+DeviceRegistry::DeviceRegistry(std::shared_ptr<DeviceBackend> backend)
+    : backend_(std::move(backend)) {}
+
+DeviceRegistry::~DeviceRegistry() {
+  Shutdown();
+}
+
+bool DeviceRegistry::Enum(DeviceKind kind,
+                          std::function<void(std::string, std::string)> f) {
+  std::optional<std::vector<DeviceInfo>> devices;
+  std::shared_ptr<DeviceBackend> backend;
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (running_) {
+      devices = devices_[(int)kind];
+    }
+    backend = backend_;
+  }
+
+  if (!devices) {
+    // キャッシュが無い場合は呼び出し元のスレッドで列挙する
+    devices = backend->Enum(kind);
+    if (!devices) {
+      return false;
+    }
+    std::lock_guard<std::mutex> guard(mutex_);
+    // 列挙している間にバックグラウンドで更新されていたら、そちらを優先する
+    if (running_ && !devices_[(int)kind]) {
+      devices_[(int)kind] = devices;
+    }
+  }
+
+  for (const auto& d : *devices) {
+    f(d.device_name, d.unique_name);
+  }
+  return true;
+}
+
+int DeviceRegistry::AddListener(std::function<void(DeviceKind)> listener) {
+  int id;
+  {
+    std::lock_guard<std::mutex> guard(listeners_mutex_);
+    id = next_listener_id_++;
+    listeners_[id] = std::move(listener);
+  }
+  UpdateWatching();
+  return id;
+}
+
+void DeviceRegistry::RemoveListener(int id) {
+  {
+    // 通知中は listeners_mutex_ を取っているので、ここで待つことになる
+    std::lock_guard<std::mutex> guard(listeners_mutex_);
+    listeners_.erase(id);
+  }
+  UpdateWatching();
+}
+
+void DeviceRegistry::RequestRefresh() {
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (!running_) {
+    return;
+  }
+  for (int i = 0; i < 3; i++) {
+    refresh_requested_[i] = true;
+  }
+  cond_.notify_all();
+}
+
+void DeviceRegistry::RequestRefresh(DeviceKind kind) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (!running_) {
+    return;
+  }
+  refresh_requested_[(int)kind] = true;
+  cond_.notify_all();
+}
+
+void DeviceRegistry::SetFakeDevices(
+    const sora_conf::internal::FakeDevices& devices) {
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (fake_backend_ == nullptr) {
+      RTC_LOG(LS_INFO) << "DeviceRegistry: switch to fake backend";
+      fake_backend_ = std::make_shared<FakeDeviceBackend>();
+      backend_ = fake_backend_;
+    }
+    fake_backend_->SetDevices(devices);
+  }
+  RequestRefresh();
+}
+
+void DeviceRegistry::Shutdown() {
+  std::lock_guard<std::mutex> guard(watch_mutex_);
+  Stop();
+}
+
+void DeviceRegistry::UpdateWatching() {
+  std::lock_guard<std::mutex> watch_guard(watch_mutex_);
+  bool has_listeners;
+  {
+    std::lock_guard<std::mutex> guard(listeners_mutex_);
+    has_listeners = !listeners_.empty();
+  }
+  if (!has_listeners) {
+    Stop();
+    return;
+  }
+
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (running_) {
+    return;
+  }
+  RTC_LOG(LS_INFO) << "DeviceRegistry: start watching devices";
+  running_ = true;
+  thread_ = std::thread([this]() { Run(); });
+}
+
+void DeviceRegistry::Stop() {
+  std::thread thread;
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (!running_) {
+      return;
+    }
+    RTC_LOG(LS_INFO) << "DeviceRegistry: stop watching devices";
+    running_ = false;
+    // 通知を受け取らなくなるので、キャッシュも捨てる
+    for (int i = 0; i < 3; i++) {
+      devices_[i] = std::nullopt;
+      refresh_requested_[i] = false;
+    }
+    thread = std::move(thread_);
+  }
+  cond_.notify_all();
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+void DeviceRegistry::Run() {
+#if defined(SORA_UNITY_SDK_WINDOWS)
+  // 通知の登録と、ADM を使ったデバイスの列挙に COM が必要
+  webrtc::ScopedCOMInitializer com(webrtc::ScopedCOMInitializer::kMTA);
+  if (!com.Succeeded()) {
+    RTC_LOG(LS_WARNING) << "DeviceRegistry: failed to initialize COM";
+  }
+#endif
+
+  auto watcher = DeviceWatcher::Create(
+      [this](DeviceKind kind) { RequestRefresh(kind); });
+  if (watcher == nullptr) {
+    RTC_LOG(LS_INFO) << "DeviceRegistry: device notifications are not "
+                        "available, use RequestRefresh()";
+  }
+
+  while (true) {
+    bool requested[3];
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cond_.wait(lock, [this]() {
+        return !running_ || refresh_requested_[0] || refresh_requested_[1] ||
+               refresh_requested_[2];
+      });
+      if (!running_) {
+        break;
+      }
+      for (int i = 0; i < 3; i++) {
+        requested[i] = refresh_requested_[i];
+        refresh_requested_[i] = false;
+      }
+    }
+
+    auto changed = Refresh(requested);
+    if (changed.empty()) {
+      continue;
+    }
+    std::lock_guard<std::mutex> guard(listeners_mutex_);
+    for (auto kind : changed) {
+      RTC_LOG(LS_INFO) << "DeviceRegistry: devices changed: kind=" << (int)kind;
+      for (const auto& kv : listeners_) {
+        kv.second(kind);
+      }
+    }
+  }
+
+  // 通知の登録を外すのも、登録したスレッドで行う
+  watcher.reset();
+}
+
+std::vector<DeviceKind> DeviceRegistry::Refresh(const bool (&requested)[3]) {
+  std::shared_ptr<DeviceBackend> backend;
+  bool enumerated[3];
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    backend = backend_;
+    for (int i = 0; i < 3; i++) {
+      enumerated[i] = devices_[i].has_value();
+    }
+  }
+
+  // 一度も列挙されていない種類は、誰も使っていないので更新しない
+  std::vector<DeviceKind> changed;
+  for (int i = 0; i < 3; i++) {
+    if (!requested[i] || !enumerated[i]) {
+      continue;
+    }
+    auto devices = backend->Enum((DeviceKind)i);
+    if (!devices) {
+      continue;
+    }
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (running_ && devices_[i] != devices) {
+      devices_[i] = std::move(devices);
+      changed.push_back((DeviceKind)i);
+    }
+  }
+  return changed;
+}
+
+}  // namespace sora_unity_sdk
@@ -0,0 +1,121 @@
+#ifndef SORA_UNITY_SDK_DEVICE_REGISTRY_H_INCLUDED
+#define SORA_UNITY_SDK_DEVICE_REGISTRY_H_INCLUDED
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sora_conf_internal.json.h"
+
+namespace sora_unity_sdk {
+
+struct DeviceInfo {
+  std::string device_name;
+  std::string unique_name;
+
+  bool operator==(const DeviceInfo& other) const {
+    return device_name == other.device_name && unique_name == other.unique_name;
+  }
+};
+
+// デバイスの種類
+enum class DeviceKind {
+  kVideoCapturer = 0,
+  kAudioRecording = 1,
+  kAudioPlayout = 2,
+};
+
+// デバイスを列挙する実装
+class DeviceBackend {
+ public:
+  virtual ~DeviceBackend() = default;
+  // 列挙に失敗した場合は std::nullopt を返す
+  virtual std::optional<std::vector<DeviceInfo>> Enum(DeviceKind kind) = 0;
+};
+
+// DeviceList を使って実際のデバイスを列挙する
+class PlatformDeviceBackend : public DeviceBackend {
+ public:
+  std::optional<std::vector<DeviceInfo>> Enum(DeviceKind kind) override;
+};
+
+// 実際のデバイスが無い環境で動作確認するための、外から設定したデバイスを返す実装
+class FakeDeviceBackend : public DeviceBackend {
+ public:
+  void SetDevices(const sora_conf::internal::FakeDevices& devices);
+  std::optional<std::vector<DeviceInfo>> Enum(DeviceKind kind) override;
+
+ private:
+  std::mutex mutex_;
+  std::vector<DeviceInfo> devices_[3];
+};
+
+// デバイスの一覧をキャッシュして、デバイスの抜き差しがあった時だけ更新する。
+//
+// デバイスの列挙は ADM の作成や初期化などで重いので、キャッシュは OS のデバイスの変化の通知を
+// 受け取っている間だけ使う。通知はリスナーが登録されている間だけ受け取り、その間だけ
+// バックグラウンドのスレッドが動く。リスナーがいない間は、呼び出し元のスレッドで毎回列挙する。
+//
+// 通知を受けると、変化した種類のデバイスをバックグラウンドのスレッドで列挙し直して、
+// 一覧に変化があった場合はリスナーに通知する。
+class DeviceRegistry {
+ public:
+  static DeviceRegistry& Instance();
+  // Instance() とは別に、指定したバックエンドで列挙するものを作る。テストで使う
+  explicit DeviceRegistry(std::shared_ptr<DeviceBackend> backend);
+  ~DeviceRegistry();
+
+  bool Enum(DeviceKind kind, std::function<void(std::string, std::string)> f);
+
+  // リスナーはバックグラウンドのスレッドから呼ばれる。
+  // RemoveListener() から戻った後にリスナーが呼ばれることは無い。
+  int AddListener(std::function<void(DeviceKind)> listener);
+  void RemoveListener(int id);
+
+  // 一覧を取得済みの全ての種類のデバイスを列挙し直して、変化があればリスナーに通知する。
+  // OS の通知を受け取れないプラットフォームで使う。リスナーがいない場合は何もしない
+  void RequestRefresh();
+
+  // 以降はフェイクのデバイスを返すようにする
+  void SetFakeDevices(const sora_conf::internal::FakeDevices& devices);
+
+  // バックグラウンドのスレッドを止める。プラグインのアンロード時に呼ぶ。
+  void Shutdown();
+
+ private:
+  DeviceRegistry();
+  void RequestRefresh(DeviceKind kind);
+  // リスナーの有無に合わせてスレッドを開始、停止する
+  void UpdateWatching();
+  void Stop();
+  void Run();
+  // 要求された種類のデバイスを列挙して、変化があった種類を返す
+  std::vector<DeviceKind> Refresh(const bool (&requested)[3]);
+
+  // UpdateWatching() と Shutdown() を直列にする
+  std::mutex watch_mutex_;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::shared_ptr<DeviceBackend> backend_;
+  std::shared_ptr<FakeDeviceBackend> fake_backend_;
+  // running_ の間だけ使う
+  std::optional<std::vector<DeviceInfo>> devices_[3];
+  bool refresh_requested_[3] = {};
+  std::thread thread_;
+  bool running_ = false;
+
+  std::mutex listeners_mutex_;
+  int next_listener_id_ = 1;
+  std::map<int, std::function<void(DeviceKind)>> listeners_;
+};
+
+}  // namespace sora_unity_sdk
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef SORA_UNITY_SDK_DEVICE_WATCHER_H_INCLUDED
+#define SORA_UNITY_SDK_DEVICE_WATCHER_H_INCLUDED
+
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#include "device_registry.h"
+
+namespace sora_unity_sdk {
+
+// OS のデバイスの抜き差しの通知を受け取る。
+//
+// 通知は OS のスレッドから呼ばれるので、受け取った側では重い処理をしないこと。
+// デストラクタから戻った後に通知が呼ばれることは無い。
+class DeviceWatcher {
+ public:
+  virtual ~DeviceWatcher() = default;
+
+  // 対応していないプラットフォームや、通知の登録に失敗した場合は nullptr を返す。
+  // Windows では COM を初期化したスレッドから呼ぶこと。
+  static std::unique_ptr<DeviceWatcher> Create(
+      std::function<void(DeviceKind)> on_change);
+};
+
+// 各プラットフォームの実装で使う、通知先を安全に外すためのヘルパー
+class DeviceWatcherNotifier {
+ public:
+  explicit DeviceWatcherNotifier(std::function<void(DeviceKind)> on_change)
+      : on_change_(std::move(on_change)) {}
+
+  void Notify(DeviceKind kind) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (on_change_) {
+      on_change_(kind);
+    }
+  }
+  // 以降は Notify() を呼んでも何もしない。
+  // 実行中の Notify() があればそれが終わるまで待つ
+  void Clear() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    on_change_ = nullptr;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::function<void(DeviceKind)> on_change_;
+};
+
+}  // namespace sora_unity_sdk
+
+#endif
@@ -0,0 +1,127 @@
+#include "device_watcher.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <thread>
+
+// WebRTC
+#include <rtc_base/logging.h>
+
+namespace sora_unity_sdk {
+
+namespace {
+
+// /dev/video* と /dev/snd/* の作成と削除を inotify で監視する。
+//
+// udev や PulseAudio のイベントを使うと追加のライブラリが必要になるので、
+// デバイスノードの変化だけを見ている。そのため Bluetooth のオーディオデバイスなど、
+// デバイスノードを作らないものの抜き差しは検出できない。
+class LinuxDeviceWatcher : public DeviceWatcher {
+ public:
+  explicit LinuxDeviceWatcher(std::function<void(DeviceKind)> on_change)
+      : notifier_(std::move(on_change)) {}
+
+  ~LinuxDeviceWatcher() override {
+    if (thread_.joinable()) {
+      uint64_t v = 1;
+      if (write(stop_fd_, &v, sizeof(v)) < 0) {
+        RTC_LOG(LS_WARNING) << "Failed to stop LinuxDeviceWatcher";
+      }
+      thread_.join();
+    }
+    notifier_.Clear();
+    if (inotify_fd_ >= 0) {
+      close(inotify_fd_);
+    }
+    if (stop_fd_ >= 0) {
+      close(stop_fd_);
+    }
+  }
+
+  bool Init() {
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    stop_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (inotify_fd_ < 0 || stop_fd_ < 0) {
+      RTC_LOG(LS_WARNING) << "Failed to create inotify: "
+                          << std::strerror(errno);
+      return false;
+    }
+    dev_wd_ = inotify_add_watch(inotify_fd_, "/dev", IN_CREATE | IN_DELETE);
+    snd_wd_ =
+        inotify_add_watch(inotify_fd_, "/dev/snd", IN_CREATE | IN_DELETE);
+    if (dev_wd_ < 0 && snd_wd_ < 0) {
+      RTC_LOG(LS_WARNING) << "Failed to inotify_add_watch: "
+                          << std::strerror(errno);
+      return false;
+    }
+    thread_ = std::thread([this]() { Run(); });
+    return true;
+  }
+
+ private:
+  void Run() {
+    alignas(inotify_event) char buf[4096];
+    while (true) {
+      pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {stop_fd_, POLLIN, 0}};
+      if (poll(fds, 2, -1) < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        RTC_LOG(LS_WARNING) << "Failed to poll: " << std::strerror(errno);
+        return;
+      }
+      if (fds[1].revents != 0) {
+        return;
+      }
+
+      bool video = false;
+      bool audio = false;
+      ssize_t n;
+      while ((n = read(inotify_fd_, buf, sizeof(buf))) > 0) {
+        for (char* p = buf; p < buf + n;) {
+          auto ev = reinterpret_cast<const inotify_event*>(p);
+          std::string name = ev->len > 0 ? ev->name : "";
+          if (ev->wd == dev_wd_ && name.rfind("video", 0) == 0) {
+            video = true;
+          } else if (ev->wd == snd_wd_) {
+            audio = true;
+          }
+          p += sizeof(inotify_event) + ev->len;
+        }
+      }
+      if (video) {
+        notifier_.Notify(DeviceKind::kVideoCapturer);
+      }
+      if (audio) {
+        notifier_.Notify(DeviceKind::kAudioRecording);
+        notifier_.Notify(DeviceKind::kAudioPlayout);
+      }
+    }
+  }
+
+  DeviceWatcherNotifier notifier_;
+  int inotify_fd_ = -1;
+  int stop_fd_ = -1;
+  int dev_wd_ = -1;
+  int snd_wd_ = -1;
+  std::thread thread_;
+};
+
+}  // namespace
+
+std::unique_ptr<DeviceWatcher> DeviceWatcher::Create(
+    std::function<void(DeviceKind)> on_change) {
+  auto watcher = std::make_unique<LinuxDeviceWatcher>(std::move(on_change));
+  if (!watcher->Init()) {
+    return nullptr;
+  }
+  return watcher;
+}
+
+}  // namespace sora_unity_sdk
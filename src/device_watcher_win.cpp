@@ -0,0 +1,195 @@
+#include "device_watcher.h"
+
+#include <windows.h>
+
+#include <cfgmgr32.h>
+#include <mmdeviceapi.h>
+#include <wrl/client.h>
+
+#include <atomic>
+#include <vector>
+
+// WebRTC
+#include <rtc_base/logging.h>
+
+namespace sora_unity_sdk {
+
+namespace {
+
+// KSCATEGORY_VIDEO_CAMERA と KSCATEGORY_VIDEO。
+// ksmedia.h の GUID を使うと ksguid.lib が必要になるので、ここで定義する
+const GUID kVideoCameraCategory = {
+    0xe5323777,
+    0xf976,
+    0x4f5b,
+    {0x9b, 0x55, 0xb9, 0x46, 0x99, 0xc4, 0x6e, 0x44}};
+const GUID kVideoCategory = {0x6994ad05,
+                             0x93ef,
+                             0x11d0,
+                             {0xa3, 0xcc, 0x00, 0xa0, 0xc9, 0x22, 0x31, 0x96}};
+
+// オーディオデバイスの変化を受け取る
+class AudioNotificationClient : public IMMNotificationClient {
+ public:
+  AudioNotificationClient(
+      std::shared_ptr<DeviceWatcherNotifier> notifier,
+      Microsoft::WRL::ComPtr<IMMDeviceEnumerator> enumerator)
+      : notifier_(std::move(notifier)), enumerator_(std::move(enumerator)) {}
+
+  ULONG STDMETHODCALLTYPE AddRef() override { return ++ref_count_; }
+  ULONG STDMETHODCALLTYPE Release() override {
+    ULONG count = --ref_count_;
+    if (count == 0) {
+      delete this;
+    }
+    return count;
+  }
+  HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid,
+                                           void** ppv) override {
+    if (riid == __uuidof(IUnknown) ||
+        riid == __uuidof(IMMNotificationClient)) {
+      AddRef();
+      *ppv = static_cast<IMMNotificationClient*>(this);
+      return S_OK;
+    }
+    *ppv = nullptr;
+    return E_NOINTERFACE;
+  }
+
+  HRESULT STDMETHODCALLTYPE OnDeviceStateChanged(LPCWSTR device_id,
+                                                 DWORD state) override {
+    NotifyDevice(device_id);
+    return S_OK;
+  }
+  HRESULT STDMETHODCALLTYPE OnDeviceAdded(LPCWSTR device_id) override {
+    NotifyDevice(device_id);
+    return S_OK;
+  }
+  HRESULT STDMETHODCALLTYPE OnDeviceRemoved(LPCWSTR device_id) override {
+    NotifyDevice(device_id);
+    return S_OK;
+  }
+  HRESULT STDMETHODCALLTYPE OnDefaultDeviceChanged(EDataFlow flow,
+                                                   ERole role,
+                                                   LPCWSTR device_id) override {
+    // 既定のデバイスは役割ごとに通知されるので、1 回だけ扱う
+    if (role == eConsole) {
+      NotifyFlow(flow);
+    }
+    return S_OK;
+  }
+  HRESULT STDMETHODCALLTYPE
+  OnPropertyValueChanged(LPCWSTR device_id, const PROPERTYKEY key) override {
+    return S_OK;
+  }
+
+ private:
+  void NotifyDevice(LPCWSTR device_id) {
+    // 削除されたデバイスは取得できないので、その場合は両方を通知する
+    Microsoft::WRL::ComPtr<IMMDevice> device;
+    Microsoft::WRL::ComPtr<IMMEndpoint> endpoint;
+    EDataFlow flow;
+    if (FAILED(enumerator_->GetDevice(device_id, &device)) ||
+        FAILED(device.As(&endpoint)) ||
+        FAILED(endpoint->GetDataFlow(&flow))) {
+      flow = eAll;
+    }
+    NotifyFlow(flow);
+  }
+  void NotifyFlow(EDataFlow flow) {
+    if (flow == eCapture || flow == eAll) {
+      notifier_->Notify(DeviceKind::kAudioRecording);
+    }
+    if (flow == eRender || flow == eAll) {
+      notifier_->Notify(DeviceKind::kAudioPlayout);
+    }
+  }
+
+  std::atomic<ULONG> ref_count_{1};
+  std::shared_ptr<DeviceWatcherNotifier> notifier_;
+  Microsoft::WRL::ComPtr<IMMDeviceEnumerator> enumerator_;
+};
+
+class WinDeviceWatcher : public DeviceWatcher {
+ public:
+  explicit WinDeviceWatcher(std::function<void(DeviceKind)> on_change)
+      : notifier_(
+            std::make_shared<DeviceWatcherNotifier>(std::move(on_change))) {}
+
+  ~WinDeviceWatcher() override {
+    // CM_Unregister_Notification は実行中のコールバックが終わるまで待つ
+    for (auto h : video_notifications_) {
+      CM_Unregister_Notification(h);
+    }
+    if (audio_client_ != nullptr) {
+      enumerator_->UnregisterEndpointNotificationCallback(audio_client_.Get());
+    }
+    notifier_->Clear();
+  }
+
+  bool Init() {
+    HRESULT hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), nullptr,
+                                  CLSCTX_ALL, IID_PPV_ARGS(&enumerator_));
+    if (FAILED(hr)) {
+      RTC_LOG(LS_WARNING) << "Failed to create MMDeviceEnumerator: hr=" << hr;
+    } else {
+      Microsoft::WRL::ComPtr<AudioNotificationClient> client;
+      client.Attach(new AudioNotificationClient(notifier_, enumerator_));
+      hr = enumerator_->RegisterEndpointNotificationCallback(client.Get());
+      if (FAILED(hr)) {
+        RTC_LOG(LS_WARNING)
+            << "Failed to RegisterEndpointNotificationCallback: hr=" << hr;
+      } else {
+        audio_client_ = client;
+      }
+    }
+
+    for (const GUID& category : {kVideoCameraCategory, kVideoCategory}) {
+      CM_NOTIFY_FILTER filter = {};
+      filter.cbSize = sizeof(filter);
+      filter.FilterType = CM_NOTIFY_FILTER_TYPE_DEVICEINTERFACE;
+      filter.u.DeviceInterface.ClassGuid = category;
+      HCMNOTIFICATION h = nullptr;
+      CONFIGRET cr =
+          CM_Register_Notification(&filter, notifier_.get(), OnVideo, &h);
+      if (cr != CR_SUCCESS) {
+        RTC_LOG(LS_WARNING) << "Failed to CM_Register_Notification: cr=" << cr;
+        continue;
+      }
+      video_notifications_.push_back(h);
+    }
+    return audio_client_ != nullptr || !video_notifications_.empty();
+  }
+
+ private:
+  static DWORD CALLBACK OnVideo(HCMNOTIFICATION h,
+                                PVOID context,
+                                CM_NOTIFY_ACTION action,
+                                PCM_NOTIFY_EVENT_DATA data,
+                                DWORD size) {
+    if (action == CM_NOTIFY_ACTION_DEVICEINTERFACEARRIVAL ||
+        action == CM_NOTIFY_ACTION_DEVICEINTERFACEREMOVAL) {
+      static_cast<DeviceWatcherNotifier*>(context)->Notify(
+          DeviceKind::kVideoCapturer);
+    }
+    return ERROR_SUCCESS;
+  }
+
+  std::shared_ptr<DeviceWatcherNotifier> notifier_;
+  Microsoft::WRL::ComPtr<IMMDeviceEnumerator> enumerator_;
+  Microsoft::WRL::ComPtr<AudioNotificationClient> audio_client_;
+  std::vector<HCMNOTIFICATION> video_notifications_;
+};
+
+}  // namespace
+
+std::unique_ptr<DeviceWatcher> DeviceWatcher::Create(
+    std::function<void(DeviceKind)> on_change) {
+  auto watcher = std::make_unique<WinDeviceWatcher>(std::move(on_change));
+  if (!watcher->Init()) {
+    return nullptr;
+  }
+  return watcher;
+}
+
+}  // namespace sora_unity_sdk
@@ -0,0 +1,86 @@
+#include "headless_unity_interfaces.h"
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <utility>
+
+namespace sora_unity_sdk {
+
+namespace {
+
+std::atomic<UnityGfxRenderer> g_renderer{kUnityGfxRendererNull};
+std::atomic<int> g_next_event_id{0};
+
+// IUnityGraphics 以外は RegisterInterface で登録されたものだけ返す
+std::mutex g_mutex;
+std::map<std::pair<unsigned long long, unsigned long long>, IUnityInterface*>
+    g_interfaces;
+
+}  // namespace
+
+IUnityInterfaces* HeadlessUnityInterfaces::Get(UnityGfxRenderer renderer) {
+  static IUnityInterfaces ifs = {
+      &HeadlessUnityInterfaces::GetInterface,
+      &HeadlessUnityInterfaces::RegisterInterface,
+      &HeadlessUnityInterfaces::GetInterfaceSplit,
+      &HeadlessUnityInterfaces::RegisterInterfaceSplit,
+  };
+  g_renderer = renderer;
+  return &ifs;
+}
+
+IUnityInterface* HeadlessUnityInterfaces::GetInterface(
+    UnityInterfaceGUID guid) {
+  return GetInterfaceSplit(guid.m_GUIDHigh, guid.m_GUIDLow);
+}
+
+void HeadlessUnityInterfaces::RegisterInterface(UnityInterfaceGUID guid,
+                                                IUnityInterface* ptr) {
+  RegisterInterfaceSplit(guid.m_GUIDHigh, guid.m_GUIDLow, ptr);
+}
+
+IUnityInterface* HeadlessUnityInterfaces::GetInterfaceSplit(
+    unsigned long long guid_high,
+    unsigned long long guid_low) {
+  static IUnityGraphics graphics = {
+      &HeadlessUnityInterfaces::GetRenderer,
+      &HeadlessUnityInterfaces::RegisterDeviceEventCallback,
+      &HeadlessUnityInterfaces::UnregisterDeviceEventCallback,
+      &HeadlessUnityInterfaces::ReserveEventIDRange,
+  };
+  UnityInterfaceGUID graphics_guid = GetUnityInterfaceGUID<IUnityGraphics>();
+  if (guid_high == graphics_guid.m_GUIDHigh &&
+      guid_low == graphics_guid.m_GUIDLow) {
+    return &graphics;
+  }
+
+  std::lock_guard<std::mutex> guard(g_mutex);
+  auto it = g_interfaces.find({guid_high, guid_low});
+  return it == g_interfaces.end() ? nullptr : it->second;
+}
+
+void HeadlessUnityInterfaces::RegisterInterfaceSplit(
+    unsigned long long guid_high,
+    unsigned long long guid_low,
+    IUnityInterface* ptr) {
+  std::lock_guard<std::mutex> guard(g_mutex);
+  g_interfaces[{guid_high, guid_low}] = ptr;
+}
+
+UnityGfxRenderer HeadlessUnityInterfaces::GetRenderer() {
+  return g_renderer;
+}
+
+// デバイスのリセットなどは起きないので、コールバックは呼ばない
+void HeadlessUnityInterfaces::RegisterDeviceEventCallback(
+    IUnityGraphicsDeviceEventCallback callback) {}
+
+void HeadlessUnityInterfaces::UnregisterDeviceEventCallback(
+    IUnityGraphicsDeviceEventCallback callback) {}
+
+int HeadlessUnityInterfaces::ReserveEventIDRange(int count) {
+  return g_next_event_id.fetch_add(count);
+}
+
+}  // namespace sora_unity_sdk
@@ -0,0 +1,45 @@
+#ifndef SORA_UNITY_SDK_HEADLESS_UNITY_INTERFACES_H_INCLUDED
+#define SORA_UNITY_SDK_HEADLESS_UNITY_INTERFACES_H_INCLUDED
+
+#include "unity/IUnityGraphics.h"
+#include "unity/IUnityInterface.h"
+
+namespace sora_unity_sdk {
+
+// Unity を使わずにプラグインを動かすための IUnityInterfaces の代替実装。
+//
+// UnityContext は UnityPluginLoad で渡される IUnityInterfaces が無いと初期化されず、
+// Sora や UnityRenderer を Unity エディタの外で動かすことができない。
+// これを UnityContext::Init() に渡すことで、ネイティブのホストから
+// テクスチャ更新コールバックやレンダリングイベントを直接呼び出せるようになる。
+//
+// IUnityGraphics は指定したレンダラーを返すだけで、グラフィックスデバイスは持たない。
+// kUnityGfxRendererOpenGLCore を指定する場合は、ホスト側で OpenGL コンテキストを
+// 作成してレンダリングイベントを呼ぶスレッドでカレントにしておくこと。
+class HeadlessUnityInterfaces {
+ public:
+  static IUnityInterfaces* Get(UnityGfxRenderer renderer);
+
+ private:
+  static IUnityInterface* UNITY_INTERFACE_API
+  GetInterface(UnityInterfaceGUID guid);
+  static void UNITY_INTERFACE_API RegisterInterface(UnityInterfaceGUID guid,
+                                                    IUnityInterface* ptr);
+  static IUnityInterface* UNITY_INTERFACE_API
+  GetInterfaceSplit(unsigned long long guid_high, unsigned long long guid_low);
+  static void UNITY_INTERFACE_API
+  RegisterInterfaceSplit(unsigned long long guid_high,
+                         unsigned long long guid_low,
+                         IUnityInterface* ptr);
+
+  static UnityGfxRenderer UNITY_INTERFACE_API GetRenderer();
+  static void UNITY_INTERFACE_API
+  RegisterDeviceEventCallback(IUnityGraphicsDeviceEventCallback callback);
+  static void UNITY_INTERFACE_API
+  UnregisterDeviceEventCallback(IUnityGraphicsDeviceEventCallback callback);
+  static int UNITY_INTERFACE_API ReserveEventIDRange(int count);
+};
+
+}  // namespace sora_unity_sdk
+
+#endif
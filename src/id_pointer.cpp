@@ -8,11 +8,21 @@ IdPointer& IdPointer::Instance() {
 }
 ptrid_t IdPointer::Register(void* p) {
   std::lock_guard<std::mutex> guard(mutex_);
-  map_[counter_] = p;
+  map_[counter_] = {p, 0};
   return counter_++;
 }
 void IdPointer::Unregister(ptrid_t id) {
-  std::lock_guard<std::mutex> guard(mutex_);
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto it = map_.find(id);
+  if (it == map_.end()) {
+    return;
+  }
+  // 以降の Lookup と With では見つからないようにしてから、使い終わるのを待つ
+  it->second.p = nullptr;
+  cv_.wait(lock, [this, id]() {
+    auto it = map_.find(id);
+    return it == map_.end() || it->second.refs == 0;
+  });
   map_.erase(id);
 }
 void* IdPointer::Lookup(ptrid_t id) {
@@ -21,7 +31,27 @@ void* IdPointer::Lookup(ptrid_t id) {
   if (it == map_.end()) {
     return nullptr;
   }
-  return it->second;
+  return it->second.p;
+}
+void* IdPointer::Acquire(ptrid_t id) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto it = map_.find(id);
+  if (it == map_.end() || it->second.p == nullptr) {
+    return nullptr;
+  }
+  it->second.refs += 1;
+  return it->second.p;
+}
+void IdPointer::Release(ptrid_t id) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto it = map_.find(id);
+  if (it == map_.end()) {
+    return;
+  }
+  it->second.refs -= 1;
+  if (it->second.refs == 0) {
+    cv_.notify_all();
+  }
 }
 
 }  // namespace sora_unity_sdk
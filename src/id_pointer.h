@@ -1,6 +1,7 @@
 #ifndef SORA_UNITY_SDK_ID_POINTER_H_INCLUDED
 #define SORA_UNITY_SDK_ID_POINTER_H_INCLUDED
 
+#include <condition_variable>
 #include <map>
 #include <mutex>
 
@@ -11,15 +12,40 @@ namespace sora_unity_sdk {
 // TextureUpdateCallback のユーザデータが 32bit 整数しか扱えないので、
 // ID からポインタに変換する仕組みを用意する
 class IdPointer {
+  struct Entry {
+    void* p;
+    // With() で使用中の数
+    int refs;
+  };
   std::mutex mutex_;
+  std::condition_variable cv_;
   ptrid_t counter_ = 1;
-  std::map<ptrid_t, void*> map_;
+  std::map<ptrid_t, Entry> map_;
+
+  void* Acquire(ptrid_t id);
+  void Release(ptrid_t id);
 
  public:
   static IdPointer& Instance();
   ptrid_t Register(void* p);
+  // With() で使用中の場合は、使い終わるまで待ってから戻る
   void Unregister(ptrid_t id);
   void* Lookup(ptrid_t id);
+
+  // id のポインタを f に渡して呼ぶ。
+  // f を呼んでいる間は Unregister(id) が戻らないので、別のスレッドで削除される
+  // オブジェクトでも、f の中では削除されない。
+  // 見つからなかった場合は f を呼ばずに false を返す。
+  template <class F>
+  bool With(ptrid_t id, F f) {
+    void* p = Acquire(id);
+    if (p == nullptr) {
+      return false;
+    }
+    f(p);
+    Release(id);
+    return true;
+  }
 };
 
 }  // namespace sora_unity_sdk
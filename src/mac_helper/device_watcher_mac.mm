@@ -0,0 +1,114 @@
+#include "../device_watcher.h"
+
+#include <vector>
+
+#import <AVFoundation/AVFoundation.h>
+#if defined(SORA_UNITY_SDK_MACOS)
+#import <CoreAudio/CoreAudio.h>
+#endif
+
+// WebRTC
+#include <rtc_base/logging.h>
+
+namespace sora_unity_sdk {
+
+namespace {
+
+#if defined(SORA_UNITY_SDK_MACOS)
+// デバイスの一覧と既定のデバイスが変わった時に通知してもらう
+const AudioObjectPropertyAddress kAudioAddresses[] = {
+    {kAudioHardwarePropertyDevices, kAudioObjectPropertyScopeGlobal,
+     kAudioObjectPropertyElementMain},
+    {kAudioHardwarePropertyDefaultInputDevice, kAudioObjectPropertyScopeGlobal,
+     kAudioObjectPropertyElementMain},
+    {kAudioHardwarePropertyDefaultOutputDevice,
+     kAudioObjectPropertyScopeGlobal, kAudioObjectPropertyElementMain},
+};
+#endif
+
+class MacDeviceWatcher : public DeviceWatcher {
+ public:
+  explicit MacDeviceWatcher(std::function<void(DeviceKind)> on_change)
+      : notifier_(
+            std::make_shared<DeviceWatcherNotifier>(std::move(on_change))) {}
+
+  ~MacDeviceWatcher() override {
+    NSNotificationCenter* center = [NSNotificationCenter defaultCenter];
+    for (CFTypeRef observer : observers_) {
+      [center removeObserver:(__bridge id)observer];
+      CFRelease(observer);
+    }
+#if defined(SORA_UNITY_SDK_MACOS)
+    for (const auto& address : audio_addresses_) {
+      AudioObjectRemovePropertyListener(kAudioObjectSystemObject, &address,
+                                        OnAudioChanged, notifier_.get());
+    }
+#endif
+    notifier_->Clear();
+  }
+
+  bool Init() {
+    // ブロックは通知先を共有して持つので、オブザーバを外した後に呼ばれても問題ない
+    auto notifier = notifier_;
+    NSNotificationCenter* center = [NSNotificationCenter defaultCenter];
+    for (NSNotificationName name : @[
+           AVCaptureDeviceWasConnectedNotification,
+           AVCaptureDeviceWasDisconnectedNotification
+         ]) {
+      id observer = [center addObserverForName:name
+                                        object:nil
+                                         queue:nil
+                                    usingBlock:^(NSNotification* note) {
+                                      notifier->Notify(
+                                          DeviceKind::kVideoCapturer);
+                                    }];
+      observers_.push_back(CFBridgingRetain(observer));
+    }
+
+#if defined(SORA_UNITY_SDK_MACOS)
+    for (const auto& address : kAudioAddresses) {
+      OSStatus status = AudioObjectAddPropertyListener(
+          kAudioObjectSystemObject, &address, OnAudioChanged, notifier_.get());
+      if (status != noErr) {
+        RTC_LOG(LS_WARNING)
+            << "Failed to AudioObjectAddPropertyListener: status=" << status;
+        continue;
+      }
+      audio_addresses_.push_back(address);
+    }
+#endif
+    return true;
+  }
+
+ private:
+#if defined(SORA_UNITY_SDK_MACOS)
+  static OSStatus OnAudioChanged(AudioObjectID object_id,
+                                 UInt32 count,
+                                 const AudioObjectPropertyAddress* addresses,
+                                 void* client_data) {
+    auto notifier = static_cast<DeviceWatcherNotifier*>(client_data);
+    notifier->Notify(DeviceKind::kAudioRecording);
+    notifier->Notify(DeviceKind::kAudioPlayout);
+    return noErr;
+  }
+  std::vector<AudioObjectPropertyAddress> audio_addresses_;
+#endif
+
+  std::shared_ptr<DeviceWatcherNotifier> notifier_;
+  std::vector<CFTypeRef> observers_;
+};
+
+}  // namespace
+
+std::unique_ptr<DeviceWatcher> DeviceWatcher::Create(
+    std::function<void(DeviceKind)> on_change) {
+  // iOS のオーディオデバイスは DeviceList で常に 1 個として扱うので、
+  // カメラの抜き差しだけを通知する
+  auto watcher = std::make_unique<MacDeviceWatcher>(std::move(on_change));
+  if (!watcher->Init()) {
+    return nullptr;
+  }
+  return watcher;
+}
+
+}  // namespace sora_unity_sdk
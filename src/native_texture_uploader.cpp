@@ -0,0 +1,344 @@
+#include "native_texture_uploader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <thread>
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+
+// WebRTC
+#include <rtc_base/logging.h>
+
+// Boost
+#include <boost/asio/post.hpp>
+
+#include "unity_renderer.h"
+
+namespace sora_unity_sdk {
+
+NativeTextureUploader& NativeTextureUploader::Instance() {
+  static NativeTextureUploader instance;
+  return instance;
+}
+
+void NativeTextureUploader::Register(ptrid_t video_sink_id,
+                                     void* native_texture,
+                                     int width,
+                                     int height) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto& entry = entries_[{video_sink_id, native_texture}];
+  // サイズが変わった場合は PBO を作り直す
+  if (entry.width != width || entry.height != height) {
+    ReleasePbos(entry.pbos);
+    entry.serial = 0;
+  }
+  entry.video_sink_id = video_sink_id;
+  entry.texture = (unsigned int)(intptr_t)native_texture;
+  entry.width = width;
+  entry.height = height;
+}
+
+void NativeTextureUploader::Unregister(ptrid_t video_sink_id,
+                                       void* native_texture) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto it = entries_.find({video_sink_id, native_texture});
+  if (it == entries_.end()) {
+    return;
+  }
+  ReleasePbos(it->second.pbos);
+  entries_.erase(it);
+}
+
+bool NativeTextureUploader::RegisterAtlas(void* native_texture,
+                                          int width,
+                                          int height,
+                                          const std::vector<AtlasCell>& cells) {
+  if (width <= 0 || height <= 0) {
+    RTC_LOG(LS_ERROR) << "Invalid atlas size: width=" << width
+                      << " height=" << height;
+    return false;
+  }
+  for (const auto& cell : cells) {
+    if (cell.width <= 0 || cell.height <= 0 || cell.x < 0 || cell.y < 0 ||
+        cell.x + cell.width > width || cell.y + cell.height > height) {
+      RTC_LOG(LS_ERROR) << "Invalid atlas cell: video_sink_id="
+                        << cell.video_sink_id << " x=" << cell.x
+                        << " y=" << cell.y << " width=" << cell.width
+                        << " height=" << cell.height;
+      return false;
+    }
+  }
+
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto& atlas = atlases_[native_texture];
+  if (atlas.width != width || atlas.height != height) {
+    ReleasePbos(atlas.pbos);
+  }
+  atlas.texture = (unsigned int)(intptr_t)native_texture;
+  atlas.width = width;
+  atlas.height = height;
+  // レイアウトが変わったセルは次のイベントで必ず書き込む
+  std::vector<Cell> new_cells(cells.size());
+  for (size_t i = 0; i < cells.size(); i++) {
+    new_cells[i].layout = cells[i];
+    for (auto& old : atlas.cells) {
+      const auto& l = old.layout;
+      if (l.video_sink_id == cells[i].video_sink_id && l.x == cells[i].x &&
+          l.y == cells[i].y && l.width == cells[i].width &&
+          l.height == cells[i].height) {
+        new_cells[i].serial = old.serial;
+        new_cells[i].scaled_buffer = std::move(old.scaled_buffer);
+        break;
+      }
+    }
+  }
+  atlas.cells = std::move(new_cells);
+  return true;
+}
+
+void NativeTextureUploader::UnregisterAtlas(void* native_texture) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto it = atlases_.find(native_texture);
+  if (it == atlases_.end()) {
+    return;
+  }
+  ReleasePbos(it->second.pbos);
+  atlases_.erase(it);
+}
+
+bool NativeTextureUploader::GetAtlasUV(void* native_texture,
+                                       ptrid_t video_sink_id,
+                                       float uv[4]) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto it = atlases_.find(native_texture);
+  if (it == atlases_.end()) {
+    return false;
+  }
+  const Atlas& atlas = it->second;
+  for (const auto& cell : atlas.cells) {
+    const auto& l = cell.layout;
+    if (l.video_sink_id == video_sink_id) {
+      uv[0] = (float)l.x / atlas.width;
+      uv[1] = (float)l.y / atlas.height;
+      uv[2] = (float)l.width / atlas.width;
+      uv[3] = (float)l.height / atlas.height;
+      return true;
+    }
+  }
+  return false;
+}
+
+void NativeTextureUploader::ReleasePbos(unsigned int* pbos) {
+  for (int i = 0; i < kPboCount; i++) {
+    if (pbos[i] != 0) {
+      garbage_pbos_.push_back(pbos[i]);
+      pbos[i] = 0;
+    }
+  }
+}
+
+void NativeTextureUploader::OnRenderEventStatic(int event_id) {
+  Instance().OnRenderEvent();
+}
+
+void NativeTextureUploader::OnRenderEvent() {
+  std::lock_guard<std::mutex> guard(mutex_);
+
+  if (!garbage_pbos_.empty()) {
+    glDeleteBuffers((GLsizei)garbage_pbos_.size(), garbage_pbos_.data());
+    garbage_pbos_.clear();
+  }
+  if (entries_.empty() && atlases_.empty()) {
+    return;
+  }
+
+  // Unity の GL ステートを壊さないように、触るものは戻しておく
+  GLint prev_texture = 0;
+  GLint prev_unpack_buffer = 0;
+  GLint prev_row_length = 0;
+  GLint prev_alignment = 0;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &prev_texture);
+  glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &prev_unpack_buffer);
+  glGetIntegerv(GL_UNPACK_ROW_LENGTH, &prev_row_length);
+  glGetIntegerv(GL_UNPACK_ALIGNMENT, &prev_alignment);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+  // 新しいフレームが来ているテクスチャの PBO をマップして、
+  // 変換はまとめてワーカースレッドで行い、最後に転送する
+  jobs_.clear();
+  uploads_.clear();
+  mapped_pbos_.clear();
+  for (auto& kv : entries_) {
+    Prepare(kv.second);
+  }
+  for (auto& kv : atlases_) {
+    PrepareAtlas(kv.second);
+  }
+  ConvertAll();
+  for (auto pbo : mapped_pbos_) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+  }
+  for (const auto& upload : uploads_) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.pbo);
+    glBindTexture(GL_TEXTURE_2D, upload.texture);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, upload.row_length);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, upload.x, upload.y, upload.width,
+                    upload.height, GL_RGBA, GL_UNSIGNED_BYTE,
+                    (const void*)upload.offset);
+  }
+  // フレームを早く解放するために参照を消しておく
+  jobs_.clear();
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, prev_unpack_buffer);
+  glBindTexture(GL_TEXTURE_2D, prev_texture);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, prev_row_length);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, prev_alignment);
+}
+
+bool NativeTextureUploader::Prepare(Entry& entry) {
+  // Sink はシグナリングスレッドで削除されるので、使っている間は削除を待たせる。
+  // 取得したフレームは参照を持っているので、Sink が削除されても使える
+  webrtc::scoped_refptr<webrtc::VideoFrameBuffer> frame_buffer;
+  IdPointer::Instance().With(entry.video_sink_id, [&](void* p) {
+    auto sink = static_cast<UnityRenderer::Sink*>(p);
+    frame_buffer =
+        sink->GetNewFrameForTexture(&entry.serial, entry.width, entry.height);
+  });
+  if (frame_buffer == nullptr) {
+    return false;
+  }
+
+  unsigned int pbo;
+  uint8_t* dst = MapPbo(entry.pbos, &entry.pbo_index,
+                        (size_t)entry.width * entry.height * 4, &pbo);
+  if (dst == nullptr) {
+    return false;
+  }
+
+  jobs_.push_back({dst, entry.width * 4, entry.width, entry.height,
+                   frame_buffer, &entry.scaled_buffer});
+  uploads_.push_back(
+      {pbo, entry.texture, 0, 0, entry.width, entry.height, 0, 0});
+  return true;
+}
+
+bool NativeTextureUploader::PrepareAtlas(Atlas& atlas) {
+  // 新しいフレームが来ているセルだけを集める
+  struct DirtyCell {
+    Cell* cell;
+    webrtc::scoped_refptr<webrtc::VideoFrameBuffer> frame_buffer;
+  };
+  std::vector<DirtyCell> dirty_cells;
+  for (auto& cell : atlas.cells) {
+    const auto& l = cell.layout;
+    // Prepare と同じく、Sink を使っている間は削除を待たせる
+    webrtc::scoped_refptr<webrtc::VideoFrameBuffer> frame_buffer;
+    IdPointer::Instance().With(l.video_sink_id, [&](void* p) {
+      auto sink = static_cast<UnityRenderer::Sink*>(p);
+      frame_buffer =
+          sink->GetNewFrameForTexture(&cell.serial, l.width, l.height);
+    });
+    if (frame_buffer != nullptr) {
+      dirty_cells.push_back({&cell, frame_buffer});
+    }
+  }
+  if (dirty_cells.empty()) {
+    return false;
+  }
+
+  // PBO はアトラス全体の大きさで 1 つだけマップし、各セルはその中の
+  // 対応する位置に書き込む。セルの外側は転送しないので未初期化のままで良い
+  unsigned int pbo;
+  uint8_t* dst = MapPbo(atlas.pbos, &atlas.pbo_index,
+                        (size_t)atlas.width * atlas.height * 4, &pbo);
+  if (dst == nullptr) {
+    return false;
+  }
+
+  for (auto& dirty : dirty_cells) {
+    Cell& cell = *dirty.cell;
+    const auto& l = cell.layout;
+    size_t offset = ((size_t)l.y * atlas.width + l.x) * 4;
+    jobs_.push_back({dst + offset, atlas.width * 4, l.width, l.height,
+                     std::move(dirty.frame_buffer), &cell.scaled_buffer});
+    uploads_.push_back({pbo, atlas.texture, l.x, l.y, l.width, l.height,
+                        atlas.width, offset});
+  }
+  return true;
+}
+
+uint8_t* NativeTextureUploader::MapPbo(unsigned int* pbos,
+                                       int* pbo_index,
+                                       size_t size,
+                                       unsigned int* pbo) {
+  if (pbos[0] == 0) {
+    glGenBuffers(kPboCount, pbos);
+  }
+  *pbo = pbos[*pbo_index];
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, *pbo);
+  // 前回の転送が終わっていなくても待たないように、領域を確保し直してから書き込む
+  glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)size, nullptr,
+               GL_STREAM_DRAW);
+  auto dst = (uint8_t*)glMapBufferRange(
+      GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)size,
+      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  if (dst == nullptr) {
+    RTC_LOG(LS_ERROR) << "glMapBufferRange failed: error="
+                      << (int)glGetError();
+    return nullptr;
+  }
+  *pbo_index = (*pbo_index + 1) % kPboCount;
+  mapped_pbos_.push_back(*pbo);
+  return dst;
+}
+
+void NativeTextureUploader::ConvertAll() {
+  auto convert = [](Job& job) {
+    UnityRenderer::Sink::ConvertToABGR(*job.frame_buffer, job.dst, job.stride,
+                                       job.width, job.height,
+                                       job.scaled_buffer);
+  };
+  if (jobs_.size() <= 1) {
+    for (auto& job : jobs_) {
+      convert(job);
+    }
+    return;
+  }
+
+  if (pool_ == nullptr) {
+    // レンダースレッドも変換するので、その分は減らしておく
+    int n = (int)std::thread::hardware_concurrency() - 1;
+    pool_size_ = std::max(1, std::min(n, 4));
+    pool_.reset(new boost::asio::thread_pool(pool_size_));
+  }
+
+  // レンダースレッドとワーカースレッドで、空いたものから順に変換する
+  std::atomic<size_t> next(0);
+  auto work = [this, &next, &convert]() {
+    for (size_t i = next.fetch_add(1); i < jobs_.size();
+         i = next.fetch_add(1)) {
+      convert(jobs_[i]);
+    }
+  };
+  int workers = std::min(pool_size_, (int)jobs_.size() - 1);
+  std::mutex mutex;
+  std::condition_variable cv;
+  int remaining = workers;
+  for (int i = 0; i < workers; i++) {
+    boost::asio::post(*pool_, [&]() {
+      work();
+      std::lock_guard<std::mutex> guard(mutex);
+      remaining -= 1;
+      cv.notify_one();
+    });
+  }
+  work();
+  std::unique_lock<std::mutex> lock(mutex);
+  cv.wait(lock, [&]() { return remaining == 0; });
+}
+
+}  // namespace sora_unity_sdk
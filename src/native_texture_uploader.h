@@ -0,0 +1,142 @@
+#ifndef SORA_UNITY_SDK_NATIVE_TEXTURE_UPLOADER_H_INCLUDED
+#define SORA_UNITY_SDK_NATIVE_TEXTURE_UPLOADER_H_INCLUDED
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// WebRTC
+#include <api/video/i420_buffer.h>
+#include <api/video/video_frame_buffer.h>
+
+// Boost
+#include <boost/asio/thread_pool.hpp>
+
+#include "unity.h"
+#include "unity/IUnityGraphics.h"
+
+namespace sora_unity_sdk {
+
+// 受信した映像を、Unity のテクスチャ更新コールバックを使わずに
+// ネイティブのテクスチャへ直接アップロードする。
+//
+// IssuePluginCustomTextureUpdateV2 はテクスチャ毎に CommandBuffer を発行し、
+// プラグインが返したデータを Unity がさらにコピーしてからテクスチャに書き込む。
+// こちらは登録された全てのテクスチャを 1 回のレンダリングイベントで更新し、
+// PBO に直接変換してから glTexSubImage2D で非同期に転送する。
+// 新しいフレームが来ていないテクスチャは転送しない。
+//
+// 大量の映像をグリッド表示する場合のために、1 枚の大きなテクスチャを
+// セルに区切って複数の映像を書き込むアトラスも登録できる。
+// アトラスは 1 つの PBO にまとめて変換し、新しいフレームが来たセルだけを転送する。
+// GL の呼び出しはレンダースレッドで行い、CPU での変換はワーカースレッドで並列に行う。
+//
+// 今のところ OpenGL Core のみ対応している。
+class NativeTextureUploader {
+ public:
+  static NativeTextureUploader& Instance();
+
+  // Unity スレッドから呼ぶ
+  void Register(ptrid_t video_sink_id,
+                void* native_texture,
+                int width,
+                int height);
+  void Unregister(ptrid_t video_sink_id, void* native_texture);
+
+  struct AtlasCell {
+    ptrid_t video_sink_id;
+    int x;
+    int y;
+    int width;
+    int height;
+  };
+  // 同じテクスチャで呼び直した場合はレイアウトを置き換える
+  bool RegisterAtlas(void* native_texture,
+                     int width,
+                     int height,
+                     const std::vector<AtlasCell>& cells);
+  void UnregisterAtlas(void* native_texture);
+  // video_sink_id のセルのテクスチャ座標を x, y, width, height の順で返す
+  bool GetAtlasUV(void* native_texture, ptrid_t video_sink_id, float uv[4]);
+
+  // レンダースレッドから呼ばれる
+  static void UNITY_INTERFACE_API OnRenderEventStatic(int event_id);
+
+ private:
+  static constexpr int kPboCount = 2;
+
+  struct Entry {
+    ptrid_t video_sink_id = 0;
+    unsigned int texture = 0;
+    int width = 0;
+    int height = 0;
+    unsigned int pbos[kPboCount] = {};
+    int pbo_index = 0;
+    uint64_t serial = 0;
+    // 変換用の作業バッファ。並列に変換するのでテクスチャ毎に持つ
+    webrtc::scoped_refptr<webrtc::I420Buffer> scaled_buffer;
+  };
+
+  struct Cell {
+    AtlasCell layout;
+    uint64_t serial = 0;
+    webrtc::scoped_refptr<webrtc::I420Buffer> scaled_buffer;
+  };
+
+  struct Atlas {
+    unsigned int texture = 0;
+    int width = 0;
+    int height = 0;
+    std::vector<Cell> cells;
+    unsigned int pbos[kPboCount] = {};
+    int pbo_index = 0;
+  };
+
+  // 1 回のイベントで行う変換
+  struct Job {
+    uint8_t* dst;
+    int stride;
+    int width;
+    int height;
+    webrtc::scoped_refptr<webrtc::VideoFrameBuffer> frame_buffer;
+    webrtc::scoped_refptr<webrtc::I420Buffer>* scaled_buffer;
+  };
+
+  // 1 回のイベントで行う転送。offset は PBO 内の位置
+  struct Upload {
+    unsigned int pbo;
+    unsigned int texture;
+    int x;
+    int y;
+    int width;
+    int height;
+    int row_length;
+    size_t offset;
+  };
+
+  void OnRenderEvent();
+  bool Prepare(Entry& entry);
+  bool PrepareAtlas(Atlas& atlas);
+  uint8_t* MapPbo(unsigned int* pbos,
+                  int* pbo_index,
+                  size_t size,
+                  unsigned int* pbo);
+  void ReleasePbos(unsigned int* pbos);
+  void ConvertAll();
+
+  std::mutex mutex_;
+  std::vector<Job> jobs_;
+  std::vector<Upload> uploads_;
+  std::vector<unsigned int> mapped_pbos_;
+  std::unique_ptr<boost::asio::thread_pool> pool_;
+  int pool_size_ = 0;
+  std::map<std::pair<ptrid_t, void*>, Entry> entries_;
+  std::map<void*, Atlas> atlases_;
+  // PBO はレンダースレッドで削除する必要があるので、次のイベントまで取っておく
+  std::vector<unsigned int> garbage_pbos_;
+};
+
+}  // namespace sora_unity_sdk
+
+#endif
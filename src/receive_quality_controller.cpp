@@ -0,0 +1,110 @@
+#include "receive_quality_controller.h"
+
+// WebRTC
+#include <rtc_base/logging.h>
+
+namespace sora_unity_sdk {
+
+ReceiveQualityController::ReceiveQualityController(
+    const sora_conf::internal::ReceiveQualityControllerConfig& config) {
+  // 0 の場合はデフォルト値を使う
+  interval_ms_ = config.interval_ms > 0 ? config.interval_ms : 1000;
+  r0_max_height_ = config.r0_max_height > 0 ? config.r0_max_height : 180;
+  r1_max_height_ = config.r1_max_height > 0 ? config.r1_max_height : 360;
+  invisible_timeout_ms_ =
+      config.invisible_timeout_ms > 0 ? config.invisible_timeout_ms : 2000;
+  stable_count_ = config.stable_count > 0 ? config.stable_count : 2;
+  rpc_method_ = !config.rpc_method.empty() ? config.rpc_method
+                                           : "2025.2.0/RequestSimulcastRid";
+}
+
+void ReceiveQualityController::AddSink(ptrid_t video_sink_id,
+                                       std::string connection_id) {
+  entries_[video_sink_id].connection_id = std::move(connection_id);
+}
+
+void ReceiveQualityController::RemoveSink(ptrid_t video_sink_id) {
+  entries_.erase(video_sink_id);
+}
+
+void ReceiveQualityController::SetHint(ptrid_t video_sink_id,
+                                       bool visible,
+                                       bool focused) {
+  auto it = entries_.find(video_sink_id);
+  if (it == entries_.end()) {
+    return;
+  }
+  it->second.visible = visible;
+  it->second.focused = focused;
+  // ヒントが変わったら次の Update ですぐに反映する
+  it->second.hint_changed = true;
+  last_update_us_ = 0;
+}
+
+std::vector<std::pair<std::string, std::string>>
+ReceiveQualityController::Update(
+    int64_t now_us,
+    std::function<bool(ptrid_t, TextureStats*)> get_texture_stats) {
+  std::vector<std::pair<std::string, std::string>> requests;
+  if (last_update_us_ != 0 &&
+      now_us - last_update_us_ < (int64_t)interval_ms_ * 1000) {
+    return requests;
+  }
+  last_update_us_ = now_us;
+
+  for (auto& kv : entries_) {
+    auto& entry = kv.second;
+    if (entry.connection_id.empty()) {
+      continue;
+    }
+    TextureStats stats;
+    bool has_stats = get_texture_stats(kv.first, &stats);
+    auto rid = SelectRid(entry, has_stats, stats, now_us);
+
+    if (rid != entry.candidate_rid) {
+      entry.candidate_rid = rid;
+      entry.candidate_count = 1;
+    } else {
+      entry.candidate_count++;
+    }
+    bool hint_changed = entry.hint_changed;
+    entry.hint_changed = false;
+    if ((entry.candidate_count < stable_count_ && !hint_changed) ||
+        rid == entry.requested_rid) {
+      continue;
+    }
+    RTC_LOG(LS_INFO) << "ReceiveQualityController: connection_id="
+                     << entry.connection_id << " rid=" << entry.requested_rid
+                     << " -> " << rid << " texture=" << stats.width << "x"
+                     << stats.height;
+    entry.requested_rid = rid;
+    requests.push_back(std::make_pair(entry.connection_id, rid));
+  }
+  return requests;
+}
+
+std::string ReceiveQualityController::SelectRid(const Entry& entry,
+                                                bool has_stats,
+                                                const TextureStats& stats,
+                                                int64_t now_us) const {
+  if (entry.focused) {
+    return "r2";
+  }
+  if (!entry.visible) {
+    return "r0";
+  }
+  // 一定時間テクスチャが更新されていない映像は、描画されていないとみなす
+  if (!has_stats || stats.updated_us == 0 ||
+      now_us - stats.updated_us > (int64_t)invisible_timeout_ms_ * 1000) {
+    return "r0";
+  }
+  if (stats.height <= r0_max_height_) {
+    return "r0";
+  }
+  if (stats.height <= r1_max_height_) {
+    return "r1";
+  }
+  return "r2";
+}
+
+}  // namespace sora_unity_sdk
@@ -0,0 +1,70 @@
+#ifndef SORA_UNITY_SDK_RECEIVE_QUALITY_CONTROLLER_H_INCLUDED
+#define SORA_UNITY_SDK_RECEIVE_QUALITY_CONTROLLER_H_INCLUDED
+
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "sora_conf_internal.json.h"
+#include "unity.h"
+#include "unity_renderer.h"
+
+namespace sora_unity_sdk {
+
+// 受信している映像が Unity 上でどの程度の大きさで描画されているかを見て、
+// 送信元のコネクション毎に受信するサイマルキャストの rid を決める。
+//
+// 全て Unity スレッドから呼び出すこと。
+class ReceiveQualityController {
+ public:
+  explicit ReceiveQualityController(
+      const sora_conf::internal::ReceiveQualityControllerConfig& config);
+
+  void AddSink(ptrid_t video_sink_id, std::string connection_id);
+  void RemoveSink(ptrid_t video_sink_id);
+  // アプリ側から、その映像が画面に見えているか、注目しているかを指定する
+  void SetHint(ptrid_t video_sink_id, bool visible, bool focused);
+
+  // 前回から interval_ms 経過していたら各映像の rid を決め直し、
+  // 変更が必要な (connection_id, rid) のリストを返す。
+  std::vector<std::pair<std::string, std::string>> Update(
+      int64_t now_us,
+      std::function<bool(ptrid_t, TextureStats*)> get_texture_stats);
+
+  const std::string& rpc_method() const { return rpc_method_; }
+
+ private:
+  struct Entry {
+    std::string connection_id;
+    bool visible = true;
+    bool focused = false;
+    // 最後にリクエストした rid
+    std::string requested_rid;
+    // 連続して同じ rid が選ばれた回数。ちらつきを抑えるために使う
+    std::string candidate_rid;
+    int candidate_count = 0;
+    // ヒントが変わった場合は連続回数を待たずに反映する
+    bool hint_changed = false;
+  };
+
+  std::string SelectRid(const Entry& entry,
+                        bool has_stats,
+                        const TextureStats& stats,
+                        int64_t now_us) const;
+
+  int interval_ms_;
+  int r0_max_height_;
+  int r1_max_height_;
+  int invisible_timeout_ms_;
+  int stable_count_;
+  std::string rpc_method_;
+
+  int64_t last_update_us_ = 0;
+  std::map<ptrid_t, Entry> entries_;
+};
+
+}  // namespace sora_unity_sdk
+
+#endif
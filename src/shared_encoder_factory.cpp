@@ -0,0 +1,545 @@
+#include "shared_encoder_factory.h"
+
+#include <algorithm>
+#include <array>
+#include <optional>
+#include <string>
+#include <utility>
+
+// WebRTC
+#include <api/array_view.h>
+#include <api/audio_codecs/audio_encoder.h>
+#include <api/video/encoded_image.h>
+#include <api/video_codecs/video_codec.h>
+#include <api/video_codecs/video_encoder.h>
+#include <modules/video_coding/include/video_error_codes.h>
+#include <rtc_base/buffer.h>
+#include <rtc_base/logging.h>
+
+namespace sora_unity_sdk {
+
+// ---- 映像 ----
+
+namespace {
+
+// エンコーダの初期化し直しが必要な設定が同じかどうか
+bool IsSameCodecSettings(const webrtc::VideoCodec& a,
+                         const webrtc::VideoCodec& b) {
+  if (a.codecType != b.codecType || a.width != b.width ||
+      a.height != b.height || a.maxFramerate != b.maxFramerate ||
+      a.startBitrate != b.startBitrate || a.maxBitrate != b.maxBitrate ||
+      a.minBitrate != b.minBitrate || a.qpMax != b.qpMax ||
+      a.mode != b.mode || a.GetScalabilityMode() != b.GetScalabilityMode() ||
+      a.numberOfSimulcastStreams != b.numberOfSimulcastStreams) {
+    return false;
+  }
+  for (int i = 0; i < a.numberOfSimulcastStreams; i++) {
+    const auto& sa = a.simulcastStream[i];
+    const auto& sb = b.simulcastStream[i];
+    if (sa.width != sb.width || sa.height != sb.height ||
+        sa.maxFramerate != sb.maxFramerate ||
+        sa.numberOfTemporalLayers != sb.numberOfTemporalLayers ||
+        sa.maxBitrate != sb.maxBitrate || sa.minBitrate != sb.minBitrate ||
+        sa.active != sb.active) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+class SharedVideoEncoderFactory::Group
+    : public webrtc::EncodedImageCallback {
+ public:
+  struct Member {
+    const void* owner;
+    webrtc::EncodedImageCallback* callback;
+    // InitEncode から Release までの間 true になる。
+    // Release しても順番とコールバックは残すので、初期化し直した接続は
+    // 元の順番に戻る
+    bool initialized;
+  };
+
+  Group(webrtc::VideoEncoderFactory* factory, webrtc::SdpVideoFormat format)
+      : factory_(factory), format_(std::move(format)) {}
+
+  int32_t InitEncode(const void* owner,
+                     const webrtc::Environment& env,
+                     const webrtc::VideoCodec* codec_settings,
+                     const webrtc::VideoEncoder::Settings& settings) {
+    std::lock_guard<std::mutex> guard(encode_mutex_);
+    SetInitialized(owner, true);
+    // 最初の接続の設定で初期化して、以降の接続はそれを共有する。
+    // 解像度やフレームレートの変更で設定が変わった場合は、
+    // リーダーの設定で初期化し直す
+    if (encoder_ != nullptr) {
+      if (IsSameCodecSettings(*codec_settings, codec_settings_)) {
+        return WEBRTC_VIDEO_CODEC_OK;
+      }
+      if (!IsLeader(owner)) {
+        // リーダー以外の設定はエンコーダに反映されない
+        RTC_LOG(LS_WARNING)
+            << "Shared video encoder ignores settings from a non-leader: "
+            << format_.ToString() << " " << codec_settings->width << "x"
+            << codec_settings->height << " (using " << codec_settings_.width
+            << "x" << codec_settings_.height << ")";
+        return WEBRTC_VIDEO_CODEC_OK;
+      }
+      encoder_->Release();
+      RTC_LOG(LS_INFO) << "Reinitialize shared video encoder: "
+                       << format_.ToString() << " " << codec_settings->width
+                       << "x" << codec_settings->height;
+    } else {
+      encoder_ = factory_->Create(env, format_);
+      if (encoder_ == nullptr) {
+        RTC_LOG(LS_ERROR) << "Failed to create shared video encoder: "
+                          << format_.ToString();
+        SetInitialized(owner, false);
+        return WEBRTC_VIDEO_CODEC_ERROR;
+      }
+    }
+    int32_t r = encoder_->InitEncode(codec_settings, settings);
+    if (r != WEBRTC_VIDEO_CODEC_OK) {
+      encoder_.reset();
+      SetInitialized(owner, false);
+      return r;
+    }
+    encoder_->RegisterEncodeCompleteCallback(this);
+    codec_settings_ = *codec_settings;
+    num_streams_ = std::max<int>(1, codec_settings->numberOfSimulcastStreams);
+    RTC_LOG(LS_INFO) << "Shared video encoder initialized: "
+                     << format_.ToString();
+    return WEBRTC_VIDEO_CODEC_OK;
+  }
+
+  void SetCallback(const void* owner,
+                   webrtc::EncodedImageCallback* callback) {
+    std::lock_guard<std::mutex> guard(members_mutex_);
+    for (auto& m : members_) {
+      if (m.owner == owner) {
+        m.callback = callback;
+        return;
+      }
+    }
+    members_.push_back(Member{owner, callback, false});
+  }
+
+  // VideoStreamEncoder は設定を変える前に Release を呼ぶので、
+  // グループからは抜けずに初期化されていない状態にするだけにする
+  void Release(const void* owner) {
+    std::lock_guard<std::mutex> guard(encode_mutex_);
+    SetInitialized(owner, false);
+    ReleaseEncoderIfUnused();
+  }
+
+  void Leave(const void* owner) {
+    std::lock_guard<std::mutex> guard(encode_mutex_);
+    {
+      std::lock_guard<std::mutex> guard(members_mutex_);
+      members_.erase(
+          std::remove_if(members_.begin(), members_.end(),
+                         [owner](const Member& m) { return m.owner == owner; }),
+          members_.end());
+    }
+    ReleaseEncoderIfUnused();
+  }
+
+  int32_t Encode(const void* owner,
+                 const webrtc::VideoFrame& frame,
+                 const std::vector<webrtc::VideoFrameType>* frame_types) {
+    std::lock_guard<std::mutex> guard(encode_mutex_);
+    if (frame_types != nullptr &&
+        std::find(frame_types->begin(), frame_types->end(),
+                  webrtc::VideoFrameType::kVideoFrameKey) !=
+            frame_types->end()) {
+      key_frame_requested_ = true;
+    }
+    // 実際にエンコードするのはリーダーだけ
+    if (!IsLeader(owner)) {
+      return WEBRTC_VIDEO_CODEC_OK;
+    }
+    if (encoder_ == nullptr) {
+      return WEBRTC_VIDEO_CODEC_UNINITIALIZED;
+    }
+    if (!key_frame_requested_) {
+      return encoder_->Encode(frame, frame_types);
+    }
+    key_frame_requested_ = false;
+    std::vector<webrtc::VideoFrameType> key_frames(
+        frame_types != nullptr ? frame_types->size() : num_streams_,
+        webrtc::VideoFrameType::kVideoFrameKey);
+    return encoder_->Encode(frame, &key_frames);
+  }
+
+  void SetRates(const void* owner,
+                const webrtc::VideoEncoder::RateControlParameters& params) {
+    std::lock_guard<std::mutex> guard(encode_mutex_);
+    if (encoder_ != nullptr && IsLeader(owner)) {
+      encoder_->SetRates(params);
+    }
+  }
+
+  std::optional<webrtc::VideoEncoder::EncoderInfo> GetEncoderInfo() {
+    std::lock_guard<std::mutex> guard(encode_mutex_);
+    if (encoder_ == nullptr) {
+      return std::nullopt;
+    }
+    return encoder_->GetEncoderInfo();
+  }
+
+  Result OnEncodedImage(
+      const webrtc::EncodedImage& encoded_image,
+      const webrtc::CodecSpecificInfo* codec_specific_info) override {
+    std::lock_guard<std::mutex> guard(members_mutex_);
+    Result result(Result::OK);
+    bool leader = true;
+    for (auto& m : members_) {
+      if (!m.initialized || m.callback == nullptr) {
+        continue;
+      }
+      auto r = m.callback->OnEncodedImage(encoded_image, codec_specific_info);
+      // エンコーダに返すのはリーダーの結果
+      if (leader) {
+        result = r;
+        leader = false;
+      }
+    }
+    return result;
+  }
+
+  void OnDroppedFrame(DropReason reason) override {
+    std::lock_guard<std::mutex> guard(members_mutex_);
+    for (auto& m : members_) {
+      if (m.initialized && m.callback != nullptr) {
+        m.callback->OnDroppedFrame(reason);
+      }
+    }
+  }
+
+ private:
+  // 初期化されている中で一番最初に参加した接続がリーダー
+  bool IsLeader(const void* owner) {
+    std::lock_guard<std::mutex> guard(members_mutex_);
+    for (const auto& m : members_) {
+      if (m.initialized) {
+        return m.owner == owner;
+      }
+    }
+    return false;
+  }
+
+  void SetInitialized(const void* owner, bool initialized) {
+    std::lock_guard<std::mutex> guard(members_mutex_);
+    for (auto& m : members_) {
+      if (m.owner == owner) {
+        m.initialized = initialized;
+        return;
+      }
+    }
+    members_.push_back(Member{owner, nullptr, initialized});
+  }
+
+  // encode_mutex_ を持った状態で呼ぶこと
+  void ReleaseEncoderIfUnused() {
+    {
+      std::lock_guard<std::mutex> guard(members_mutex_);
+      if (std::any_of(members_.begin(), members_.end(),
+                      [](const Member& m) { return m.initialized; })) {
+        return;
+      }
+    }
+    if (encoder_ != nullptr) {
+      encoder_->Release();
+      encoder_.reset();
+      key_frame_requested_ = false;
+    }
+  }
+
+  webrtc::VideoEncoderFactory* factory_;
+  webrtc::SdpVideoFormat format_;
+
+  // encode_mutex_ -> members_mutex_ の順でロックする
+  std::mutex encode_mutex_;
+  std::unique_ptr<webrtc::VideoEncoder> encoder_;
+  // encoder_ を初期化した時の設定
+  webrtc::VideoCodec codec_settings_;
+  int num_streams_ = 1;
+  bool key_frame_requested_ = false;
+
+  std::mutex members_mutex_;
+  std::vector<Member> members_;
+};
+
+namespace {
+
+class SharedVideoEncoder : public webrtc::VideoEncoder {
+ public:
+  SharedVideoEncoder(const webrtc::Environment& env,
+                     std::shared_ptr<SharedVideoEncoderFactory::Group> group)
+      : env_(env), group_(std::move(group)) {}
+  ~SharedVideoEncoder() override { group_->Leave(this); }
+
+  int32_t InitEncode(const webrtc::VideoCodec* codec_settings,
+                     const Settings& settings) override {
+    return group_->InitEncode(this, env_, codec_settings, settings);
+  }
+  int32_t RegisterEncodeCompleteCallback(
+      webrtc::EncodedImageCallback* callback) override {
+    group_->SetCallback(this, callback);
+    return WEBRTC_VIDEO_CODEC_OK;
+  }
+  int32_t Release() override {
+    group_->Release(this);
+    return WEBRTC_VIDEO_CODEC_OK;
+  }
+  int32_t Encode(
+      const webrtc::VideoFrame& frame,
+      const std::vector<webrtc::VideoFrameType>* frame_types) override {
+    return group_->Encode(this, frame, frame_types);
+  }
+  void SetRates(const RateControlParameters& parameters) override {
+    group_->SetRates(this, parameters);
+  }
+  EncoderInfo GetEncoderInfo() const override {
+    auto info = group_->GetEncoderInfo();
+    if (!info) {
+      return EncoderInfo();
+    }
+    return *info;
+  }
+
+ private:
+  webrtc::Environment env_;
+  std::shared_ptr<SharedVideoEncoderFactory::Group> group_;
+};
+
+}  // namespace
+
+SharedVideoEncoderFactory::SharedVideoEncoderFactory(
+    std::unique_ptr<webrtc::VideoEncoderFactory> factory)
+    : factory_(std::move(factory)) {}
+
+SharedVideoEncoderFactory::~SharedVideoEncoderFactory() = default;
+
+std::vector<webrtc::SdpVideoFormat>
+SharedVideoEncoderFactory::GetSupportedFormats() const {
+  return factory_->GetSupportedFormats();
+}
+
+webrtc::VideoEncoderFactory::CodecSupport
+SharedVideoEncoderFactory::QueryCodecSupport(
+    const webrtc::SdpVideoFormat& format,
+    std::optional<std::string> scalability_mode) const {
+  return factory_->QueryCodecSupport(format, scalability_mode);
+}
+
+std::unique_ptr<webrtc::VideoEncoder> SharedVideoEncoderFactory::Create(
+    const webrtc::Environment& env,
+    const webrtc::SdpVideoFormat& format) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  std::shared_ptr<Group> group;
+  for (auto it = groups_.begin(); it != groups_.end();) {
+    if (it->second.expired()) {
+      it = groups_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  auto key = format.ToString();
+  auto it = groups_.find(key);
+  if (it != groups_.end()) {
+    group = it->second.lock();
+  }
+  if (group == nullptr) {
+    group = std::make_shared<Group>(factory_.get(), format);
+    groups_[key] = group;
+  }
+  return std::make_unique<SharedVideoEncoder>(env, group);
+}
+
+// ---- 音声 ----
+
+namespace {
+
+std::string GetAudioFormatKey(const webrtc::SdpAudioFormat& format) {
+  std::string key = format.name + "/" + std::to_string(format.clockrate_hz) +
+                    "/" + std::to_string(format.num_channels);
+  for (const auto& p : format.parameters) {
+    key += ";" + p.first + "=" + p.second;
+  }
+  return key;
+}
+
+}  // namespace
+
+class SharedAudioEncoderFactory::Group {
+ public:
+  // この数だけエンコード結果を保持しておく。
+  // これより遅れた接続は自分でエンコードする
+  static constexpr int kMaxResults = 64;
+
+  struct Result {
+    webrtc::Buffer data;
+    webrtc::AudioEncoder::EncodedInfo info;
+    uint32_t rtp_timestamp = 0;
+  };
+
+  explicit Group(std::unique_ptr<webrtc::AudioEncoder> encoder)
+      : encoder_(std::move(encoder)) {
+    sample_rate_hz_ = encoder_->SampleRateHz();
+    num_channels_ = encoder_->NumChannels();
+    rtp_timestamp_rate_hz_ = encoder_->RtpTimestampRateHz();
+    num_10ms_frames_in_next_packet_ = encoder_->Num10MsFramesInNextPacket();
+    max_10ms_frames_in_a_packet_ = encoder_->Max10MsFramesInAPacket();
+    target_bitrate_ = encoder_->GetTargetBitrate();
+    frame_length_range_ = encoder_->GetFrameLengthRange();
+  }
+
+  // 次にエンコードされる結果の番号
+  int64_t Head() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return head_;
+  }
+
+  // index 番目の結果を encoded に追記する。
+  // まだエンコードされていなければ audio をエンコードして結果を保存する。
+  webrtc::AudioEncoder::EncodedInfo Encode(
+      int64_t* index,
+      uint32_t rtp_timestamp,
+      webrtc::ArrayView<const int16_t> audio,
+      webrtc::Buffer* encoded) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (*index < head_ - kMaxResults || *index > head_) {
+      *index = head_;
+    }
+    if (*index == head_) {
+      auto& r = results_[head_ % kMaxResults];
+      r.data.Clear();
+      r.info = encoder_->Encode(rtp_timestamp, audio, &r.data);
+      r.rtp_timestamp = rtp_timestamp;
+      head_ += 1;
+    }
+    const auto& r = results_[*index % kMaxResults];
+    *index += 1;
+    encoded->AppendData(r.data);
+    auto info = r.info;
+    // RTP タイムスタンプは接続毎に違うので、差分だけずらす
+    info.encoded_timestamp += rtp_timestamp - r.rtp_timestamp;
+    return info;
+  }
+
+  int sample_rate_hz_;
+  size_t num_channels_;
+  int rtp_timestamp_rate_hz_;
+  size_t num_10ms_frames_in_next_packet_;
+  size_t max_10ms_frames_in_a_packet_;
+  int target_bitrate_;
+  std::optional<std::pair<webrtc::TimeDelta, webrtc::TimeDelta>>
+      frame_length_range_;
+
+ private:
+  std::mutex mutex_;
+  std::unique_ptr<webrtc::AudioEncoder> encoder_;
+  std::array<Result, kMaxResults> results_;
+  int64_t head_ = 0;
+};
+
+namespace {
+
+class SharedAudioEncoder : public webrtc::AudioEncoder {
+ public:
+  SharedAudioEncoder(std::shared_ptr<SharedAudioEncoderFactory::Group> group,
+                     int payload_type)
+      : group_(std::move(group)), payload_type_(payload_type) {}
+
+  int SampleRateHz() const override { return group_->sample_rate_hz_; }
+  size_t NumChannels() const override { return group_->num_channels_; }
+  int RtpTimestampRateHz() const override {
+    return group_->rtp_timestamp_rate_hz_;
+  }
+  size_t Num10MsFramesInNextPacket() const override {
+    return group_->num_10ms_frames_in_next_packet_;
+  }
+  size_t Max10MsFramesInAPacket() const override {
+    return group_->max_10ms_frames_in_a_packet_;
+  }
+  int GetTargetBitrate() const override { return group_->target_bitrate_; }
+  std::optional<std::pair<webrtc::TimeDelta, webrtc::TimeDelta>>
+  GetFrameLengthRange() const override {
+    return group_->frame_length_range_;
+  }
+  void Reset() override { index_ = std::nullopt; }
+
+ protected:
+  EncodedInfo EncodeImpl(uint32_t rtp_timestamp,
+                         webrtc::ArrayView<const int16_t> audio,
+                         webrtc::Buffer* encoded) override {
+    // 最初の呼び出しで、グループの最新の位置から参加する
+    if (!index_) {
+      index_ = group_->Head();
+    }
+    auto info = group_->Encode(&*index_, rtp_timestamp, audio, encoded);
+    if (info.encoded_bytes > 0) {
+      info.payload_type = payload_type_;
+    }
+    return info;
+  }
+
+ private:
+  std::shared_ptr<SharedAudioEncoderFactory::Group> group_;
+  int payload_type_;
+  std::optional<int64_t> index_;
+};
+
+}  // namespace
+
+SharedAudioEncoderFactory::SharedAudioEncoderFactory(
+    webrtc::scoped_refptr<webrtc::AudioEncoderFactory> factory)
+    : factory_(std::move(factory)) {}
+
+SharedAudioEncoderFactory::~SharedAudioEncoderFactory() = default;
+
+std::vector<webrtc::AudioCodecSpec>
+SharedAudioEncoderFactory::GetSupportedEncoders() {
+  return factory_->GetSupportedEncoders();
+}
+
+std::optional<webrtc::AudioCodecInfo>
+SharedAudioEncoderFactory::QueryAudioEncoder(
+    const webrtc::SdpAudioFormat& format) {
+  return factory_->QueryAudioEncoder(format);
+}
+
+std::unique_ptr<webrtc::AudioEncoder> SharedAudioEncoderFactory::Create(
+    const webrtc::Environment& env,
+    const webrtc::SdpAudioFormat& format,
+    Options options) {
+  int payload_type = options.payload_type;
+  std::lock_guard<std::mutex> guard(mutex_);
+  for (auto it = groups_.begin(); it != groups_.end();) {
+    if (it->second.expired()) {
+      it = groups_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  auto key = GetAudioFormatKey(format);
+  std::shared_ptr<Group> group;
+  auto it = groups_.find(key);
+  if (it != groups_.end()) {
+    group = it->second.lock();
+  }
+  if (group == nullptr) {
+    auto encoder = factory_->Create(env, format, std::move(options));
+    if (encoder == nullptr) {
+      RTC_LOG(LS_ERROR) << "Failed to create shared audio encoder: " << key;
+      return nullptr;
+    }
+    group = std::make_shared<Group>(std::move(encoder));
+    groups_[key] = group;
+  }
+  return std::make_unique<SharedAudioEncoder>(group, payload_type);
+}
+
+}  // namespace sora_unity_sdk
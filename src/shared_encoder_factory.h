@@ -0,0 +1,82 @@
+#ifndef SORA_UNITY_SDK_SHARED_ENCODER_FACTORY_H_INCLUDED
+#define SORA_UNITY_SDK_SHARED_ENCODER_FACTORY_H_INCLUDED
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+// WebRTC
+#include <api/audio_codecs/audio_encoder_factory.h>
+#include <api/environment/environment.h>
+#include <api/scoped_refptr.h>
+#include <api/video_codecs/video_encoder_factory.h>
+
+namespace sora_unity_sdk {
+
+// 負荷試験のために、同じ PeerConnectionFactory を使う全ての接続で
+// 1 つのエンコーダの出力を共有するエンコーダファクトリ。
+//
+// 同じコーデックのエンコーダは全て 1 つのグループに入り、最初に初期化した接続の
+// エンコーダ（リーダー）だけが実際にエンコードして、その結果を全ての接続に配る。
+// 各接続で行うのはパケット化と暗号化だけになる。
+//
+// 全ての接続が同じソースから同じ設定で送信することを前提にしている。
+// ビットレートなどの制御はリーダーの接続のものだけが反映され、
+// どの接続からキーフレームを要求されてもリーダーのエンコーダでキーフレームを作る。
+// リーダーが違う設定で InitEncode を呼んだ場合はエンコーダを初期化し直し、
+// リーダー以外の接続の違う設定は警告を出して無視する。
+class SharedVideoEncoderFactory : public webrtc::VideoEncoderFactory {
+ public:
+  explicit SharedVideoEncoderFactory(
+      std::unique_ptr<webrtc::VideoEncoderFactory> factory);
+  ~SharedVideoEncoderFactory() override;
+
+  std::vector<webrtc::SdpVideoFormat> GetSupportedFormats() const override;
+  CodecSupport QueryCodecSupport(
+      const webrtc::SdpVideoFormat& format,
+      std::optional<std::string> scalability_mode) const override;
+  std::unique_ptr<webrtc::VideoEncoder> Create(
+      const webrtc::Environment& env,
+      const webrtc::SdpVideoFormat& format) override;
+
+  class Group;
+
+ private:
+  std::unique_ptr<webrtc::VideoEncoderFactory> factory_;
+  std::mutex mutex_;
+  std::map<std::string, std::weak_ptr<Group>> groups_;
+};
+
+// 音声版の SharedVideoEncoderFactory。
+//
+// 音声のエンコーダは 10ms 毎に同期的に呼ばれるので、グループ内の呼び出し回数で
+// 同じ時刻の音声を揃えて、最初に呼んだ接続の入力だけをエンコードする。
+// 他の接続にはエンコード結果をコピーし、RTP タイムスタンプだけ各接続のものに合わせる。
+class SharedAudioEncoderFactory : public webrtc::AudioEncoderFactory {
+ public:
+  explicit SharedAudioEncoderFactory(
+      webrtc::scoped_refptr<webrtc::AudioEncoderFactory> factory);
+  ~SharedAudioEncoderFactory() override;
+
+  std::vector<webrtc::AudioCodecSpec> GetSupportedEncoders() override;
+  std::optional<webrtc::AudioCodecInfo> QueryAudioEncoder(
+      const webrtc::SdpAudioFormat& format) override;
+  std::unique_ptr<webrtc::AudioEncoder> Create(
+      const webrtc::Environment& env,
+      const webrtc::SdpAudioFormat& format,
+      Options options) override;
+
+  class Group;
+
+ private:
+  webrtc::scoped_refptr<webrtc::AudioEncoderFactory> factory_;
+  std::mutex mutex_;
+  std::map<std::string, std::weak_ptr<Group>> groups_;
+};
+
+}  // namespace sora_unity_sdk
+
+#endif
@@ -1,7 +1,7 @@
 #include "sora.h"
 #include "sora_version.h"
 
-#include <future>
+#include <algorithm>
 
 // WebRTC
 #include <api/audio/create_audio_device_module.h>
@@ -22,6 +22,7 @@
 #include <rtc_base/crypto_random.h>
 #include <rtc_base/logging.h>
 #include <rtc_base/ssl_adapter.h>
+#include <rtc_base/time_utils.h>
 
 // Sora
 #include <sora/audio_device_module.h>
@@ -32,7 +33,12 @@
 #include <sora/sora_video_decoder_factory.h>
 #include <sora/sora_video_encoder_factory.h>
 
+// Boost
+#include <boost/json.hpp>
+
 #include "converter.h"
+#include "device_registry.h"
+#include "shared_encoder_factory.h"
 
 #ifdef SORA_UNITY_SDK_ANDROID
 #include <sora/android/android_capturer.h>
@@ -50,7 +56,10 @@
 
 namespace sora_unity_sdk {
 
-Sora::Sora(UnityContext* context) : unity_context_(context) {
+Sora::Sora(UnityContext* context)
+    : unity_context_(context),
+      timeline_(std::make_shared<ConnectTimeline>()),
+      first_packet_observer_(timeline_) {
   ptrid_ = IdPointer::Instance().Register(this);
 #if defined(SORA_UNITY_SDK_ANDROID)
   auto env = sora::GetJNIEnv();
@@ -62,34 +71,52 @@ Sora::Sora(UnityContext* context) : unity_context_(context) {
 Sora::~Sora() {
   RTC_LOG(LS_INFO) << "Sora object destroy started";
 
+  if (device_listener_id_ != 0) {
+    DeviceRegistry::Instance().RemoveListener(device_listener_id_);
+  }
   IdPointer::Instance().Unregister(ptrid_);
 
   renderer_.reset();
-#if defined(SORA_UNITY_SDK_ANDROID)
-  if (capturer_ != nullptr && capturer_type_ == 0) {
-    static_cast<sora::AndroidCapturer*>(capturer_.get())->Stop();
-  }
-#endif
-#if defined(SORA_UNITY_SDK_IOS) || defined(SORA_UNITY_SDK_MACOS)
-  if (capturer_ != nullptr && capturer_type_ == 0) {
-    static_cast<sora::MacCapturer*>(capturer_.get())->Stop();
+  if (pending_video_track_ != nullptr) {
+    pending_video_track_->RemoveSink(switch_camera_sink_.get());
   }
-#endif
-  if (capturer_ != nullptr && capturer_type_ != 0) {
-    static_cast<UnityCameraCapturer*>(capturer_.get())->Stop();
+  switch_camera_sink_.reset();
+  StopCapturer(pending_capturer_, pending_capturer_type_);
+  StopCapturer(capturer_, capturer_type_);
+  {
+    std::lock_guard<std::mutex> guard(video_sources_mutex_);
+    for (const auto& kv : video_sources_) {
+      StopCapturer(kv.second.capturer, kv.second.capturer_type);
+    }
+    video_sources_.clear();
+    pending_capturer_ = nullptr;
+    capturer_ = nullptr;
   }
+  pending_video_track_ = nullptr;
   capturer_sink_ = nullptr;
-  capturer_ = nullptr;
   unity_adm_ = nullptr;
 
   video_sender_ = nullptr;
+  primary_video_track_ = nullptr;
   audio_track_ = nullptr;
   video_track_ = nullptr;
 
+  // RtpReceiver は first_packet_observer_ より長生きする可能性があるので外しておく
+  {
+    std::lock_guard<std::mutex> guard(observed_receivers_mutex_);
+    for (auto& receiver : observed_receivers_) {
+      receiver->SetObserver(nullptr);
+    }
+    observed_receivers_.clear();
+  }
+
   if (ioc_ != nullptr) {
     ioc_->stop();
   }
   signaling_.reset();
+  connection_state_timer_.reset();
+  stats_timer_.reset();
+  switch_camera_timer_.reset();
   ioc_.reset();
   if (io_thread_) {
     io_thread_->Stop();
@@ -149,6 +176,28 @@ void Sora::SetOnCapturerFrame(
     std::function<void(std::string)> on_capturer_frame) {
   on_capturer_frame_ = std::move(on_capturer_frame);
 }
+void Sora::SetOnSwitchCamera(
+    std::function<void(bool, std::string)> on_switch_camera) {
+  on_switch_camera_ = std::move(on_switch_camera);
+}
+void Sora::SetOnAddVideoSource(
+    std::function<void(int, ptrid_t)> on_add_video_source) {
+  on_add_video_source_ = std::move(on_add_video_source);
+}
+void Sora::SetOnDeviceChange(std::function<void(int)> on_device_change) {
+  on_device_change_ = std::move(on_device_change);
+  if (on_device_change_ && device_listener_id_ == 0) {
+    // RemoveListener() はリスナーの呼び出し中なら終わるまで待つので this を使って問題ない
+    device_listener_id_ =
+        DeviceRegistry::Instance().AddListener([this](DeviceKind kind) {
+          PushEvent([this, kind]() {
+            if (on_device_change_) {
+              on_device_change_((int)kind);
+            }
+          });
+        });
+  }
+}
 
 void Sora::DispatchEvents() {
   auto self = shared_from_this();
@@ -164,6 +213,74 @@ void Sora::DispatchEvents() {
     }
     f();
   }
+
+  if (receive_quality_controller_ != nullptr && set_offer_ &&
+      renderer_ != nullptr) {
+    auto requests = receive_quality_controller_->Update(
+        webrtc::TimeMicros(),
+        [this](ptrid_t video_sink_id, TextureStats* stats) {
+          return renderer_->GetTextureStats(video_sink_id, stats);
+        });
+    for (const auto& req : requests) {
+      boost::json::object params;
+      params["sender_connection_id"] = req.first;
+      params["rid"] = req.second;
+      boost::json::object rpc;
+      rpc["jsonrpc"] = "2.0";
+      rpc["method"] = receive_quality_controller_->rpc_method();
+      rpc["params"] = params;
+      SendMessage("rpc", boost::json::serialize(rpc));
+    }
+  }
+}
+
+void Sora::StartReceiveQualityController(
+    const sora_conf::internal::ReceiveQualityControllerConfig& config) {
+  RTC_LOG(LS_INFO) << "StartReceiveQualityController: "
+                   << jsonif::to_json(config);
+  receive_quality_controller_.reset(new ReceiveQualityController(config));
+  for (const auto& kv : remote_video_sinks_) {
+    receive_quality_controller_->AddSink(kv.first, kv.second);
+  }
+}
+void Sora::StopReceiveQualityController() {
+  receive_quality_controller_.reset();
+}
+void Sora::SetVideoSinkHint(ptrid_t video_sink_id, bool visible, bool focused) {
+  if (receive_quality_controller_ == nullptr) {
+    return;
+  }
+  receive_quality_controller_->SetHint(video_sink_id, visible, focused);
+}
+
+static webrtc::DegradationPreference ToDegradationPreference(
+    sora_conf::internal::DegradationPreference dp) {
+  switch (dp) {
+    case sora_conf::internal::DegradationPreference::DISABLED:
+      return webrtc::DegradationPreference::DISABLED;
+    case sora_conf::internal::DegradationPreference::MAINTAIN_FRAMERATE:
+      return webrtc::DegradationPreference::MAINTAIN_FRAMERATE;
+    case sora_conf::internal::DegradationPreference::MAINTAIN_RESOLUTION:
+      return webrtc::DegradationPreference::MAINTAIN_RESOLUTION;
+    case sora_conf::internal::DegradationPreference::BALANCED:
+    default:
+      return webrtc::DegradationPreference::BALANCED;
+  }
+}
+
+static sora_conf::internal::DegradationPreference FromDegradationPreference(
+    webrtc::DegradationPreference dp) {
+  switch (dp) {
+    case webrtc::DegradationPreference::DISABLED:
+      return sora_conf::internal::DegradationPreference::DISABLED;
+    case webrtc::DegradationPreference::MAINTAIN_FRAMERATE:
+      return sora_conf::internal::DegradationPreference::MAINTAIN_FRAMERATE;
+    case webrtc::DegradationPreference::MAINTAIN_RESOLUTION:
+      return sora_conf::internal::DegradationPreference::MAINTAIN_RESOLUTION;
+    case webrtc::DegradationPreference::BALANCED:
+    default:
+      return sora_conf::internal::DegradationPreference::BALANCED;
+  }
 }
 
 static sora_conf::VideoFrame VideoFrameToConfig(
@@ -200,7 +317,33 @@ static sora_conf::VideoFrame VideoFrameToConfig(
   return f;
 }
 
-void Sora::Connect(const sora_conf::internal::ConnectConfig& cc) {
+#if defined(SORA_UNITY_SDK_IOS)
+// iOS でマイクを使用する場合、ADM を初期化する前にマイクの初期化の設定をする
+static void StartIosAudioInit(
+    const sora_conf::internal::ConnectConfig& cc,
+    std::function<void(int, std::string)> on_error) {
+  if (cc.role == "recvonly" || cc.unity_audio_input) {
+    // この場合マイクを利用しない
+    return;
+  }
+
+  static bool ios_audio_initializing = false;
+  if (!ios_audio_initializing) {
+    ios_audio_initializing = true;
+    IosAudioInit([on_error = std::move(on_error)](std::string error) {
+      if (!error.empty()) {
+        RTC_LOG(LS_ERROR) << "Failed to IosAudioInit: error=" << error;
+        on_error((int)sora_conf::ErrorCode::INTERNAL_ERROR,
+                 "Failed to IosAudioInit: error=" + error);
+      }
+      ios_audio_initializing = false;
+    });
+  }
+}
+#endif
+
+void Sora::Connect(const sora_conf::internal::ConnectConfig& cc,
+                   std::shared_ptr<SoraSharedContext> shared_context) {
   auto on_disconnect = [this](int error_code, std::string reason) {
     PushEvent([this, error_code, reason = std::move(reason)]() {
       if (on_disconnect_) {
@@ -209,51 +352,111 @@ void Sora::Connect(const sora_conf::internal::ConnectConfig& cc) {
     });
   };
 
-#if defined(SORA_UNITY_SDK_IOS)
-  // iOS でマイクを使用する場合、マイクの初期化の設定をしてから DoConnect する。
+  // Prepare() した時と設定が違う場合は、準備したものを捨てて最初からやり直す
+  if (prepared_ && !IsPreparedFor(cc, shared_context)) {
+    RTC_LOG(LS_WARNING) << "ConnectConfig does not match the one passed to "
+                           "Prepare(), preparing again";
+    ReleasePrepared();
+  }
 
-  if (cc.role == "recvonly" || cc.unity_audio_input) {
-    // この場合マイクを利用しないのですぐに DoConnect
-    DoConnect(cc, std::move(on_disconnect));
-    return;
+#if defined(SORA_UNITY_SDK_IOS)
+  // Prepare() 済みなら、その時に初期化している
+  if (!prepared_) {
+    StartIosAudioInit(cc, on_disconnect);
   }
+#endif
+  DoConnect(cc, shared_context, std::move(on_disconnect));
+}
 
-  static bool ios_audio_initializing = false;
-  if (!ios_audio_initializing) {
-    ios_audio_initializing = true;
-    IosAudioInit(
-        [this, on_disconnect = std::move(on_disconnect)](std::string error) {
-          if (!error.empty()) {
-            RTC_LOG(LS_ERROR) << "Failed to IosAudioInit: error=" << error;
-            on_disconnect((int)sora_conf::ErrorCode::INTERNAL_ERROR,
-                          "Failed to IosAudioInit: error=" + error);
-          }
-          ios_audio_initializing = false;
-        });
+bool Sora::Prepare(const sora_conf::internal::ConnectConfig& cc,
+                   std::shared_ptr<SoraSharedContext> shared_context) {
+  RTC_LOG(LS_INFO) << "Sora::Prepare " << jsonif::to_json(cc);
+
+  if (prepared_ || ioc_ != nullptr) {
+    RTC_LOG(LS_WARNING) << "Already prepared or connected";
+    return false;
   }
-  DoConnect(cc, std::move(on_disconnect));
-#else
-  DoConnect(cc, std::move(on_disconnect));
+  timeline_->Reset();
+  auto on_error = [](int error_code, std::string reason) {
+    RTC_LOG(LS_ERROR) << "Failed to Prepare: error_code=" << error_code
+                      << " reason=" << reason;
+  };
+#if defined(SORA_UNITY_SDK_IOS)
+  StartIosAudioInit(cc, on_error);
 #endif
+  return DoPrepare(cc, shared_context, on_error);
 }
 
-void Sora::DoConnect(const sora_conf::internal::ConnectConfig& cc,
-                     std::function<void(int, std::string)> on_disconnect) {
-  RTC_LOG(LS_INFO) << "Sora::Connect " << jsonif::to_json(cc);
+bool Sora::IsPreparedFor(
+    const sora_conf::internal::ConnectConfig& cc,
+    std::shared_ptr<SoraSharedContext> shared_context) const {
+  // DoPrepare() で使う設定だけを比べる
+  const auto& p = prepared_config_;
+  return shared_context == prepared_shared_context_ && cc.role == p.role &&
+         cc.no_audio_device == p.no_audio_device &&
+         cc.no_video_device == p.no_video_device &&
+         cc.unity_audio_input == p.unity_audio_input &&
+         cc.unity_audio_output == p.unity_audio_output &&
+         cc.audio_recording_device == p.audio_recording_device &&
+         cc.audio_playout_device == p.audio_playout_device &&
+         cc.has_audio_speaker_volume() == p.has_audio_speaker_volume() &&
+         cc.audio_speaker_volume == p.audio_speaker_volume &&
+         cc.has_audio_microphone_volume() == p.has_audio_microphone_volume() &&
+         cc.audio_microphone_volume == p.audio_microphone_volume &&
+         jsonif::to_json(cc.camera_config) ==
+             jsonif::to_json(p.camera_config) &&
+         jsonif::to_json(cc.video_codec_capability_config) ==
+             jsonif::to_json(p.video_codec_capability_config) &&
+         cc.has_video_codec_preference() == p.has_video_codec_preference() &&
+         jsonif::to_json(cc.video_codec_preference) ==
+             jsonif::to_json(p.video_codec_preference);
+}
 
+void Sora::ReleasePrepared() {
+  StopCapturer(capturer_, capturer_type_);
+  {
+    std::lock_guard<std::mutex> guard(video_sources_mutex_);
+    capturer_ = nullptr;
+    capturer_type_ = 0;
+  }
+  audio_track_ = nullptr;
+  video_track_ = nullptr;
+  renderer_.reset();
+  unity_adm_ = nullptr;
+  shared_adm_ = false;
+  sora_context_ = nullptr;
+  prepared_shared_context_ = nullptr;
+  prepared_ = false;
+}
+
+sora_prepare_timings_t Sora::GetPrepareTimings() const {
+  return prepare_timings_;
+}
+
+int Sora::ReadConnectTimeline(sora_timeline_event_t* buf, int size) {
+  return timeline_->Read(buf, size);
+}
+
+bool Sora::DoPrepare(const sora_conf::internal::ConnectConfig& cc,
+                     std::shared_ptr<SoraSharedContext> shared_context,
+                     std::function<void(int, std::string)> on_error) {
   if (cc.role != "sendonly" && cc.role != "recvonly" && cc.role != "sendrecv") {
     RTC_LOG(LS_ERROR) << "Invalid role: " << cc.role;
-    on_disconnect((int)sora_conf::ErrorCode::INVALID_PARAMETER,
-                  "Invalid role: " + cc.role);
-    return;
-  }
-  if (cc.signaling_url.empty()) {
-    RTC_LOG(LS_ERROR) << "Signaling URL is empty";
-    on_disconnect((int)sora_conf::ErrorCode::INVALID_PARAMETER,
-                  "Signaling URL is empty");
-    return;
+    on_error((int)sora_conf::ErrorCode::INVALID_PARAMETER,
+             "Invalid role: " + cc.role);
+    return false;
   }
 
+  prepare_timings_ = {};
+  int64_t start_us = webrtc::TimeMicros();
+  int64_t phase_us = start_us;
+  auto lap = [&phase_us]() {
+    int64_t now_us = webrtc::TimeMicros();
+    int64_t elapsed_us = now_us - phase_us;
+    phase_us = now_us;
+    return elapsed_us;
+  };
+
   // このスレッド上の env と context
   void* env = sora::GetJNIEnv();
   void* android_context = GetAndroidApplicationContext(env);
@@ -299,6 +502,13 @@ void Sora::DoConnect(const sora_conf::internal::ConnectConfig& cc,
         dependencies.worker_thread->BlockingCall(
             [&] { dependencies.adm = unity_adm_; });
 
+        // DecodeGate で読み飛ばすことにしたフレームをデコーダに渡さない
+        if (dependencies.video_decoder_factory != nullptr) {
+          dependencies.video_decoder_factory =
+              std::make_unique<DecodeGateVideoDecoderFactory>(
+                  std::move(dependencies.video_decoder_factory));
+        }
+
 #if defined(SORA_UNITY_SDK_ANDROID)
         dependencies.worker_thread->BlockingCall([worker_env, worker_context] {
           ((JNIEnv*)worker_env)->DeleteLocalRef((jobject)worker_context);
@@ -306,28 +516,49 @@ void Sora::DoConnect(const sora_conf::internal::ConnectConfig& cc,
 #endif
       };
 
-  sora_context_ = sora::SoraClientContext::Create(client_config);
+  if (shared_context != nullptr) {
+    // 共有コンテキストの ADM は全ての Sora インスタンスで共通なので、
+    // Unity のオーディオ入出力は使えない
+    if (cc.unity_audio_input || cc.unity_audio_output) {
+      RTC_LOG(LS_WARNING) << "unity_audio_input and unity_audio_output are "
+                             "ignored when using the shared context";
+    }
+    // 音量も全ての接続に影響するので、SharedContextConfig で指定する
+    if (cc.has_audio_speaker_volume() || cc.has_audio_microphone_volume()) {
+      RTC_LOG(LS_WARNING) << "audio_speaker_volume and audio_microphone_volume "
+                             "are ignored when using the shared context";
+    }
+    sora_context_ = shared_context->client_context;
+    unity_adm_ = shared_context->adm;
+    shared_adm_ = true;
+  } else {
+    sora_context_ = sora::SoraClientContext::Create(client_config);
+    shared_adm_ = false;
+  }
 
   if (sora_context_ == nullptr) {
     RTC_LOG(LS_ERROR) << "Failed to create PeerConnectionFactory";
-    on_disconnect((int)sora_conf::ErrorCode::INTERNAL_ERROR,
-                  "Failed to create PeerConnectionFactory");
-    return;
+    on_error((int)sora_conf::ErrorCode::INTERNAL_ERROR,
+             "Failed to create PeerConnectionFactory");
+    return false;
   }
+  prepare_timings_.context_us = lap();
+  timeline_->Record(SORA_TIMELINE_CONTEXT_CREATED);
 
   if (!InitADM(unity_adm_,
-               cc.has_audio_speaker_volume()
+               !shared_adm_ && cc.has_audio_speaker_volume()
                    ? std::make_optional(cc.audio_speaker_volume)
                    : std::nullopt,
-               cc.has_audio_microphone_volume()
+               !shared_adm_ && cc.has_audio_microphone_volume()
                    ? std::make_optional(cc.audio_microphone_volume)
                    : std::nullopt)) {
-    on_disconnect((int)sora_conf::ErrorCode::INTERNAL_ERROR,
-                  "Failed to InitADM");
-    return;
+    on_error((int)sora_conf::ErrorCode::INTERNAL_ERROR, "Failed to InitADM");
+    return false;
   }
+  prepare_timings_.adm_us = lap();
+  timeline_->Record(SORA_TIMELINE_ADM_INITIALIZED);
 
-  renderer_.reset(new UnityRenderer());
+  renderer_.reset(new UnityRenderer(timeline_));
 
   if (cc.role == "sendonly" || cc.role == "sendrecv") {
     std::function<void(const webrtc::VideoFrame& frame)> on_frame;
@@ -339,21 +570,33 @@ void Sora::DoConnect(const sora_conf::internal::ConnectConfig& cc,
       };
     }
 
-    auto capturer = CreateVideoCapturer(
-        cc.camera_config.capturer_type,
-        (void*)cc.camera_config.unity_camera_texture, cc.no_video_device,
-        cc.camera_config.video_capturer_device, cc.camera_config.video_width,
-        cc.camera_config.video_height, cc.camera_config.video_fps, on_frame,
-        sora_context_->signaling_thread(), env, android_context,
-        unity_context_);
-    if (!cc.no_video_device && !capturer) {
-      on_disconnect((int)sora_conf::ErrorCode::INTERNAL_ERROR,
-                    "Capturer Init Failed");
-      return;
+    webrtc::scoped_refptr<webrtc::VideoTrackSourceInterface> capturer;
+    if (!cc.no_video_device && shared_context != nullptr &&
+        shared_context->video_source != nullptr) {
+      // 共有コンテキストの映像ソースは全ての Sora インスタンスで共通なので、
+      // このインスタンスでは止めたり切り替えたりしない
+      capturer = shared_context->video_source;
+    } else {
+      capturer = CreateVideoCapturer(
+          cc.camera_config.capturer_type,
+          (void*)cc.camera_config.unity_camera_texture, cc.no_video_device,
+          cc.camera_config.video_capturer_device, cc.camera_config.video_width,
+          cc.camera_config.video_height, cc.camera_config.video_fps,
+          cc.camera_config.capture_on_mark_dirty,
+          cc.camera_config.keepalive_interval_ms, on_frame,
+          sora_context_->signaling_thread(), env, android_context,
+          unity_context_);
+      if (!cc.no_video_device && !capturer) {
+        on_error((int)sora_conf::ErrorCode::INTERNAL_ERROR,
+                 "Capturer Init Failed");
+        return false;
+      }
+      std::lock_guard<std::mutex> guard(video_sources_mutex_);
+      capturer_ = capturer;
+      capturer_type_ = cc.camera_config.capturer_type;
     }
-
-    capturer_ = capturer;
-    capturer_type_ = cc.camera_config.capturer_type;
+    prepare_timings_.capturer_us = lap();
+    timeline_->Record(SORA_TIMELINE_CAPTURER_STARTED);
 
     std::string audio_track_id = webrtc::CreateRandomString(16);
     audio_track_ = sora_context_->peer_connection_factory()->CreateAudioTrack(
@@ -366,8 +609,51 @@ void Sora::DoConnect(const sora_conf::internal::ConnectConfig& cc,
       video_track_ = sora_context_->peer_connection_factory()->CreateVideoTrack(
           capturer, video_track_id);
     }
+    prepare_timings_.tracks_us = lap();
   }
 
+  prepared_config_ = cc;
+  prepared_shared_context_ = shared_context;
+
+  prepare_timings_.total_us = phase_us - start_us;
+  RTC_LOG(LS_INFO) << "Prepared: context_us=" << prepare_timings_.context_us
+                   << " adm_us=" << prepare_timings_.adm_us
+                   << " capturer_us=" << prepare_timings_.capturer_us
+                   << " tracks_us=" << prepare_timings_.tracks_us
+                   << " total_us=" << prepare_timings_.total_us;
+  prepared_ = true;
+  return true;
+}
+
+void Sora::DoConnect(const sora_conf::internal::ConnectConfig& cc,
+                     std::shared_ptr<SoraSharedContext> shared_context,
+                     std::function<void(int, std::string)> on_disconnect) {
+  RTC_LOG(LS_INFO) << "Sora::Connect " << jsonif::to_json(cc);
+
+  if (cc.signaling_url.empty()) {
+    RTC_LOG(LS_ERROR) << "Signaling URL is empty";
+    on_disconnect((int)sora_conf::ErrorCode::INVALID_PARAMETER,
+                  "Signaling URL is empty");
+    return;
+  }
+
+  // Prepare() 済みの場合、タイムラインには Prepare() 時のイベントが CONNECT_START より前に残っている
+  if (!prepared_) {
+    timeline_->Reset();
+  }
+  timeline_->Record(SORA_TIMELINE_CONNECT_START);
+
+  // Prepare() 済みであれば、その時に作ったコンテキストやトラックをそのまま使う
+  if (!prepared_ && !DoPrepare(cc, shared_context, on_disconnect)) {
+    return;
+  }
+  prepared_ = false;
+  prepared_shared_context_ = nullptr;
+  decode_pause_idle_frames_ = cc.decode_pause_idle_frames;
+  manual_video_sink_ = cc.manual_video_sink;
+  no_video_decode_ = cc.no_video_decode;
+  decode_gates_.clear();
+
   {
     RTC_LOG(LS_INFO) << "Start Signaling: cc=" << jsonif::to_json(cc);
     ioc_.reset(new boost::asio::io_context(1));
@@ -434,24 +720,8 @@ void Sora::DoConnect(const sora_conf::internal::ConnectConfig& cc,
     config.audio_codec_type = cc.audio_codec_type;
     config.audio_bit_rate = cc.audio_bit_rate;
     if (cc.has_degradation_preference()) {
-      switch (cc.degradation_preference) {
-        case sora_conf::internal::DegradationPreference::DISABLED:
-          config.degradation_preference =
-              webrtc::DegradationPreference::DISABLED;
-          break;
-        case sora_conf::internal::DegradationPreference::MAINTAIN_FRAMERATE:
-          config.degradation_preference =
-              webrtc::DegradationPreference::MAINTAIN_FRAMERATE;
-          break;
-        case sora_conf::internal::DegradationPreference::MAINTAIN_RESOLUTION:
-          config.degradation_preference =
-              webrtc::DegradationPreference::MAINTAIN_RESOLUTION;
-          break;
-        case sora_conf::internal::DegradationPreference::BALANCED:
-          config.degradation_preference =
-              webrtc::DegradationPreference::BALANCED;
-          break;
-      }
+      config.degradation_preference =
+          ToDegradationPreference(cc.degradation_preference);
     }
     if (cc.has_data_channel_signaling()) {
       config.data_channel_signaling = cc.data_channel_signaling;
@@ -551,6 +821,7 @@ void Sora::DoConnect(const sora_conf::internal::ConnectConfig& cc,
         "Mozilla/5.0 (Sora Unity SDK/" SORA_UNITY_SDK_VERSION ")");
 
     signaling_ = sora::SoraSignaling::Create(std::move(config));
+    timeline_->Record(SORA_TIMELINE_SIGNALING_START);
     signaling_->Connect();
   }
 
@@ -584,6 +855,20 @@ void Sora::Disconnect() {
 
 void Sora::SwitchCamera(const sora_conf::internal::CameraConfig& cc) {
   if (!set_offer_) {
+    PushEvent([this]() {
+      if (on_switch_camera_) {
+        on_switch_camera_(false, "Not connected");
+      }
+    });
+    return;
+  }
+  if (pending_capturer_ != nullptr) {
+    RTC_LOG(LS_WARNING) << "SwitchCamera: already switching";
+    PushEvent([this]() {
+      if (on_switch_camera_) {
+        on_switch_camera_(false, "Already switching");
+      }
+    });
     return;
   }
 
@@ -604,55 +889,95 @@ void Sora::SwitchCamera(const sora_conf::internal::CameraConfig& cc) {
   void* env = sora::GetJNIEnv();
   void* android_context = GetAndroidApplicationContext(env);
 
-#if defined(SORA_UNITY_SDK_ANDROID)
-  if (capturer_ != nullptr && capturer_type_ == 0) {
-    static_cast<sora::AndroidCapturer*>(capturer_.get())->Stop();
-  }
-#endif
-#if defined(SORA_UNITY_SDK_IOS) || defined(SORA_UNITY_SDK_MACOS)
-  if (capturer_ != nullptr && capturer_type_ == 0) {
-    static_cast<sora::MacCapturer*>(capturer_.get())->Stop();
-  }
-#endif
-  if (capturer_ != nullptr && capturer_type_ != 0) {
-    static_cast<UnityCameraCapturer*>(capturer_.get())->Stop();
+  // 古いキャプチャラは新しいキャプチャラからフレームが届くまで止めない。
+  auto create_capturer = [&]() {
+    return CreateVideoCapturer(
+        cc.capturer_type, (void*)cc.unity_camera_texture, false,
+        cc.video_capturer_device, cc.video_width, cc.video_height,
+        cc.video_fps, cc.capture_on_mark_dirty, cc.keepalive_interval_ms,
+        on_frame, sora_context_->signaling_thread(), env, android_context,
+        unity_context_);
+  };
+  switch_camera_stopped_old_ = false;
+  auto capturer = create_capturer();
+  if (!capturer && cc.capturer_type == 0 && capturer_ != nullptr &&
+      capturer_type_ == 0) {
+    // Android の Camera2 や iOS の AVCaptureSession、多くの UVC ドライバは
+    // 2 つのカメラを同時に開けないので、古いカメラを止めてからもう一度作る
+    RTC_LOG(LS_WARNING) << "SwitchCamera: Failed to CreateVideoCapturer while "
+                           "the old camera is running, retry after stopping it";
+    StopCapturer(capturer_, capturer_type_);
+    switch_camera_stopped_old_ = true;
+    capturer = create_capturer();
   }
-  capturer_ = nullptr;
-
-  auto capturer = CreateVideoCapturer(
-      cc.capturer_type, (void*)cc.unity_camera_texture, false,
-      cc.video_capturer_device, cc.video_width, cc.video_height, cc.video_fps,
-      on_frame, sora_context_->signaling_thread(), env, android_context,
-      unity_context_);
   if (!capturer) {
     RTC_LOG(LS_ERROR) << "Failed to CreateVideoCapturer";
+    PushEvent([this]() {
+      if (on_switch_camera_) {
+        on_switch_camera_(false, "Failed to CreateVideoCapturer");
+      }
+    });
     return;
   }
 
-  capturer_ = capturer;
-  capturer_type_ = cc.capturer_type;
-
   std::string video_track_id = webrtc::CreateRandomString(16);
   auto video_track = sora_context_->peer_connection_factory()->CreateVideoTrack(
       capturer, video_track_id);
 
-  // video_track_ をこのスレッド(Unity スレッド)で設定したいので、
-  // IO スレッドの実行完了を待つ
-  std::promise<void> p;
-  std::future<void> f = p.get_future();
-  boost::asio::post(*ioc_,
-                    [self = shared_from_this(), cc = cc, video_track, &p]() {
-                      self->DoSwitchCamera(cc, video_track);
-                      p.set_value();
-                    });
-  f.wait();
+  int switch_id = ++switch_camera_id_;
+  {
+    std::lock_guard<std::mutex> guard(video_sources_mutex_);
+    pending_capturer_ = capturer;
+    pending_capturer_type_ = cc.capturer_type;
+  }
+  pending_video_track_ = video_track;
+
+  // 最初のフレームより先に IO スレッド側で切り替え待ちの状態にしておく
+  boost::asio::post(*ioc_, [this, switch_id]() {
+    switching_camera_id_ = switch_id;
+    switch_camera_timer_.reset(new boost::asio::steady_timer(*ioc_));
+    switch_camera_timer_->expires_after(
+        std::chrono::milliseconds(kSwitchCameraTimeoutMs));
+    switch_camera_timer_->async_wait(
+        [this, switch_id](const boost::system::error_code& ec) {
+          if (ec || switching_camera_id_ != switch_id) {
+            return;
+          }
+          RTC_LOG(LS_WARNING) << "SwitchCamera: timeout";
+          switching_camera_id_ = 0;
+          PushEvent([this, switch_id]() {
+            FinishSwitchCamera(switch_id, false,
+                               "Timeout waiting for the first frame");
+          });
+        });
+  });
 
-  video_track_ = video_track;
+  // 最初のフレームはキャプチャラのスレッドから呼ばれるので、IO スレッドで差し替える。
+  // デストラクタでシンクを外してから IO スレッドを止めるので this を使って問題ない
+  auto old_video_track = video_track_;
+  switch_camera_sink_.reset(
+      new FirstFrameSink([this, switch_id, old_video_track, video_track]() {
+        boost::asio::post(*ioc_, [this, switch_id, old_video_track,
+                                  video_track]() {
+          DoSwitchCamera(switch_id, old_video_track, video_track);
+        });
+      }));
+  video_track->AddOrUpdateSink(switch_camera_sink_.get(),
+                               webrtc::VideoSinkWants());
 }
+
 void Sora::DoSwitchCamera(
-    const sora_conf::internal::CameraConfig& cc,
+    int switch_id,
+    webrtc::scoped_refptr<webrtc::VideoTrackInterface> old_video_track,
     webrtc::scoped_refptr<webrtc::VideoTrackInterface> video_track) {
-  if (video_track_ == nullptr) {
+  // タイムアウトした後に最初のフレームが届いた場合は何もしない
+  if (switching_camera_id_ != switch_id) {
+    return;
+  }
+  switching_camera_id_ = 0;
+  switch_camera_timer_.reset();
+
+  if (old_video_track == nullptr) {
     webrtc::RTCErrorOr<webrtc::scoped_refptr<webrtc::RtpSenderInterface>>
         video_result = signaling_->GetPeerConnection()->AddTrack(video_track,
                                                                  {stream_id_});
@@ -665,9 +990,382 @@ void Sora::DoSwitchCamera(
       }
     });
   } else {
-    renderer_->ReplaceTrack(video_track_.get(), video_track.get());
+    renderer_->ReplaceTrack(old_video_track.get(), video_track.get());
+  }
+  // 他の映像ソースを送信中の場合は、戻す時のトラックだけ差し替える
+  if (sending_video_source_id_ != 0) {
+    primary_video_track_ = video_track;
+  } else {
+    video_sender_->SetTrack(video_track.get());
+  }
+
+  PushEvent([this, switch_id]() { FinishSwitchCamera(switch_id, true, ""); });
+}
+
+void Sora::FinishSwitchCamera(int switch_id,
+                              bool success,
+                              std::string message) {
+  if (switch_id != switch_camera_id_ || pending_capturer_ == nullptr) {
+    return;
+  }
+
+  pending_video_track_->RemoveSink(switch_camera_sink_.get());
+  switch_camera_sink_.reset();
+
+  if (success) {
+    // 新しいトラックに差し替わったので、ここで古いキャプチャラを止める
+    if (!switch_camera_stopped_old_) {
+      StopCapturer(capturer_, capturer_type_);
+    }
+    video_track_ = pending_video_track_;
+    // どちらの方法で切り替えたかを通知する
+    message = switch_camera_stopped_old_ ? "break-before-make"
+                                         : "make-before-break";
+  } else {
+    StopCapturer(pending_capturer_, pending_capturer_type_);
+  }
+  {
+    std::lock_guard<std::mutex> guard(video_sources_mutex_);
+    if (success) {
+      capturer_ = pending_capturer_;
+      capturer_type_ = pending_capturer_type_;
+    }
+    pending_capturer_ = nullptr;
+  }
+  pending_video_track_ = nullptr;
+
+  RTC_LOG(LS_INFO) << "SwitchCamera finished: success=" << success
+                   << " message=" << message;
+  if (on_switch_camera_) {
+    on_switch_camera_(success, std::move(message));
+  }
+}
+
+int Sora::AddVideoSource(const sora_conf::internal::VideoSourceConfig& config) {
+  if (!set_offer_) {
+    RTC_LOG(LS_WARNING) << "AddVideoSource: not connected";
+    return 0;
+  }
+
+  RTC_LOG(LS_INFO) << "AddVideoSource: " << jsonif::to_json(config);
+
+  // キャプチャラは SwitchCamera と同じく Unity スレッドで作成する
+  const auto& cc = config.camera_config;
+  void* env = sora::GetJNIEnv();
+  void* android_context = GetAndroidApplicationContext(env);
+  auto capturer = CreateVideoCapturer(
+      cc.capturer_type, (void*)cc.unity_camera_texture, false,
+      cc.video_capturer_device, cc.video_width, cc.video_height, cc.video_fps,
+      cc.capture_on_mark_dirty, cc.keepalive_interval_ms, nullptr,
+      sora_context_->signaling_thread(), env, android_context, unity_context_);
+  if (!capturer) {
+    RTC_LOG(LS_ERROR) << "Failed to CreateVideoCapturer";
+    return 0;
+  }
+
+  std::string video_track_id = webrtc::CreateRandomString(16);
+  auto video_track = sora_context_->peer_connection_factory()->CreateVideoTrack(
+      capturer, video_track_id);
+
+  int source_id = next_video_source_id_++;
+  {
+    std::lock_guard<std::mutex> guard(video_sources_mutex_);
+    VideoSource& source = video_sources_[source_id];
+    source.capturer = capturer;
+    source.capturer_type = cc.capturer_type;
+    source.video_track = video_track;
+    source.config = config;
+  }
+
+  // renderer_ は IO スレッドで触る
+  boost::asio::post(*ioc_, [this, source_id, video_track]() {
+    if (renderer_ == nullptr) {
+      return;
+    }
+    auto video_sink_id = renderer_->AddTrack(video_track.get());
+    PushEvent([this, source_id, video_sink_id]() {
+      if (on_add_video_source_) {
+        on_add_video_source_(source_id, video_sink_id);
+      }
+    });
+  });
+  return source_id;
+}
+
+bool Sora::RemoveVideoSource(int source_id) {
+  VideoSource source;
+  {
+    std::lock_guard<std::mutex> guard(video_sources_mutex_);
+    auto it = video_sources_.find(source_id);
+    if (it == video_sources_.end()) {
+      return false;
+    }
+    source = std::move(it->second);
+    video_sources_.erase(it);
+  }
+
+  RTC_LOG(LS_INFO) << "RemoveVideoSource: source_id=" << source_id;
+
+  // 切断した後は IO スレッドが止まっていて post しても実行されないので、
+  // ここで片付ける。IO スレッドが止まった後は renderer_ は Unity スレッドだけが触る
+  if (ioc_->stopped()) {
+    if (renderer_ != nullptr) {
+      renderer_->RemoveTrack(source.video_track.get());
+    }
+    StopCapturer(source.capturer, source.capturer_type);
+    return true;
+  }
+
+  // 送信中なら接続時の映像に戻してから、キャプチャラを Unity スレッドで止める
+  boost::asio::post(*ioc_, [this, source_id, source]() {
+    if (sending_video_source_id_ == source_id) {
+      DoSetSendingVideoSource(0, nullptr, {});
+    }
+    if (renderer_ != nullptr) {
+      renderer_->RemoveTrack(source.video_track.get());
+    }
+    PushEvent(
+        [source]() { StopCapturer(source.capturer, source.capturer_type); });
+  });
+  return true;
+}
+
+bool Sora::MarkVideoSourceDirty(int source_id) {
+  std::vector<webrtc::scoped_refptr<webrtc::VideoTrackSourceInterface>>
+      capturers;
+  {
+    std::lock_guard<std::mutex> guard(video_sources_mutex_);
+    if (source_id == 0) {
+      if (capturer_ == nullptr || capturer_type_ == 0) {
+        return false;
+      }
+      capturers.push_back(capturer_);
+      if (pending_capturer_ != nullptr && pending_capturer_type_ != 0) {
+        capturers.push_back(pending_capturer_);
+      }
+    } else {
+      auto it = video_sources_.find(source_id);
+      if (it == video_sources_.end() || it->second.capturer_type == 0) {
+        return false;
+      }
+      capturers.push_back(it->second.capturer);
+    }
+  }
+  // 参照を持っているので、途中でキャプチャラが差し替えられても破棄されない
+  for (const auto& capturer : capturers) {
+    static_cast<UnityCameraCapturer*>(capturer.get())->MarkDirty();
+  }
+  return true;
+}
+
+bool Sora::SetSendingVideoSource(int source_id) {
+  if (!set_offer_) {
+    return false;
+  }
+  webrtc::scoped_refptr<webrtc::VideoTrackInterface> video_track;
+  sora_conf::internal::VideoSourceConfig config;
+  if (source_id != 0) {
+    std::lock_guard<std::mutex> guard(video_sources_mutex_);
+    auto it = video_sources_.find(source_id);
+    if (it == video_sources_.end()) {
+      return false;
+    }
+    video_track = it->second.video_track;
+    config = it->second.config;
+  }
+  boost::asio::post(*ioc_, [this, source_id, video_track, config]() {
+    DoSetSendingVideoSource(source_id, video_track, config);
+  });
+  return true;
+}
+
+void Sora::DoSetSendingVideoSource(
+    int source_id,
+    webrtc::scoped_refptr<webrtc::VideoTrackInterface> video_track,
+    sora_conf::internal::VideoSourceConfig config) {
+  if (video_sender_ == nullptr) {
+    RTC_LOG(LS_WARNING) << "SetSendingVideoSource: video sender not found";
+    return;
+  }
+  if (source_id == sending_video_source_id_) {
+    return;
+  }
+
+  if (sending_video_source_id_ == 0) {
+    primary_video_track_ = webrtc::scoped_refptr<webrtc::VideoTrackInterface>(
+        static_cast<webrtc::VideoTrackInterface*>(
+            video_sender_->track().get()));
+    primary_encodings_ = video_sender_->GetParameters().encodings;
+  }
+
+  // SetParameters には直前の GetParameters の結果が必要なので、取り直してから変更する
+  webrtc::RtpParameters parameters = video_sender_->GetParameters();
+  // 前のソースへの切り替えで設定した値のままの項目だけを接続時の値に戻す。
+  // 送信中に SetVideoEncodingParameters で変更された項目はそのまま残す
+  for (size_t i = 0;
+       i < parameters.encodings.size() && i < primary_encodings_.size() &&
+       i < applied_encodings_.size();
+       i++) {
+    auto& e = parameters.encodings[i];
+    const auto& p = primary_encodings_[i];
+    const auto& a = applied_encodings_[i];
+    if (e.max_bitrate_bps == a.max_bitrate_bps) {
+      e.max_bitrate_bps = p.max_bitrate_bps;
+    }
+    if (e.max_framerate == a.max_framerate) {
+      e.max_framerate = p.max_framerate;
+    }
+    if (e.scale_resolution_down_by == a.scale_resolution_down_by) {
+      e.scale_resolution_down_by = p.scale_resolution_down_by;
+    }
+  }
+  if (source_id == 0) {
+    video_sender_->SetTrack(primary_video_track_.get());
+    primary_video_track_ = nullptr;
+    primary_encodings_.clear();
+    applied_encodings_.clear();
+  } else {
+    video_sender_->SetTrack(video_track.get());
+    for (auto& e : parameters.encodings) {
+      if (config.max_bitrate_bps > 0) {
+        e.max_bitrate_bps = config.max_bitrate_bps;
+      }
+      if (config.max_framerate > 0) {
+        e.max_framerate = config.max_framerate;
+      }
+      if (config.scale_resolution_down_by > 0) {
+        e.scale_resolution_down_by = config.scale_resolution_down_by;
+      }
+    }
+    applied_encodings_ = parameters.encodings;
+  }
+  auto error = video_sender_->SetParameters(parameters);
+  if (!error.ok()) {
+    RTC_LOG(LS_WARNING) << "Failed to SetParameters: " << error.message();
+  }
+  sending_video_source_id_ = source_id;
+  RTC_LOG(LS_INFO) << "SetSendingVideoSource: source_id=" << source_id;
+}
+
+bool Sora::SetVideoEncodingParameters(
+    const sora_conf::internal::VideoEncodingParameters& params) {
+  if (!set_offer_) {
+    return false;
+  }
+  RTC_LOG(LS_INFO) << "SetVideoEncodingParameters: " << jsonif::to_json(params);
+  boost::asio::post(*ioc_,
+                    [this, params]() { DoSetVideoEncodingParameters(params); });
+  return true;
+}
+
+void Sora::DoSetVideoEncodingParameters(
+    const sora_conf::internal::VideoEncodingParameters& params) {
+  if (video_sender_ == nullptr) {
+    RTC_LOG(LS_WARNING) << "SetVideoEncodingParameters: video sender not found";
+    return;
+  }
+
+  webrtc::RtpParameters parameters = video_sender_->GetParameters();
+  for (size_t i = 0; i < params.encodings.size(); i++) {
+    const auto& pe = params.encodings[i];
+    webrtc::RtpEncodingParameters* e = nullptr;
+    if (!pe.rid.empty()) {
+      auto it = std::find_if(
+          parameters.encodings.begin(), parameters.encodings.end(),
+          [&pe](const webrtc::RtpEncodingParameters& x) {
+            return x.rid == pe.rid;
+          });
+      if (it != parameters.encodings.end()) {
+        e = &*it;
+      }
+    } else if (i < parameters.encodings.size()) {
+      e = &parameters.encodings[i];
+    }
+    if (e == nullptr) {
+      RTC_LOG(LS_WARNING) << "SetVideoEncodingParameters: encoding not found: "
+                          << "index=" << i << " rid=" << pe.rid;
+      continue;
+    }
+
+    if (pe.has_active()) {
+      e->active = pe.active;
+    }
+    if (pe.has_max_bitrate_bps()) {
+      e->max_bitrate_bps = pe.max_bitrate_bps > 0
+                               ? std::optional<int>(pe.max_bitrate_bps)
+                               : std::nullopt;
+    }
+    if (pe.has_max_framerate()) {
+      e->max_framerate = pe.max_framerate > 0
+                             ? std::optional<double>(pe.max_framerate)
+                             : std::nullopt;
+    }
+    if (pe.has_scale_resolution_down_by()) {
+      e->scale_resolution_down_by =
+          pe.scale_resolution_down_by > 0
+              ? std::optional<double>(pe.scale_resolution_down_by)
+              : std::nullopt;
+    }
+  }
+  if (params.has_degradation_preference()) {
+    parameters.degradation_preference =
+        ToDegradationPreference(params.degradation_preference);
+  }
+
+  auto error = video_sender_->SetParameters(parameters);
+  if (!error.ok()) {
+    RTC_LOG(LS_WARNING) << "Failed to SetParameters: " << error.message();
+  }
+}
+
+sora_conf::internal::VideoEncodingParameters
+Sora::GetVideoEncodingParameters() {
+  sora_conf::internal::VideoEncodingParameters params;
+  if (!set_offer_ || video_sender_ == nullptr) {
+    return params;
+  }
+  webrtc::RtpParameters parameters = video_sender_->GetParameters();
+  for (const auto& e : parameters.encodings) {
+    sora_conf::internal::VideoEncodingParameters::Encoding pe;
+    pe.rid = e.rid;
+    pe.set_active(e.active);
+    if (e.max_bitrate_bps) {
+      pe.set_max_bitrate_bps(*e.max_bitrate_bps);
+    }
+    if (e.max_framerate) {
+      pe.set_max_framerate(*e.max_framerate);
+    }
+    if (e.scale_resolution_down_by) {
+      pe.set_scale_resolution_down_by(*e.scale_resolution_down_by);
+    }
+    params.encodings.push_back(pe);
+  }
+  if (parameters.degradation_preference) {
+    params.set_degradation_preference(
+        FromDegradationPreference(*parameters.degradation_preference));
+  }
+  return params;
+}
+
+void Sora::StopCapturer(
+    webrtc::scoped_refptr<webrtc::VideoTrackSourceInterface> capturer,
+    int capturer_type) {
+  if (capturer == nullptr) {
+    return;
+  }
+#if defined(SORA_UNITY_SDK_ANDROID)
+  if (capturer_type == 0) {
+    static_cast<sora::AndroidCapturer*>(capturer.get())->Stop();
+  }
+#endif
+#if defined(SORA_UNITY_SDK_IOS) || defined(SORA_UNITY_SDK_MACOS)
+  if (capturer_type == 0) {
+    static_cast<sora::MacCapturer*>(capturer.get())->Stop();
+  }
+#endif
+  if (capturer_type != 0) {
+    static_cast<UnityCameraCapturer*>(capturer.get())->Stop();
   }
-  video_sender_->SetTrack(video_track.get());
 }
 
 void Sora::RenderCallbackStatic(int event_id) {
@@ -683,9 +1381,30 @@ int Sora::GetRenderCallbackEventID() const {
 }
 
 void Sora::RenderCallback() {
-  if (capturer_ != nullptr && capturer_type_ != 0) {
-    static_cast<UnityCameraCapturer*>(capturer_.get())->OnRender();
+  // メインスレッドでキャプチャラが差し替えられるので、ロックを取って参照を持ってから描画する。
+  // Stop() 済みのキャプチャラの OnRender() は何もしない
+  std::vector<webrtc::scoped_refptr<webrtc::VideoTrackSourceInterface>>
+      capturers;
+  {
+    std::lock_guard<std::mutex> guard(video_sources_mutex_);
+    if (capturer_ != nullptr && capturer_type_ != 0) {
+      capturers.push_back(capturer_);
+    }
+    // 切り替え中の Unity カメラも描画しないと最初のフレームが届かない
+    if (pending_capturer_ != nullptr && pending_capturer_type_ != 0) {
+      capturers.push_back(pending_capturer_);
+    }
+    for (const auto& kv : video_sources_) {
+      if (kv.second.capturer_type != 0) {
+        capturers.push_back(kv.second.capturer);
+      }
+    }
   }
+  for (const auto& capturer : capturers) {
+    static_cast<UnityCameraCapturer*>(capturer.get())->OnRender();
+  }
+  // 切り替えや終了で破棄したキャプチャラのバッファは、GPU の処理を待ってから解放する
+  UnityCameraCapturer::ReleaseRetiredResources(unity_context_);
 }
 
 webrtc::VideoTrackInterface* Sora::GetVideoTrackFromVideoSinkId(
@@ -770,6 +1489,11 @@ bool Sora::SetADMVolume(webrtc::scoped_refptr<webrtc::AudioDeviceModule> adm,
   return true;
 }
 bool Sora::SetSpeakerVolume(double volume) {
+  if (shared_adm_) {
+    RTC_LOG(LS_WARNING) << "SetSpeakerVolume is not available when using the "
+                           "shared context";
+    return false;
+  }
   return sora_context_->worker_thread()->BlockingCall([this, volume] {
     if (!unity_adm_) {
       return false;
@@ -778,6 +1502,11 @@ bool Sora::SetSpeakerVolume(double volume) {
   });
 }
 bool Sora::SetMicrophoneVolume(double volume) {
+  if (shared_adm_) {
+    RTC_LOG(LS_WARNING) << "SetMicrophoneVolume is not available when using "
+                           "the shared context";
+    return false;
+  }
   return sora_context_->worker_thread()->BlockingCall([this, volume] {
     if (!unity_adm_) {
       return false;
@@ -785,6 +1514,16 @@ bool Sora::SetMicrophoneVolume(double volume) {
     return SetADMVolume(unity_adm_, false, volume);
   });
 }
+bool Sora::SetSharedContextVolume(
+    std::shared_ptr<SoraSharedContext> shared_context,
+    bool is_speaker,
+    double volume) {
+  if (shared_context == nullptr || shared_context->adm == nullptr) {
+    return false;
+  }
+  return shared_context->client_context->worker_thread()->BlockingCall(
+      [&] { return SetADMVolume(shared_context->adm, is_speaker, volume); });
+}
 
 webrtc::scoped_refptr<UnityAudioDevice> Sora::CreateADM(
     webrtc::Environment env,
@@ -821,6 +1560,120 @@ webrtc::scoped_refptr<UnityAudioDevice> Sora::CreateADM(
   });
 }
 
+std::shared_ptr<SoraSharedContext> Sora::CreateSharedContext(
+    const sora_conf::internal::SharedContextConfig& config) {
+  RTC_LOG(LS_INFO) << "Sora::CreateSharedContext " << jsonif::to_json(config);
+
+  auto shared_context = std::make_shared<SoraSharedContext>();
+
+  sora::SoraClientContextConfig client_config;
+  client_config.use_audio_device = false;
+  client_config.video_codec_factory_config.capability_config =
+      ConvertToVideoCodecCapabilityConfigWithSession(
+          config.video_codec_capability_config);
+  if (config.has_video_codec_preference()) {
+    client_config.video_codec_factory_config.preference =
+        ConvertToVideoCodecPreference(config.video_codec_preference);
+  }
+  if (!config.audio_playout_device.empty()) {
+    client_config.audio_playout_device = config.audio_playout_device;
+  }
+  if (!config.audio_recording_device.empty()) {
+    client_config.audio_recording_device = config.audio_recording_device;
+  }
+  client_config.configure_dependencies =
+      [&](webrtc::PeerConnectionFactoryDependencies& dependencies) {
+        auto webrtc_env = webrtc::CreateEnvironment();
+        // worker 上の env
+        auto worker_env = dependencies.worker_thread->BlockingCall(
+            [] { return sora::GetJNIEnv(); });
+    // worker 上の context
+#if defined(SORA_UNITY_SDK_ANDROID)
+        void* worker_context =
+            dependencies.worker_thread->BlockingCall([worker_env] {
+              return ::sora_unity_sdk::GetAndroidApplicationContext(
+                         (JNIEnv*)worker_env)
+                  .Release();
+            });
+#else
+        void* worker_context = nullptr;
+#endif
+
+        // 特定の Sora インスタンスに紐付かないので、
+        // Unity のオーディオ入出力やフックは使わない
+        shared_context->adm =
+            CreateADM(webrtc_env, config.no_audio_device, false, false,
+                      nullptr, nullptr, config.audio_recording_device,
+                      config.audio_playout_device, dependencies.worker_thread,
+                      worker_env, worker_context);
+        dependencies.worker_thread->BlockingCall(
+            [&] { dependencies.adm = shared_context->adm; });
+
+        // DecodeGate で読み飛ばすことにしたフレームをデコーダに渡さない
+        if (dependencies.video_decoder_factory != nullptr) {
+          dependencies.video_decoder_factory =
+              std::make_unique<DecodeGateVideoDecoderFactory>(
+                  std::move(dependencies.video_decoder_factory));
+        }
+
+        if (config.has_load_generator()) {
+          // 全ての接続で 1 つのエンコード結果を共有する
+          if (dependencies.video_encoder_factory != nullptr) {
+            dependencies.video_encoder_factory =
+                std::make_unique<SharedVideoEncoderFactory>(
+                    std::move(dependencies.video_encoder_factory));
+          } else {
+            RTC_LOG(LS_WARNING) << "video_encoder_factory is not set";
+          }
+          if (dependencies.audio_encoder_factory != nullptr) {
+            dependencies.audio_encoder_factory =
+                webrtc::make_ref_counted<SharedAudioEncoderFactory>(
+                    dependencies.audio_encoder_factory);
+          } else {
+            RTC_LOG(LS_WARNING) << "audio_encoder_factory is not set";
+          }
+        }
+
+#if defined(SORA_UNITY_SDK_ANDROID)
+        dependencies.worker_thread->BlockingCall([worker_env, worker_context] {
+          ((JNIEnv*)worker_env)->DeleteLocalRef((jobject)worker_context);
+        });
+#endif
+      };
+
+  shared_context->client_context =
+      sora::SoraClientContext::Create(client_config);
+  if (shared_context->client_context == nullptr) {
+    RTC_LOG(LS_ERROR) << "Failed to create PeerConnectionFactory";
+    return nullptr;
+  }
+  if (!InitADM(shared_context->adm,
+               config.has_audio_speaker_volume()
+                   ? std::make_optional(config.audio_speaker_volume)
+                   : std::nullopt,
+               config.has_audio_microphone_volume()
+                   ? std::make_optional(config.audio_microphone_volume)
+                   : std::nullopt)) {
+    RTC_LOG(LS_ERROR) << "Failed to InitADM";
+    return nullptr;
+  }
+
+  if (config.has_load_generator()) {
+    const auto& lg = config.load_generator;
+    SyntheticVideoSourceConfig source_config;
+    source_config.width = lg.video_width;
+    source_config.height = lg.video_height;
+    source_config.fps = lg.video_fps;
+    source_config.y4m_file = lg.y4m_file;
+    shared_context->video_source = SyntheticVideoSource::Create(source_config);
+    if (shared_context->video_source == nullptr) {
+      RTC_LOG(LS_ERROR) << "Failed to create SyntheticVideoSource";
+      return nullptr;
+    }
+  }
+  return shared_context;
+}
+
 bool Sora::InitADM(webrtc::scoped_refptr<webrtc::AudioDeviceModule> adm,
                    std::optional<double> speaker_volume,
                    std::optional<double> microphone_volume) {
@@ -844,6 +1697,8 @@ Sora::CreateVideoCapturer(
     int video_width,
     int video_height,
     int video_fps,
+    bool capture_on_mark_dirty,
+    int keepalive_interval_ms,
     std::function<void(const webrtc::VideoFrame& frame)> on_frame,
     webrtc::Thread* signaling_thread,
     void* jni_env,
@@ -873,6 +1728,10 @@ Sora::CreateVideoCapturer(
     config.unity_camera_texture = unity_camera_texture;
     config.width = video_width;
     config.height = video_height;
+    config.capture_on_mark_dirty = capture_on_mark_dirty;
+    if (keepalive_interval_ms > 0) {
+      config.keepalive_interval_ms = keepalive_interval_ms;
+    }
     return UnityCameraCapturer::Create(config);
   }
 }
@@ -904,6 +1763,125 @@ void Sora::GetStats(std::function<void(std::string)> on_get_stats) {
   });
 }
 
+void Sora::GetFilteredStats(
+    const sora_conf::internal::StatsFilter& filter,
+    std::function<void(const FilteredStats&)> on_get_stats) {
+  boost::asio::post(*ioc_, [self = shared_from_this(), filter,
+                            on_get_stats = std::move(on_get_stats)]() {
+    auto pc = self->signaling_ == nullptr
+                  ? nullptr
+                  : self->signaling_->GetPeerConnection();
+    if (self->signaling_ == nullptr || pc == nullptr) {
+      self->PushEvent([on_get_stats = std::move(on_get_stats)]() {
+        on_get_stats(FilteredStats());
+      });
+      return;
+    }
+
+    pc->GetStats(
+        sora::RTCStatsCallback::Create(
+            [self, filter, on_get_stats = std::move(on_get_stats)](
+                const webrtc::scoped_refptr<const webrtc::RTCStatsReport>&
+                    report) {
+              // ToJson() を使わずに、必要な値だけをこのスレッドで抜き出しておく
+              auto stats = FilterStats(*report, filter);
+              self->PushEvent([on_get_stats = std::move(on_get_stats),
+                               stats = std::move(stats)]() {
+                on_get_stats(stats);
+              });
+            })
+            .get());
+  });
+}
+
+void Sora::StartStatsSampler(int interval_ms) {
+  if (ioc_ == nullptr || interval_ms <= 0) {
+    return;
+  }
+  boost::asio::post(*ioc_, [self = shared_from_this(), interval_ms]() {
+    bool running = self->stats_sampler_interval_ms_ != 0;
+    self->stats_sampler_interval_ms_ = interval_ms;
+    if (self->stats_timer_ == nullptr) {
+      self->stats_timer_.reset(new boost::asio::steady_timer(*self->ioc_));
+    }
+    // 既に動いている場合は次のタイマーから新しい間隔になる
+    if (!running) {
+      self->DoSampleStats();
+    }
+  });
+}
+
+void Sora::StopStatsSampler() {
+  if (ioc_ == nullptr) {
+    return;
+  }
+  boost::asio::post(*ioc_, [self = shared_from_this()]() {
+    self->stats_sampler_interval_ms_ = 0;
+    if (self->stats_timer_ != nullptr) {
+      self->stats_timer_->cancel();
+    }
+  });
+}
+
+int Sora::ReadStatsSamples(sora_stats_sample_t* buf, int size) {
+  return stats_sampler_.Read(buf, size);
+}
+
+void Sora::DoSampleStats() {
+  stats_timer_->expires_after(
+      std::chrono::milliseconds(stats_sampler_interval_ms_));
+  // 繰り返し設定するタイマーが self を持ち続けると Sora が破棄されなくなるので、
+  // 弱参照で持っておいて、破棄された後は何もしない
+  stats_timer_->async_wait([weak = weak_from_this()](
+                               const boost::system::error_code& ec) {
+    auto self = weak.lock();
+    if (ec || self == nullptr || self->stats_sampler_interval_ms_ == 0) {
+      return;
+    }
+    auto pc = self->signaling_ == nullptr
+                  ? nullptr
+                  : self->signaling_->GetPeerConnection();
+    if (pc != nullptr) {
+      // 前回の統計情報との差分は StatsSampler 側で計算する
+      pc->GetStats(sora::RTCStatsCallback::Create(
+                       [self](const webrtc::scoped_refptr<
+                              const webrtc::RTCStatsReport>& report) {
+                         self->stats_sampler_.Update(*report);
+                       })
+                       .get());
+    }
+    self->DoSampleStats();
+  });
+}
+
+void Sora::DoWatchConnectionState() {
+  connection_state_timer_->expires_after(std::chrono::milliseconds(10));
+  connection_state_timer_->async_wait(
+      [this](const boost::system::error_code& ec) {
+        if (ec) {
+          return;
+        }
+        auto pc =
+            signaling_ == nullptr ? nullptr : signaling_->GetPeerConnection();
+        if (pc == nullptr) {
+          return;
+        }
+        auto state = pc->peer_connection_state();
+        if (state == webrtc::PeerConnectionInterface::PeerConnectionState::
+                         kConnected) {
+          timeline_->Record(SORA_TIMELINE_PEER_CONNECTED);
+          return;
+        }
+        if (state == webrtc::PeerConnectionInterface::PeerConnectionState::
+                         kFailed ||
+            state == webrtc::PeerConnectionInterface::PeerConnectionState::
+                         kClosed) {
+          return;
+        }
+        DoWatchConnectionState();
+      });
+}
+
 void Sora::SendMessage(const std::string& label, const std::string& data) {
   if (signaling_ == nullptr) {
     return;
@@ -919,6 +1897,25 @@ void* Sora::GetAndroidApplicationContext(void* env) {
 #endif
 }
 
+Sora::FirstFrameSink::FirstFrameSink(std::function<void()> on_first_frame)
+    : on_first_frame_(std::move(on_first_frame)) {}
+void Sora::FirstFrameSink::OnFrame(const webrtc::VideoFrame& frame) {
+  if (received_.exchange(true)) {
+    return;
+  }
+  on_first_frame_();
+}
+
+Sora::FirstPacketObserver::FirstPacketObserver(
+    std::shared_ptr<ConnectTimeline> timeline)
+    : timeline_(timeline) {}
+void Sora::FirstPacketObserver::OnFirstPacketReceived(
+    webrtc::MediaType media_type) {
+  timeline_->Record(media_type == webrtc::MediaType::VIDEO
+                        ? SORA_TIMELINE_FIRST_VIDEO_RTP
+                        : SORA_TIMELINE_FIRST_AUDIO_RTP);
+}
+
 sora_conf::ErrorCode Sora::ToErrorCode(sora::SoraSignalingErrorCode ec) {
   switch (ec) {
     case sora::SoraSignalingErrorCode::CLOSE_SUCCEEDED:
@@ -945,6 +1942,15 @@ sora_conf::ErrorCode Sora::ToErrorCode(sora::SoraSignalingErrorCode ec) {
 }
 
 void Sora::OnSetOffer(std::string offer) {
+  timeline_->Record(SORA_TIMELINE_OFFER_RECEIVED);
+  // 接続状態の変化を受け取る手段が無いので、接続するまで IO スレッドで状態を見に行く
+  boost::asio::post(*ioc_, [self = shared_from_this()]() {
+    if (self->connection_state_timer_ == nullptr) {
+      self->connection_state_timer_.reset(
+          new boost::asio::steady_timer(*self->ioc_));
+      self->DoWatchConnectionState();
+    }
+  });
   PushEvent([this, offer]() {
     if (on_set_offer_) {
       on_set_offer_(offer);
@@ -976,9 +1982,13 @@ void Sora::OnSetOffer(std::string offer) {
 }
 void Sora::OnDisconnect(sora::SoraSignalingErrorCode ec, std::string message) {
   RTC_LOG(LS_INFO) << "OnDisconnect: " << message;
-  renderer_.reset();
   ioc_->stop();
+  // DispatchEvents が Unity スレッドで renderer_ と receive_quality_controller_ を
+  // 使っているので、片付けも Unity スレッドで行う
   PushEvent([this, ec, message = std::move(message)]() {
+    set_offer_ = false;
+    receive_quality_controller_.reset();
+    renderer_.reset();
     if (on_disconnect_) {
       on_disconnect_((int)ToErrorCode(ec), std::move(message));
     }
@@ -1014,15 +2024,36 @@ void Sora::OnRpc(std::string data) {
 }
 void Sora::OnTrack(
     webrtc::scoped_refptr<webrtc::RtpTransceiverInterface> transceiver) {
-  PushEvent([this, transceiver]() {
+  {
+    std::lock_guard<std::mutex> guard(observed_receivers_mutex_);
+    transceiver->receiver()->SetObserver(&first_packet_observer_);
+    observed_receivers_.push_back(transceiver->receiver());
+  }
+  // デコードを止められるように、フレームがデコーダに渡る前に挟んでおく。
+  // 止めている間もフレームバッファにはフレームが渡るので、キーフレームは要求されない
+  webrtc::scoped_refptr<DecodeGate> decode_gate;
+  if ((decode_pause_idle_frames_ > 0 || no_video_decode_) &&
+      transceiver->media_type() == webrtc::MediaType::VIDEO) {
+    decode_gate = webrtc::make_ref_counted<DecodeGate>();
+    // VideoSink を作るまではデコードしない
+    if (no_video_decode_) {
+      decode_gate->SetPaused(true);
+    }
+    transceiver->receiver()->SetDepacketizerToDecoderFrameTransformer(
+        decode_gate);
+  }
+  PushEvent([this, transceiver, decode_gate]() {
     auto track = transceiver->receiver()->track();
     auto connection_id = transceiver->receiver()->stream_ids()[0];
     connection_ids_.insert(std::make_pair(track->id(), connection_id));
     if (track->kind() == webrtc::MediaStreamTrackInterface::kVideoKind) {
-      auto video_sink_id = renderer_->AddTrack(
-          static_cast<webrtc::VideoTrackInterface*>(track.get()));
-      if (on_add_track_) {
-        on_add_track_(video_sink_id, connection_id);
+      if (decode_gate != nullptr) {
+        decode_gates_[track->id()] = decode_gate;
+      }
+      if (!manual_video_sink_) {
+        AddRemoteVideoSink(
+            static_cast<webrtc::VideoTrackInterface*>(track.get()),
+            connection_id);
       }
     }
     if (on_media_stream_track_) {
@@ -1032,6 +2063,15 @@ void Sora::OnTrack(
 }
 void Sora::OnRemoveTrack(
     webrtc::scoped_refptr<webrtc::RtpReceiverInterface> receiver) {
+  {
+    std::lock_guard<std::mutex> guard(observed_receivers_mutex_);
+    auto it = std::find(observed_receivers_.begin(), observed_receivers_.end(),
+                        receiver);
+    if (it != observed_receivers_.end()) {
+      receiver->SetObserver(nullptr);
+      observed_receivers_.erase(it);
+    }
+  }
   PushEvent([this, receiver]() {
     auto track = receiver->track();
     auto connection_id = connection_ids_[track->id()];
@@ -1050,6 +2090,11 @@ void Sora::OnRemoveTrack(
       }
 
       renderer_->RemoveTrack(video_track);
+      remote_video_sinks_.erase(video_sink_id);
+      decode_gates_.erase(track->id());
+      if (receive_quality_controller_ != nullptr) {
+        receive_quality_controller_->RemoveSink(video_sink_id);
+      }
     }
 
     connection_ids_.erase(track->id());
@@ -1064,6 +2109,69 @@ void Sora::OnDataChannel(std::string label) {
   });
 }
 
+ptrid_t Sora::AddVideoSink(webrtc::MediaStreamTrackInterface* track) {
+  if (renderer_ == nullptr ||
+      track->kind() != webrtc::MediaStreamTrackInterface::kVideoKind) {
+    return 0;
+  }
+  auto video_track = static_cast<webrtc::VideoTrackInterface*>(track);
+  auto video_sink_id = renderer_->GetVideoSinkId(video_track);
+  if (video_sink_id != 0) {
+    return video_sink_id;
+  }
+  // 受信した映像のトラックだけを対象にする
+  auto it = connection_ids_.find(track->id());
+  if (it == connection_ids_.end()) {
+    RTC_LOG(LS_WARNING) << "AddVideoSink: remote track not found: id="
+                        << track->id();
+    return 0;
+  }
+  return AddRemoteVideoSink(video_track, it->second);
+}
+
+ptrid_t Sora::AddRemoteVideoSink(webrtc::VideoTrackInterface* video_track,
+                                 const std::string& connection_id) {
+  webrtc::scoped_refptr<DecodeGate> decode_gate;
+  auto it = decode_gates_.find(video_track->id());
+  if (it != decode_gates_.end()) {
+    decode_gate = it->second;
+  }
+  auto track = webrtc::scoped_refptr<webrtc::VideoTrackInterface>(video_track);
+  // 止めている間に参照フレームが欠けているので、再開する時はキーフレームを要求する。
+  // レンダースレッドからも呼ばれるので、ワーカースレッドへの同期呼び出しは IO スレッドで行う
+  auto resume = [this, decode_gate, track]() {
+    decode_gate->SetPaused(false);
+    boost::asio::post(*ioc_, [track]() {
+      track->GetSource()->GenerateKeyFrame();
+    });
+  };
+
+  std::function<void(bool)> on_demand_changed;
+  if (decode_gate != nullptr && decode_pause_idle_frames_ > 0) {
+    on_demand_changed = [decode_gate, resume](bool demanded) {
+      if (demanded) {
+        resume();
+      } else {
+        decode_gate->SetPaused(true);
+      }
+    };
+  }
+  auto video_sink_id = renderer_->AddTrack(
+      video_track, decode_pause_idle_frames_, on_demand_changed);
+  remote_video_sinks_[video_sink_id] = connection_id;
+  if (receive_quality_controller_ != nullptr) {
+    receive_quality_controller_->AddSink(video_sink_id, connection_id);
+  }
+  // no_video_decode でデコードしていなかった映像はここからデコードを始める
+  if (decode_gate != nullptr && decode_gate->IsPaused()) {
+    resume();
+  }
+  if (on_add_track_) {
+    on_add_track_(video_sink_id, connection_id);
+  }
+  return video_sink_id;
+}
+
 void Sora::PushEvent(std::function<void()> f) {
   std::lock_guard<std::mutex> guard(event_mutex_);
   event_queue_.push_back(std::move(f));
@@ -11,18 +11,26 @@
 
 // Boost
 #include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
 
 // WebRTC
 #include <api/environment/environment_factory.h>
+#include <api/rtp_receiver_interface.h>
 #include <api/scoped_refptr.h>
 #include <api/task_queue/task_queue_factory.h>
 #include <media/engine/webrtc_media_engine.h>
 #include <modules/audio_device/include/audio_device.h>
 #include <pc/connection_context.h>
 
+#include "connect_timeline.h"
+#include "decode_gate.h"
 #include "id_pointer.h"
+#include "receive_quality_controller.h"
 #include "sora_conf.json.h"
 #include "sora_conf_internal.json.h"
+#include "stats_filter.h"
+#include "stats_sampler.h"
+#include "synthetic_video_source.h"
 #include "unity.h"
 #include "unity_audio_device.h"
 #include "unity_camera_capturer.h"
@@ -35,6 +43,16 @@
 
 namespace sora_unity_sdk {
 
+// 複数の Sora インスタンスで共有するコンテキスト。
+// スレッドや PeerConnectionFactory、コーデックのファクトリ、ADM を使い回す。
+struct SoraSharedContext {
+  std::shared_ptr<sora::SoraClientContext> client_context;
+  webrtc::scoped_refptr<UnityAudioDevice> adm;
+  // 負荷試験用に、全ての Sora インスタンスが送信する映像ソース。
+  // 設定されている場合はカメラの代わりにこれを使う
+  webrtc::scoped_refptr<SyntheticVideoSource> video_source;
+};
+
 class Sora : public std::enable_shared_from_this<Sora>,
              public sora::SoraSignalingObserver {
  public:
@@ -60,17 +78,71 @@ class Sora : public std::enable_shared_from_this<Sora>,
   void SetOnDisconnect(std::function<void(int, std::string)> on_disconnect);
   void SetOnDataChannel(std::function<void(std::string)> on_data_channel);
   void SetOnCapturerFrame(std::function<void(std::string)> on_capturer_frame);
+  // デバイスの抜き差しを検出した時に Unity スレッドで呼ばれる。
+  // 引数は DeviceKind の値。
+  void SetOnDeviceChange(std::function<void(int)> on_device_change);
+  // SwitchCamera の完了時に Unity スレッドで呼ばれる
+  void SetOnSwitchCamera(
+      std::function<void(bool, std::string)> on_switch_camera);
+  // AddVideoSource で追加した映像ソースのトラックが描画できるようになった時に Unity スレッドで呼ばれる
+  void SetOnAddVideoSource(
+      std::function<void(int, ptrid_t)> on_add_video_source);
   void DispatchEvents();
 
-  void Connect(const sora_conf::internal::ConnectConfig& cc);
+  // shared_context を指定した場合、新しく SoraClientContext を作らずにそれを利用する
+  void Connect(const sora_conf::internal::ConnectConfig& cc,
+               std::shared_ptr<SoraSharedContext> shared_context = nullptr);
+  // 接続に依存しない準備（コンテキストや ADM、キャプチャラ、トラックの作成）を事前に行う。
+  // Prepare() した後に Connect() すると、すぐにシグナリングを開始する。
+  bool Prepare(const sora_conf::internal::ConnectConfig& cc,
+               std::shared_ptr<SoraSharedContext> shared_context = nullptr);
+  sora_prepare_timings_t GetPrepareTimings() const;
+  int ReadConnectTimeline(sora_timeline_event_t* buf, int size);
   void Disconnect();
+  // 新しいキャプチャラを開始して最初のフレームが届いてから送信トラックを差し替え、
+  // その後で古いキャプチャラを止める。完了は SetOnSwitchCamera で設定したコールバックで通知する。
+  // カメラを同時に開けずに新しいキャプチャラの作成に失敗した場合は、
+  // 古いカメラを止めてから作り直す。成功した場合のメッセージは、
+  // 古いカメラを後で止めた場合は "make-before-break"、先に止めた場合は "break-before-make"。
   void SwitchCamera(const sora_conf::internal::CameraConfig& cc);
 
+  // 接続中に映像ソースを追加する。追加したソースは常にキャプチャされ、
+  // SetSendingVideoSource で指定した時だけ送信される。
+  // 戻り値はソースの ID で、失敗した場合は 0 を返す。
+  int AddVideoSource(const sora_conf::internal::VideoSourceConfig& config);
+  bool RemoveVideoSource(int source_id);
+  // 送信する映像ソースを切り替える。0 を指定すると接続時の映像に戻す。
+  // 再ネゴシエーションは行わず、送信トラックとエンコードパラメータだけを差し替える。
+  bool SetSendingVideoSource(int source_id);
+  // Unity カメラやテクスチャの内容が変わったことを通知する。0 を指定すると接続時の映像。
+  // CameraConfig の capture_on_mark_dirty が true の場合だけ意味がある。
+  bool MarkVideoSourceDirty(int source_id);
+  // 送信中の映像のエンコードパラメータを、再ネゴシエーション無しで変更する。
+  // 変更は IO スレッドで非同期に行われる。
+  bool SetVideoEncodingParameters(
+      const sora_conf::internal::VideoEncodingParameters& params);
+  sora_conf::internal::VideoEncodingParameters GetVideoEncodingParameters();
+
+  // 受信している映像の描画サイズに合わせて、受信するサイマルキャストの rid を自動で切り替える。
+  // rid の変更は DataChannel の JSON-RPC で行うので、DataChannel シグナリングが有効である必要がある。
+  void StartReceiveQualityController(
+      const sora_conf::internal::ReceiveQualityControllerConfig& config);
+  void StopReceiveQualityController();
+  // 映像が画面に見えているか、注目しているかをコントローラに伝える
+  void SetVideoSinkHint(ptrid_t video_sink_id, bool visible, bool focused);
+
+  static std::shared_ptr<SoraSharedContext> CreateSharedContext(
+      const sora_conf::internal::SharedContextConfig& config);
+
   static void UNITY_INTERFACE_API RenderCallbackStatic(int event_id);
   int GetRenderCallbackEventID() const;
 
   void RenderCallback();
 
+  // manual_video_sink の場合に、受信した映像の VideoSink を作る。
+  // 既に作っている場合はその VideoSinkId を返す。Unity スレッドから呼ぶ
+  ptrid_t AddVideoSink(webrtc::MediaStreamTrackInterface* track);
+
   webrtc::VideoTrackInterface* GetVideoTrackFromVideoSinkId(
       ptrid_t video_sink_id) const;
   ptrid_t GetVideoSinkIdFromVideoTrack(
@@ -82,10 +154,25 @@ class Sora : public std::enable_shared_from_this<Sora>,
   static bool SetADMVolume(webrtc::scoped_refptr<webrtc::AudioDeviceModule> adm,
                            bool is_speaker,
                            double volume);
+  // 共有コンテキストを使っている場合は ADM が全ての接続で共通なので、
+  // 接続ごとの音量は変更できずに false を返す。
+  // 代わりに SetSharedContextVolume を使う
   bool SetSpeakerVolume(double volume);
   bool SetMicrophoneVolume(double volume);
+  // 共有コンテキストの ADM の音量を設定する。全ての接続に影響する
+  static bool SetSharedContextVolume(
+      std::shared_ptr<SoraSharedContext> shared_context,
+      bool is_speaker,
+      double volume);
 
   void GetStats(std::function<void(std::string)> on_get_stats);
+  void GetFilteredStats(
+      const sora_conf::internal::StatsFilter& filter,
+      std::function<void(const FilteredStats&)> on_get_stats);
+
+  void StartStatsSampler(int interval_ms);
+  void StopStatsSampler();
+  int ReadStatsSamples(sora_stats_sample_t* buf, int size);
 
   void SendMessage(const std::string& label, const std::string& data);
 
@@ -116,11 +203,33 @@ class Sora : public std::enable_shared_from_this<Sora>,
   void OnDataChannel(std::string label) override;
 
  private:
+  bool DoPrepare(const sora_conf::internal::ConnectConfig& cc,
+                 std::shared_ptr<SoraSharedContext> shared_context,
+                 std::function<void(int, std::string)> on_error);
+  // Prepare() した時の設定で cc の接続ができるかどうか
+  bool IsPreparedFor(const sora_conf::internal::ConnectConfig& cc,
+                     std::shared_ptr<SoraSharedContext> shared_context) const;
+  // Prepare() で作ったものを破棄する
+  void ReleasePrepared();
   void DoConnect(const sora_conf::internal::ConnectConfig& config,
+                 std::shared_ptr<SoraSharedContext> shared_context,
                  std::function<void(int, std::string)> on_disconnect);
   void DoSwitchCamera(
-      const sora_conf::internal::CameraConfig& cc,
+      int switch_id,
+      webrtc::scoped_refptr<webrtc::VideoTrackInterface> old_video_track,
       webrtc::scoped_refptr<webrtc::VideoTrackInterface> video_track);
+  void FinishSwitchCamera(int switch_id, bool success, std::string message);
+  void DoSetVideoEncodingParameters(
+      const sora_conf::internal::VideoEncodingParameters& params);
+  void DoSetSendingVideoSource(
+      int source_id,
+      webrtc::scoped_refptr<webrtc::VideoTrackInterface> video_track,
+      sora_conf::internal::VideoSourceConfig config);
+  static void StopCapturer(
+      webrtc::scoped_refptr<webrtc::VideoTrackSourceInterface> capturer,
+      int capturer_type);
+  void DoSampleStats();
+  void DoWatchConnectionState();
 
   static webrtc::scoped_refptr<UnityAudioDevice> CreateADM(
       webrtc::Environment env,
@@ -147,6 +256,8 @@ class Sora : public std::enable_shared_from_this<Sora>,
       int video_width,
       int video_height,
       int video_fps,
+      bool capture_on_mark_dirty,
+      int keepalive_interval_ms,
       std::function<void(const webrtc::VideoFrame& frame)> on_frame,
       webrtc::Thread* signaling_thread,
       void* jni_env,
@@ -154,6 +265,8 @@ class Sora : public std::enable_shared_from_this<Sora>,
       UnityContext* unity_context);
 
   void PushEvent(std::function<void()> f);
+  ptrid_t AddRemoteVideoSink(webrtc::VideoTrackInterface* video_track,
+                             const std::string& connection_id);
 
   struct CapturerSink : webrtc::VideoSinkInterface<webrtc::VideoFrame> {
     CapturerSink(
@@ -167,6 +280,25 @@ class Sora : public std::enable_shared_from_this<Sora>,
     std::function<void(std::string)> on_frame_;
   };
 
+  // SwitchCamera で新しいキャプチャラから最初のフレームが届いたことを検出する
+  struct FirstFrameSink : webrtc::VideoSinkInterface<webrtc::VideoFrame> {
+    FirstFrameSink(std::function<void()> on_first_frame);
+    void OnFrame(const webrtc::VideoFrame& frame) override;
+
+   private:
+    std::atomic<bool> received_{false};
+    std::function<void()> on_first_frame_;
+  };
+
+  // 受信側で最初の RTP パケットを受け取った時刻を記録する
+  struct FirstPacketObserver : webrtc::RtpReceiverObserverInterface {
+    FirstPacketObserver(std::shared_ptr<ConnectTimeline> timeline);
+    void OnFirstPacketReceived(webrtc::MediaType media_type) override;
+
+   private:
+    std::shared_ptr<ConnectTimeline> timeline_;
+  };
+
  private:
   std::unique_ptr<boost::asio::io_context> ioc_;
   std::shared_ptr<sora::SoraSignaling> signaling_;
@@ -194,6 +326,10 @@ class Sora : public std::enable_shared_from_this<Sora>,
   std::function<void(std::string)> on_data_channel_;
   std::function<void(const int16_t*, int, int)> on_handle_audio_;
   std::function<void(std::string)> on_capturer_frame_;
+  std::function<void(int)> on_device_change_;
+  std::function<void(bool, std::string)> on_switch_camera_;
+  std::function<void(int, ptrid_t)> on_add_video_source_;
+  int device_listener_id_ = 0;
 
   webrtc::AudioTrackSinkInterface* sender_audio_track_sink_ = nullptr;
 
@@ -209,17 +345,84 @@ class Sora : public std::enable_shared_from_this<Sora>,
 
   std::string stream_id_;
 
+  // capturer_ と capturer_type_ はレンダースレッドからも参照するので、
+  // 書き換える時は video_sources_mutex_ のロックを取る
   webrtc::scoped_refptr<webrtc::VideoTrackSourceInterface> capturer_;
   int capturer_type_ = 0;
   std::shared_ptr<CapturerSink> capturer_sink_;
 
   webrtc::scoped_refptr<UnityAudioDevice> unity_adm_;
+  // unity_adm_ が共有コンテキストの ADM かどうか
+  bool shared_adm_ = false;
   webrtc::TaskQueueFactory* task_queue_factory_;
 #if defined(SORA_UNITY_SDK_ANDROID)
   webrtc::ScopedJavaGlobalRef<jobject> android_context_;
 #endif
 
   std::atomic<bool> set_offer_ = false;
+
+  // Unity スレッドからのみ触る
+  bool prepared_ = false;
+  // Prepare() した時の設定。Connect() で同じかどうかを確認する
+  sora_conf::internal::ConnectConfig prepared_config_;
+  std::shared_ptr<SoraSharedContext> prepared_shared_context_;
+  sora_prepare_timings_t prepare_timings_ = {};
+  // シグナリングスレッドの OnTrack から参照するので、接続前に設定しておく
+  int decode_pause_idle_frames_ = 0;
+  bool manual_video_sink_ = false;
+  bool no_video_decode_ = false;
+  // 受信した映像のトラック ID と DecodeGate。Unity スレッドからのみ触る
+  std::map<std::string, webrtc::scoped_refptr<DecodeGate>> decode_gates_;
+  // 受信している映像の VideoSinkId と送信元のコネクション ID
+  std::map<ptrid_t, std::string> remote_video_sinks_;
+  std::unique_ptr<ReceiveQualityController> receive_quality_controller_;
+  // 切り替え中のキャプチャラとトラック。
+  // pending_capturer_ と pending_capturer_type_ は capturer_ と同じく
+  // 書き換える時に video_sources_mutex_ のロックを取る
+  int switch_camera_id_ = 0;
+  webrtc::scoped_refptr<webrtc::VideoTrackSourceInterface> pending_capturer_;
+  int pending_capturer_type_ = 0;
+  webrtc::scoped_refptr<webrtc::VideoTrackInterface> pending_video_track_;
+  std::unique_ptr<FirstFrameSink> switch_camera_sink_;
+  // 新しいカメラを開く前に古いカメラを止めた場合に true になる。Unity スレッドだけが触る
+  bool switch_camera_stopped_old_ = false;
+
+  // AddVideoSource で追加した映像ソース。
+  // RenderCallback でレンダースレッドから参照するのでロックを取る。
+  // video_sources_mutex_ は capturer_ と pending_capturer_ も保護する
+  struct VideoSource {
+    webrtc::scoped_refptr<webrtc::VideoTrackSourceInterface> capturer;
+    int capturer_type = 0;
+    webrtc::scoped_refptr<webrtc::VideoTrackInterface> video_track;
+    sora_conf::internal::VideoSourceConfig config;
+  };
+  std::mutex video_sources_mutex_;
+  std::map<int, VideoSource> video_sources_;
+  int next_video_source_id_ = 1;
+
+  std::shared_ptr<ConnectTimeline> timeline_;
+  FirstPacketObserver first_packet_observer_;
+  std::mutex observed_receivers_mutex_;
+  std::vector<webrtc::scoped_refptr<webrtc::RtpReceiverInterface>>
+      observed_receivers_;
+
+  // IO スレッドからのみ触る
+  std::unique_ptr<boost::asio::steady_timer> connection_state_timer_;
+  std::unique_ptr<boost::asio::steady_timer> stats_timer_;
+  // 切り替え待ちの SwitchCamera の ID。0 の場合は切り替え中ではない
+  int switching_camera_id_ = 0;
+  static constexpr int kSwitchCameraTimeoutMs = 5000;
+  // 送信中の映像ソースの ID。0 の場合は接続時の映像
+  int sending_video_source_id_ = 0;
+  // 接続時の映像のトラックとエンコードパラメータ。他のソースを送信している間だけ保持する
+  webrtc::scoped_refptr<webrtc::VideoTrackInterface> primary_video_track_;
+  std::vector<webrtc::RtpEncodingParameters> primary_encodings_;
+  // 他のソースへの切り替えで設定したエンコードパラメータ。
+  // SetVideoEncodingParameters で後から変更された項目を区別するために保持する
+  std::vector<webrtc::RtpEncodingParameters> applied_encodings_;
+  std::unique_ptr<boost::asio::steady_timer> switch_camera_timer_;
+  int stats_sampler_interval_ms_ = 0;
+  StatsSampler stats_sampler_;
 };
 
 }  // namespace sora_unity_sdk
@@ -0,0 +1,85 @@
+#include "stats_filter.h"
+
+#include <cstring>
+#include <limits>
+
+namespace sora_unity_sdk {
+
+std::optional<double> StatsAttributeToDouble(const webrtc::Attribute& attr) {
+  if (!attr.has_value()) {
+    return std::nullopt;
+  }
+  if (attr.holds_alternative<double>()) {
+    return attr.get<double>();
+  }
+  if (attr.holds_alternative<int32_t>()) {
+    return (double)attr.get<int32_t>();
+  }
+  if (attr.holds_alternative<uint32_t>()) {
+    return (double)attr.get<uint32_t>();
+  }
+  if (attr.holds_alternative<int64_t>()) {
+    return (double)attr.get<int64_t>();
+  }
+  if (attr.holds_alternative<uint64_t>()) {
+    return (double)attr.get<uint64_t>();
+  }
+  if (attr.holds_alternative<bool>()) {
+    return attr.get<bool>() ? 1.0 : 0.0;
+  }
+  return std::nullopt;
+}
+
+FilteredStats FilterStats(const webrtc::RTCStatsReport& report,
+                          const sora_conf::internal::StatsFilter& filter) {
+  FilteredStats result;
+  result.num_fields = (int)filter.fields.size();
+
+  for (const auto& stats : report) {
+    // types が空なら全ての type を対象にする
+    int type_index = -1;
+    if (filter.types.empty()) {
+      type_index = 0;
+    } else {
+      for (int i = 0; i < (int)filter.types.size(); i++) {
+        if (std::strcmp(stats.type(), filter.types[i].c_str()) == 0) {
+          type_index = i;
+          break;
+        }
+      }
+    }
+    if (type_index < 0) {
+      continue;
+    }
+
+    sora_stats_record_t record;
+    record.type = type_index;
+    record.ssrc = 0;
+    record.timestamp_us = stats.timestamp().us();
+
+    size_t offset = result.values.size();
+    result.values.resize(offset + result.num_fields,
+                         std::numeric_limits<double>::quiet_NaN());
+    for (const auto& attr : stats.Attributes()) {
+      if (std::strcmp(attr.name(), "ssrc") == 0) {
+        if (attr.holds_alternative<uint32_t>() && attr.has_value()) {
+          record.ssrc = attr.get<uint32_t>();
+        }
+      }
+      for (int i = 0; i < result.num_fields; i++) {
+        if (std::strcmp(attr.name(), filter.fields[i].c_str()) != 0) {
+          continue;
+        }
+        auto v = StatsAttributeToDouble(attr);
+        if (v) {
+          result.values[offset + i] = *v;
+        }
+        break;
+      }
+    }
+    result.records.push_back(record);
+  }
+  return result;
+}
+
+}  // namespace sora_unity_sdk
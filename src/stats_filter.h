@@ -0,0 +1,37 @@
+#ifndef SORA_UNITY_SDK_STATS_FILTER_H_INCLUDED
+#define SORA_UNITY_SDK_STATS_FILTER_H_INCLUDED
+
+#include <optional>
+#include <vector>
+
+// WebRTC
+#include <api/stats/rtc_stats.h>
+#include <api/stats/rtc_stats_report.h>
+
+#include "sora_conf_internal.json.h"
+#include "unity.h"
+
+namespace sora_unity_sdk {
+
+// RTCStatsReport から必要な type と field だけを抜き出した結果。
+//
+// JSON を経由せずに C# に渡すため、records と values はそのまま
+// C API のコールバックに渡せる形式になっている。
+// values は records.size() * num_fields 個の値を持つ行優先の配列で、
+// 該当する field が存在しないか数値でない場合は NaN が入る。
+struct FilteredStats {
+  std::vector<sora_stats_record_t> records;
+  std::vector<double> values;
+  int num_fields = 0;
+};
+
+// 統計情報の属性を数値に変換する。
+// 数値や真偽値でない場合、または値が設定されていない場合は std::nullopt を返す。
+std::optional<double> StatsAttributeToDouble(const webrtc::Attribute& attr);
+
+FilteredStats FilterStats(const webrtc::RTCStatsReport& report,
+                          const sora_conf::internal::StatsFilter& filter);
+
+}  // namespace sora_unity_sdk
+
+#endif
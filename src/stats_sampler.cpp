@@ -0,0 +1,134 @@
+#include "stats_sampler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "stats_filter.h"
+
+namespace sora_unity_sdk {
+
+static std::optional<double> GetNumber(const webrtc::RTCStats& stats,
+                                       const char* name) {
+  for (const auto& attr : stats.Attributes()) {
+    if (std::strcmp(attr.name(), name) == 0) {
+      return StatsAttributeToDouble(attr);
+    }
+  }
+  return std::nullopt;
+}
+
+static std::string GetString(const webrtc::RTCStats& stats, const char* name) {
+  for (const auto& attr : stats.Attributes()) {
+    if (std::strcmp(attr.name(), name) == 0) {
+      if (attr.holds_alternative<std::string>() && attr.has_value()) {
+        return attr.get<std::string>();
+      }
+      break;
+    }
+  }
+  return "";
+}
+
+StatsSampler::StatsSampler() : middle_(1) {}
+
+void StatsSampler::Update(const webrtc::RTCStatsReport& report) {
+  const double kNaN = std::numeric_limits<double>::quiet_NaN();
+
+  // 送信側のパケットロス率は remote-inbound-rtp の fractionLost から取る
+  std::map<uint32_t, double> remote_fraction_lost;
+  for (const auto& stats : report) {
+    if (std::strcmp(stats.type(), "remote-inbound-rtp") != 0) {
+      continue;
+    }
+    auto ssrc = GetNumber(stats, "ssrc");
+    auto fraction_lost = GetNumber(stats, "fractionLost");
+    if (ssrc && fraction_lost) {
+      remote_fraction_lost[(uint32_t)*ssrc] = *fraction_lost;
+    }
+  }
+
+  auto& samples = buffers_[back_];
+  samples.clear();
+  std::map<std::string, Counters> current;
+  for (const auto& stats : report) {
+    bool inbound = std::strcmp(stats.type(), "inbound-rtp") == 0;
+    bool outbound = std::strcmp(stats.type(), "outbound-rtp") == 0;
+    if (!inbound && !outbound) {
+      continue;
+    }
+
+    Counters c;
+    c.timestamp_us = stats.timestamp().us();
+    c.bytes =
+        GetNumber(stats, inbound ? "bytesReceived" : "bytesSent").value_or(0);
+    c.packets = GetNumber(stats, inbound ? "packetsReceived" : "packetsSent")
+                    .value_or(0);
+    c.packets_lost = GetNumber(stats, "packetsLost").value_or(0);
+    c.frames = GetNumber(stats, inbound ? "framesDecoded" : "framesEncoded")
+                   .value_or(0);
+    c.jitter_buffer_delay = GetNumber(stats, "jitterBufferDelay").value_or(0);
+    c.jitter_buffer_emitted_count =
+        GetNumber(stats, "jitterBufferEmittedCount").value_or(0);
+
+    sora_stats_sample_t s;
+    s.timestamp_us = c.timestamp_us;
+    s.bitrate_bps = kNaN;
+    s.framerate = kNaN;
+    s.packet_loss_percent = kNaN;
+    s.jitter_buffer_delay_ms = kNaN;
+    s.ssrc = (uint32_t)GetNumber(stats, "ssrc").value_or(0);
+    s.kind = GetString(stats, "kind") == "video" ? 1 : 0;
+    s.direction = inbound ? 0 : 1;
+
+    // 前回の値が無い場合は差分が取れないので NaN のままにしておく
+    auto it = prev_.find(stats.id());
+    if (it != prev_.end() && c.timestamp_us > it->second.timestamp_us) {
+      const auto& p = it->second;
+      double sec = (c.timestamp_us - p.timestamp_us) / 1000000.0;
+      s.bitrate_bps = (c.bytes - p.bytes) * 8 / sec;
+      if (s.kind == 1) {
+        s.framerate = (c.frames - p.frames) / sec;
+      }
+      if (inbound) {
+        double lost = c.packets_lost - p.packets_lost;
+        double total = (c.packets - p.packets) + lost;
+        s.packet_loss_percent = total > 0 ? std::max(0.0, lost) * 100 / total
+                                          : 0.0;
+        double emitted =
+            c.jitter_buffer_emitted_count - p.jitter_buffer_emitted_count;
+        if (emitted > 0) {
+          s.jitter_buffer_delay_ms =
+              (c.jitter_buffer_delay - p.jitter_buffer_delay) * 1000 / emitted;
+        }
+      }
+    }
+    if (outbound) {
+      auto rit = remote_fraction_lost.find(s.ssrc);
+      if (rit != remote_fraction_lost.end()) {
+        s.packet_loss_percent = rit->second * 100;
+      }
+    }
+
+    samples.push_back(s);
+    current[stats.id()] = c;
+  }
+  // 消えたストリームの値を持ち続けないように、毎回入れ替える
+  prev_ = std::move(current);
+
+  back_ = middle_.exchange(back_ | kDirty) & kIndexMask;
+}
+
+int StatsSampler::Read(sora_stats_sample_t* buf, int size) {
+  if (middle_.load() & kDirty) {
+    front_ = middle_.exchange(front_) & kIndexMask;
+  }
+  const auto& samples = buffers_[front_];
+  int n = std::min(size, (int)samples.size());
+  if (n > 0) {
+    std::memcpy(buf, samples.data(), n * sizeof(sora_stats_sample_t));
+  }
+  return (int)samples.size();
+}
+
+}  // namespace sora_unity_sdk
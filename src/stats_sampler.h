@@ -0,0 +1,57 @@
+#ifndef SORA_UNITY_SDK_STATS_SAMPLER_H_INCLUDED
+#define SORA_UNITY_SDK_STATS_SAMPLER_H_INCLUDED
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+// WebRTC
+#include <api/stats/rtc_stats_report.h>
+
+#include "unity.h"
+
+namespace sora_unity_sdk {
+
+// 定期的に取得した RTCStatsReport から、前回との差分を使って
+// ビットレートやフレームレートなどを計算する。
+//
+// Update() は統計情報のコールバックスレッドから、Read() はアプリ側のスレッドから呼ばれる。
+// 両者の間はトリプルバッファでやり取りしているのでロックを取らない。
+// ただし Update() と Read() はそれぞれ単一のスレッドから呼び出すこと。
+class StatsSampler {
+ public:
+  StatsSampler();
+
+  void Update(const webrtc::RTCStatsReport& report);
+  // 最新のサンプルを buf に最大 size 個コピーし、最新のサンプルの総数を返す。
+  // 戻り値が size より大きい場合、バッファが足りていない。
+  int Read(sora_stats_sample_t* buf, int size);
+
+ private:
+  struct Counters {
+    int64_t timestamp_us = 0;
+    double bytes = 0;
+    double packets = 0;
+    double packets_lost = 0;
+    double frames = 0;
+    double jitter_buffer_delay = 0;
+    double jitter_buffer_emitted_count = 0;
+  };
+
+  // Update() を呼ぶスレッドだけが触る
+  std::map<std::string, Counters> prev_;
+  int back_ = 0;
+
+  // Read() を呼ぶスレッドだけが触る
+  int front_ = 2;
+
+  static constexpr int kDirty = 4;
+  static constexpr int kIndexMask = 3;
+  std::atomic<int> middle_;
+  std::vector<sora_stats_sample_t> buffers_[3];
+};
+
+}  // namespace sora_unity_sdk
+
+#endif
@@ -0,0 +1,216 @@
+#include "synthetic_video_source.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+// WebRTC
+#include <api/video/video_frame.h>
+#include <libyuv.h>
+#include <rtc_base/logging.h>
+#include <rtc_base/time_utils.h>
+
+namespace sora_unity_sdk {
+
+webrtc::scoped_refptr<SyntheticVideoSource> SyntheticVideoSource::Create(
+    const SyntheticVideoSourceConfig& config) {
+  webrtc::scoped_refptr<SyntheticVideoSource> p =
+      webrtc::make_ref_counted<SyntheticVideoSource>(config);
+  if (!p->Init()) {
+    return nullptr;
+  }
+  return p;
+}
+
+SyntheticVideoSource::SyntheticVideoSource(
+    const SyntheticVideoSourceConfig& config)
+    : sora::ScalableVideoTrackSource(config), config_(config) {}
+
+SyntheticVideoSource::~SyntheticVideoSource() {
+  Stop();
+  if (file_ != nullptr) {
+    std::fclose(file_);
+  }
+}
+
+bool SyntheticVideoSource::Init() {
+  if (!config_.y4m_file.empty() && !OpenY4M()) {
+    return false;
+  }
+  if (config_.width <= 0 || config_.height <= 0 || config_.fps <= 0) {
+    RTC_LOG(LS_ERROR) << "Invalid synthetic video config: width="
+                      << config_.width << " height=" << config_.height
+                      << " fps=" << config_.fps;
+    return false;
+  }
+  RTC_LOG(LS_INFO) << "SyntheticVideoSource: width=" << config_.width
+                   << " height=" << config_.height << " fps=" << config_.fps
+                   << " y4m_file=" << config_.y4m_file;
+  thread_ = std::thread([this]() { Run(); });
+  return true;
+}
+
+bool SyntheticVideoSource::OpenY4M() {
+  file_ = std::fopen(config_.y4m_file.c_str(), "rb");
+  if (file_ == nullptr) {
+    RTC_LOG(LS_ERROR) << "Failed to open Y4M file: " << config_.y4m_file;
+    return false;
+  }
+  char header[256];
+  if (std::fgets(header, sizeof(header), file_) == nullptr ||
+      std::strncmp(header, "YUV4MPEG2", 9) != 0) {
+    RTC_LOG(LS_ERROR) << "Invalid Y4M header: " << config_.y4m_file;
+    return false;
+  }
+
+  // 例: YUV4MPEG2 W640 H480 F30:1 Ip A1:1 C420jpeg
+  std::istringstream iss(header + 9);
+  std::string token;
+  while (iss >> token) {
+    switch (token[0]) {
+      case 'W':
+        config_.width = std::atoi(token.c_str() + 1);
+        break;
+      case 'H':
+        config_.height = std::atoi(token.c_str() + 1);
+        break;
+      case 'F': {
+        int num = 0;
+        int den = 0;
+        if (std::sscanf(token.c_str() + 1, "%d:%d", &num, &den) == 2 &&
+            den > 0) {
+          config_.fps = std::max(1, (num + den / 2) / den);
+        }
+        break;
+      }
+      case 'C':
+        // 8bit の 4:2:0 のみ対応する
+        if (token.compare(0, 4, "C420") != 0 ||
+            token.find("p1") != std::string::npos) {
+          RTC_LOG(LS_ERROR) << "Unsupported Y4M colorspace: " << token;
+          return false;
+        }
+        break;
+    }
+  }
+  data_offset_ = std::ftell(file_);
+  return true;
+}
+
+void SyntheticVideoSource::Stop() {
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    stopped_ = true;
+  }
+  cv_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void SyntheticVideoSource::Run() {
+  const int64_t interval_us = 1000000 / config_.fps;
+  int64_t next_us = webrtc::TimeMicros();
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      auto wait_us = std::max<int64_t>(0, next_us - webrtc::TimeMicros());
+      if (cv_.wait_for(lock, std::chrono::microseconds(wait_us),
+                       [this]() { return stopped_; })) {
+        return;
+      }
+    }
+
+    int64_t now_us = webrtc::TimeMicros();
+    // 大きく遅れた場合は追いつこうとせずに、ここから数え直す
+    next_us = std::max(next_us + interval_us, now_us);
+
+    auto buffer = NextFrame();
+    if (buffer == nullptr) {
+      continue;
+    }
+    auto video_frame = webrtc::VideoFrame::Builder()
+                           .set_video_frame_buffer(buffer)
+                           .set_rotation(webrtc::kVideoRotation_0)
+                           .set_timestamp_us(now_us)
+                           .build();
+    OnCapturedFrame(video_frame);
+  }
+}
+
+webrtc::scoped_refptr<webrtc::I420Buffer> SyntheticVideoSource::NextFrame() {
+  auto buffer = pool_.CreateI420Buffer(config_.width, config_.height);
+  if (buffer == nullptr) {
+    return nullptr;
+  }
+  if (file_ != nullptr) {
+    if (!ReadY4MFrame(buffer.get())) {
+      return nullptr;
+    }
+  } else {
+    DrawPattern(buffer.get());
+  }
+  frame_count_ += 1;
+  return buffer;
+}
+
+void SyntheticVideoSource::DrawPattern(webrtc::I420Buffer* buffer) {
+  int width = buffer->width();
+  int height = buffer->height();
+  // 背景の色を少しずつ変えて、その上で白い四角を動かす
+  int t = (int)(frame_count_ % 256);
+  libyuv::I420Rect(buffer->MutableDataY(), buffer->StrideY(),
+                   buffer->MutableDataU(), buffer->StrideU(),
+                   buffer->MutableDataV(), buffer->StrideV(), 0, 0, width,
+                   height, 64, t, 255 - t);
+  int box_width = std::max(2, width / 8);
+  int box_height = std::max(2, height / 8);
+  int x = (int)((frame_count_ * 4) % std::max(1, width - box_width)) & ~1;
+  int y = (int)((frame_count_ * 2) % std::max(1, height - box_height)) & ~1;
+  libyuv::I420Rect(buffer->MutableDataY(), buffer->StrideY(),
+                   buffer->MutableDataU(), buffer->StrideU(),
+                   buffer->MutableDataV(), buffer->StrideV(), x, y, box_width,
+                   box_height, 235, 128, 128);
+}
+
+bool SyntheticVideoSource::ReadY4MFrame(webrtc::I420Buffer* buffer) {
+  char line[256];
+  if (std::fgets(line, sizeof(line), file_) == nullptr) {
+    // 最後まで読んだら先頭のフレームに戻る
+    std::fseek(file_, data_offset_, SEEK_SET);
+    if (std::fgets(line, sizeof(line), file_) == nullptr) {
+      return false;
+    }
+  }
+  if (std::strncmp(line, "FRAME", 5) != 0) {
+    RTC_LOG(LS_ERROR) << "Invalid Y4M frame header";
+    return false;
+  }
+
+  auto read_plane = [this](uint8_t* data, int stride, int width, int height) {
+    for (int y = 0; y < height; y++) {
+      if (std::fread(data + y * stride, 1, width, file_) != (size_t)width) {
+        return false;
+      }
+    }
+    return true;
+  };
+  int chroma_width = (buffer->width() + 1) / 2;
+  int chroma_height = (buffer->height() + 1) / 2;
+  if (!read_plane(buffer->MutableDataY(), buffer->StrideY(), buffer->width(),
+                  buffer->height()) ||
+      !read_plane(buffer->MutableDataU(), buffer->StrideU(), chroma_width,
+                  chroma_height) ||
+      !read_plane(buffer->MutableDataV(), buffer->StrideV(), chroma_width,
+                  chroma_height)) {
+    // 途中で切れているフレームは捨てて、次は先頭から読む
+    RTC_LOG(LS_WARNING) << "Truncated Y4M frame";
+    std::fseek(file_, data_offset_, SEEK_SET);
+    return false;
+  }
+  return true;
+}
+
+}  // namespace sora_unity_sdk
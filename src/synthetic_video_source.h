@@ -0,0 +1,66 @@
+#ifndef SORA_UNITY_SDK_SYNTHETIC_VIDEO_SOURCE_H_INCLUDED
+#define SORA_UNITY_SDK_SYNTHETIC_VIDEO_SOURCE_H_INCLUDED
+
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// WebRTC
+#include <api/scoped_refptr.h>
+#include <api/video/i420_buffer.h>
+#include <common_video/include/video_frame_buffer_pool.h>
+
+// sora
+#include <sora/scalable_track_source.h>
+
+namespace sora_unity_sdk {
+
+struct SyntheticVideoSourceConfig : sora::ScalableVideoTrackSourceConfig {
+  int width = 640;
+  int height = 480;
+  int fps = 30;
+  // 空でない場合は、パターンの代わりに Y4M ファイルの映像を繰り返し送る。
+  // その場合、解像度とフレームレートはファイルの値を使う
+  std::string y4m_file;
+};
+
+// カメラやグラフィックスデバイスを使わずに映像を生成するソース。
+//
+// 負荷試験で多数の接続から同じ映像を送るために使う。
+// 自前のスレッドで fps 毎にフレームを生成する。
+class SyntheticVideoSource : public sora::ScalableVideoTrackSource {
+ public:
+  static webrtc::scoped_refptr<SyntheticVideoSource> Create(
+      const SyntheticVideoSourceConfig& config);
+
+  SyntheticVideoSource(const SyntheticVideoSourceConfig& config);
+  ~SyntheticVideoSource() override;
+
+  void Stop();
+
+ private:
+  bool Init();
+  bool OpenY4M();
+  void Run();
+  webrtc::scoped_refptr<webrtc::I420Buffer> NextFrame();
+  void DrawPattern(webrtc::I420Buffer* buffer);
+  bool ReadY4MFrame(webrtc::I420Buffer* buffer);
+
+  SyntheticVideoSourceConfig config_;
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stopped_ = false;
+
+  // 以下は thread_ だけが触る
+  FILE* file_ = nullptr;
+  long data_offset_ = 0;
+  int64_t frame_count_ = 0;
+  webrtc::VideoFrameBufferPool pool_{false, 8};
+};
+
+}  // namespace sora_unity_sdk
+
+#endif
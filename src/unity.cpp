@@ -5,11 +5,17 @@
 #include <sora/sora_video_codec.h>
 
 #include "converter.h"
-#include "device_list.h"
+#include "device_registry.h"
+#include "headless_unity_interfaces.h"
 #include "sora.h"
 #include "sora_conf.json.h"
 #include "sora_conf_internal.json.h"
 #include "unity_context.h"
+#include "video_codec_capability_cache.h"
+
+#if defined(SORA_UNITY_SDK_UBUNTU)
+#include "native_texture_uploader.h"
+#endif
 
 #if defined(SORA_UNITY_SDK_WINDOWS) || defined(SORA_UNITY_SDK_UBUNTU)
 #include <sora/hwenc_nvcodec/nvcodec_video_decoder.h>
@@ -20,6 +26,22 @@ struct SoraWrapper {
   std::shared_ptr<sora_unity_sdk::Sora> sora;
 };
 
+struct SoraSharedContextWrapper {
+  std::shared_ptr<sora_unity_sdk::SoraSharedContext> shared_context;
+};
+
+// 文字列を返す関数の戻り値。
+// 呼び出し側で sora_result_data/sora_result_size を使って取り出し、sora_result_destroy で破棄する。
+struct SoraResult {
+  std::string data;
+};
+
+static void* CreateResult(std::string data) {
+  auto result = new SoraResult();
+  result->data = std::move(data);
+  return result;
+}
+
 extern "C" {
 #if defined(SORA_UNITY_SDK_IOS)
 // PlaybackEngines/iOSSupport/Trampoline/Classes/Unity/UnityInterface.h から必要な定義だけ拾ってきた
@@ -34,6 +56,28 @@ void UNITY_INTERFACE_API SoraUnitySdk_UnityPluginLoad(IUnityInterfaces* ifs);
 void UNITY_INTERFACE_API SoraUnitySdk_UnityPluginUnload();
 #endif
 
+const void* sora_result_data(void* result) {
+  return ((SoraResult*)result)->data.data();
+}
+int sora_result_size(void* result) {
+  return (int)((SoraResult*)result)->data.size();
+}
+void sora_result_destroy(void* result) {
+  delete (SoraResult*)result;
+}
+
+void sora_headless_load(int renderer) {
+  auto type = renderer == SORA_HEADLESS_RENDERER_OPENGL_CORE
+                  ? kUnityGfxRendererOpenGLCore
+                  : kUnityGfxRendererNull;
+  sora_unity_sdk::UnityContext::Instance().Init(
+      sora_unity_sdk::HeadlessUnityInterfaces::Get(type));
+}
+void sora_headless_unload() {
+  sora_unity_sdk::DeviceRegistry::Instance().Shutdown();
+  sora_unity_sdk::UnityContext::Instance().Shutdown();
+}
+
 void* sora_create() {
 #if defined(SORA_UNITY_SDK_IOS)
   if (!g_ios_plugin_registered) {
@@ -53,6 +97,21 @@ void* sora_create() {
   return wsora.release();
 }
 
+void* sora_create_headless() {
+  auto context = &sora_unity_sdk::UnityContext::Instance();
+  // Unity から UnityPluginLoad が呼ばれていれば、グラフィックスデバイスが
+  // 無くなっていても本物のインタフェースをそのまま使う
+  if (context->GetInterfaces() == nullptr) {
+    context->Init(
+        sora_unity_sdk::HeadlessUnityInterfaces::Get(kUnityGfxRendererNull));
+    RTC_LOG(LS_INFO) << "Graphics device not found, use headless interfaces";
+  }
+
+  auto wsora = std::unique_ptr<SoraWrapper>(new SoraWrapper());
+  wsora->sora = std::make_shared<sora_unity_sdk::Sora>(context);
+  return wsora.release();
+}
+
 void sora_set_on_add_track(void* p, track_cb_t on_add_track, void* userdata) {
   auto wsora = (SoraWrapper*)p;
   if (on_add_track == nullptr) {
@@ -220,6 +279,34 @@ void sora_set_on_capturer_frame(void* p,
       });
 }
 
+void sora_set_on_switch_camera(void* p,
+                               switch_camera_cb_t on_switch_camera,
+                               void* userdata) {
+  auto wsora = (SoraWrapper*)p;
+  if (on_switch_camera == nullptr) {
+    wsora->sora->SetOnSwitchCamera(nullptr);
+    return;
+  }
+  wsora->sora->SetOnSwitchCamera(
+      [on_switch_camera, userdata](bool success, std::string message) {
+        on_switch_camera(success ? 1 : 0, message.c_str(), userdata);
+      });
+}
+
+void sora_set_on_add_video_source(void* p,
+                                  add_video_source_cb_t on_add_video_source,
+                                  void* userdata) {
+  auto wsora = (SoraWrapper*)p;
+  if (on_add_video_source == nullptr) {
+    wsora->sora->SetOnAddVideoSource(nullptr);
+    return;
+  }
+  wsora->sora->SetOnAddVideoSource(
+      [on_add_video_source, userdata](int source_id, ptrid_t video_sink_id) {
+        on_add_video_source(source_id, video_sink_id, userdata);
+      });
+}
+
 void sora_dispatch_events(void* p) {
   auto wsora = (SoraWrapper*)p;
   wsora->sora->DispatchEvents();
@@ -237,6 +324,81 @@ void sora_disconnect(void* p) {
   wsora->sora->Disconnect();
 }
 
+void* sora_shared_context_create(const char* config_json) {
+  auto config =
+      jsonif::from_json<sora_conf::internal::SharedContextConfig>(config_json);
+  auto shared_context = sora_unity_sdk::Sora::CreateSharedContext(config);
+  if (shared_context == nullptr) {
+    return nullptr;
+  }
+  auto wctx =
+      std::unique_ptr<SoraSharedContextWrapper>(new SoraSharedContextWrapper());
+  wctx->shared_context = shared_context;
+  return wctx.release();
+}
+
+void sora_shared_context_destroy(void* shared_context) {
+  delete (SoraSharedContextWrapper*)shared_context;
+}
+
+unity_bool_t sora_shared_context_set_speaker_volume(void* shared_context,
+                                                    double volume) {
+  auto wctx = (SoraSharedContextWrapper*)shared_context;
+  return sora_unity_sdk::Sora::SetSharedContextVolume(wctx->shared_context,
+                                                      true, volume)
+             ? 1
+             : 0;
+}
+
+unity_bool_t sora_shared_context_set_microphone_volume(void* shared_context,
+                                                       double volume) {
+  auto wctx = (SoraSharedContextWrapper*)shared_context;
+  return sora_unity_sdk::Sora::SetSharedContextVolume(wctx->shared_context,
+                                                      false, volume)
+             ? 1
+             : 0;
+}
+
+void sora_connect_with_shared_context(void* p,
+                                      void* shared_context,
+                                      const char* config_json) {
+  auto wsora = (SoraWrapper*)p;
+  auto wctx = (SoraSharedContextWrapper*)shared_context;
+  auto config =
+      jsonif::from_json<sora_conf::internal::ConnectConfig>(config_json);
+  wsora->sora->Connect(config,
+                       wctx == nullptr ? nullptr : wctx->shared_context);
+}
+
+unity_bool_t sora_prepare(void* p, const char* config_json) {
+  return sora_prepare_with_shared_context(p, nullptr, config_json);
+}
+
+unity_bool_t sora_prepare_with_shared_context(void* p,
+                                              void* shared_context,
+                                              const char* config_json) {
+  auto wsora = (SoraWrapper*)p;
+  auto wctx = (SoraSharedContextWrapper*)shared_context;
+  auto config =
+      jsonif::from_json<sora_conf::internal::ConnectConfig>(config_json);
+  return wsora->sora->Prepare(
+             config, wctx == nullptr ? nullptr : wctx->shared_context)
+             ? 1
+             : 0;
+}
+
+void sora_get_prepare_timings(void* p, sora_prepare_timings_t* timings) {
+  auto wsora = (SoraWrapper*)p;
+  *timings = wsora->sora->GetPrepareTimings();
+}
+
+int sora_read_connect_timeline(void* p,
+                               sora_timeline_event_t* buf,
+                               int size) {
+  auto wsora = (SoraWrapper*)p;
+  return wsora->sora->ReadConnectTimeline(buf, size);
+}
+
 void sora_switch_camera(void* p, const char* config_json) {
   auto wsora = (SoraWrapper*)p;
   auto config =
@@ -244,6 +406,61 @@ void sora_switch_camera(void* p, const char* config_json) {
   wsora->sora->SwitchCamera(config);
 }
 
+int sora_add_video_source(void* p, const char* config_json) {
+  auto wsora = (SoraWrapper*)p;
+  auto config =
+      jsonif::from_json<sora_conf::internal::VideoSourceConfig>(config_json);
+  return wsora->sora->AddVideoSource(config);
+}
+
+unity_bool_t sora_remove_video_source(void* p, int source_id) {
+  auto wsora = (SoraWrapper*)p;
+  return wsora->sora->RemoveVideoSource(source_id) ? 1 : 0;
+}
+
+unity_bool_t sora_set_sending_video_source(void* p, int source_id) {
+  auto wsora = (SoraWrapper*)p;
+  return wsora->sora->SetSendingVideoSource(source_id) ? 1 : 0;
+}
+unity_bool_t sora_mark_video_source_dirty(void* p, int source_id) {
+  auto wsora = (SoraWrapper*)p;
+  return wsora->sora->MarkVideoSourceDirty(source_id) ? 1 : 0;
+}
+
+unity_bool_t sora_set_video_encoding_parameters(void* p, const char* json) {
+  auto wsora = (SoraWrapper*)p;
+  auto params =
+      jsonif::from_json<sora_conf::internal::VideoEncodingParameters>(json);
+  return wsora->sora->SetVideoEncodingParameters(params) ? 1 : 0;
+}
+
+void* sora_get_video_encoding_parameters(void* p) {
+  auto wsora = (SoraWrapper*)p;
+  return CreateResult(
+      jsonif::to_json(wsora->sora->GetVideoEncodingParameters()));
+}
+
+void sora_start_receive_quality_controller(void* p, const char* config_json) {
+  auto wsora = (SoraWrapper*)p;
+  auto config =
+      jsonif::from_json<sora_conf::internal::ReceiveQualityControllerConfig>(
+          config_json);
+  wsora->sora->StartReceiveQualityController(config);
+}
+
+void sora_stop_receive_quality_controller(void* p) {
+  auto wsora = (SoraWrapper*)p;
+  wsora->sora->StopReceiveQualityController();
+}
+
+void sora_set_video_sink_hint(void* p,
+                              ptrid_t video_sink_id,
+                              unity_bool_t visible,
+                              unity_bool_t focused) {
+  auto wsora = (SoraWrapper*)p;
+  wsora->sora->SetVideoSinkHint(video_sink_id, visible != 0, focused != 0);
+}
+
 void* sora_get_texture_update_callback() {
   return (void*)&sora_unity_sdk::UnityRenderer::Sink::TextureUpdateCallback;
 }
@@ -255,11 +472,149 @@ void sora_destroy(void* sora) {
 void* sora_get_render_callback() {
   return (void*)&sora_unity_sdk::Sora::RenderCallbackStatic;
 }
+
+#if defined(SORA_UNITY_SDK_UBUNTU)
+static bool IsNativeTextureUploadSupported() {
+  auto& context = sora_unity_sdk::UnityContext::Instance();
+  return context.IsInitialized() &&
+         context.GetInterfaces()->Get<IUnityGraphics>()->GetRenderer() ==
+             kUnityGfxRendererOpenGLCore;
+}
+#endif
+
+unity_bool_t sora_register_native_texture(ptrid_t video_sink_id,
+                                          void* native_texture,
+                                          int width,
+                                          int height) {
+#if defined(SORA_UNITY_SDK_UBUNTU)
+  if (!IsNativeTextureUploadSupported()) {
+    return 0;
+  }
+  sora_unity_sdk::NativeTextureUploader::Instance().Register(
+      video_sink_id, native_texture, width, height);
+  return 1;
+#else
+  return 0;
+#endif
+}
+void sora_unregister_native_texture(ptrid_t video_sink_id,
+                                    void* native_texture) {
+#if defined(SORA_UNITY_SDK_UBUNTU)
+  sora_unity_sdk::NativeTextureUploader::Instance().Unregister(video_sink_id,
+                                                               native_texture);
+#endif
+}
+unity_bool_t sora_register_native_texture_atlas(void* native_texture,
+                                                int width,
+                                                int height,
+                                                const ptrid_t* video_sink_ids,
+                                                const int* rects,
+                                                int count) {
+#if defined(SORA_UNITY_SDK_UBUNTU)
+  if (!IsNativeTextureUploadSupported()) {
+    return 0;
+  }
+  std::vector<sora_unity_sdk::NativeTextureUploader::AtlasCell> cells;
+  for (int i = 0; i < count; i++) {
+    cells.push_back({video_sink_ids[i], rects[i * 4 + 0], rects[i * 4 + 1],
+                     rects[i * 4 + 2], rects[i * 4 + 3]});
+  }
+  return sora_unity_sdk::NativeTextureUploader::Instance().RegisterAtlas(
+             native_texture, width, height, cells)
+             ? 1
+             : 0;
+#else
+  return 0;
+#endif
+}
+void sora_unregister_native_texture_atlas(void* native_texture) {
+#if defined(SORA_UNITY_SDK_UBUNTU)
+  sora_unity_sdk::NativeTextureUploader::Instance().UnregisterAtlas(
+      native_texture);
+#endif
+}
+unity_bool_t sora_get_native_texture_atlas_uv(void* native_texture,
+                                              ptrid_t video_sink_id,
+                                              float* uv) {
+#if defined(SORA_UNITY_SDK_UBUNTU)
+  return sora_unity_sdk::NativeTextureUploader::Instance().GetAtlasUV(
+             native_texture, video_sink_id, uv)
+             ? 1
+             : 0;
+#else
+  return 0;
+#endif
+}
+void* sora_get_native_texture_update_callback() {
+#if defined(SORA_UNITY_SDK_UBUNTU)
+  return (void*)&sora_unity_sdk::NativeTextureUploader::OnRenderEventStatic;
+#else
+  return nullptr;
+#endif
+}
+void* sora_lock_video_frame(ptrid_t video_sink_id,
+                            unity_bool_t downscaled,
+                            sora_video_frame_t* frame) {
+  // Sink はシグナリングスレッドで削除されるので、使っている間は削除を待たせる
+  webrtc::scoped_refptr<webrtc::VideoFrameBuffer> frame_buffer;
+  uint64_t serial = 0;
+  sora_unity_sdk::IdPointer::Instance().With(video_sink_id, [&](void* p) {
+    auto sink = static_cast<sora_unity_sdk::UnityRenderer::Sink*>(p);
+    frame_buffer = sink->GetLatestFrame(downscaled != 0, &serial);
+  });
+  if (frame_buffer == nullptr) {
+    return nullptr;
+  }
+  frame_buffer = sora_unity_sdk::UnityRenderer::Sink::MapFrameBuffer(
+      frame_buffer, serial, frame);
+  if (frame_buffer == nullptr) {
+    return nullptr;
+  }
+  // 参照を持ったまま返して、sora_unlock_video_frame で解放する
+  return (void*)frame_buffer.release();
+}
+void sora_unlock_video_frame(void* handle) {
+  if (handle != nullptr) {
+    ((webrtc::VideoFrameBuffer*)handle)->Release();
+  }
+}
+void sora_retain_video_frame(void* handle) {
+  ((webrtc::VideoFrameBuffer*)handle)->AddRef();
+}
+int sora_add_video_frame_callback(ptrid_t video_sink_id,
+                                  video_frame_cb_t f,
+                                  void* userdata) {
+  int callback_id = 0;
+  sora_unity_sdk::IdPointer::Instance().With(video_sink_id, [&](void* p) {
+    auto sink = static_cast<sora_unity_sdk::UnityRenderer::Sink*>(p);
+    callback_id = sink->AddFrameCallback(f, userdata);
+  });
+  return callback_id;
+}
+void sora_remove_video_frame_callback(ptrid_t video_sink_id,
+                                      int callback_id) {
+  sora_unity_sdk::IdPointer::Instance().With(video_sink_id, [&](void* p) {
+    auto sink = static_cast<sora_unity_sdk::UnityRenderer::Sink*>(p);
+    sink->RemoveFrameCallback(callback_id);
+  });
+}
+void sora_set_video_frame_downscale(ptrid_t video_sink_id,
+                                    int width,
+                                    int height) {
+  sora_unity_sdk::IdPointer::Instance().With(video_sink_id, [&](void* p) {
+    auto sink = static_cast<sora_unity_sdk::UnityRenderer::Sink*>(p);
+    sink->SetDownscale(width, height);
+  });
+}
 int sora_get_render_callback_event_id(void* p) {
   auto wsora = (SoraWrapper*)p;
   return wsora->sora->GetRenderCallbackEventID();
 }
 
+ptrid_t sora_add_video_sink(void* p, void* track) {
+  auto wsora = (SoraWrapper*)p;
+  return wsora->sora->AddVideoSink((webrtc::MediaStreamTrackInterface*)track);
+}
 void* sora_get_video_track_from_video_sink_id(void* p, ptrid_t video_sink_id) {
   auto wsora = (SoraWrapper*)p;
   return wsora->sora->GetVideoTrackFromVideoSinkId(video_sink_id);
@@ -305,6 +660,33 @@ void sora_get_stats(void* p, stats_cb_t f, void* userdata) {
       [f, userdata](std::string json) { f(json.c_str(), userdata); });
 }
 
+void sora_get_filtered_stats(void* p,
+                             const char* filter_json,
+                             filtered_stats_cb_t f,
+                             void* userdata) {
+  auto wsora = (SoraWrapper*)p;
+  auto filter =
+      jsonif::from_json<sora_conf::internal::StatsFilter>(filter_json);
+  wsora->sora->GetFilteredStats(
+      filter, [f, userdata](const sora_unity_sdk::FilteredStats& stats) {
+        f(stats.records.data(), (int)stats.records.size(),
+          stats.values.data(), stats.num_fields, userdata);
+      });
+}
+
+void sora_start_stats_sampler(void* p, int interval_ms) {
+  auto wsora = (SoraWrapper*)p;
+  wsora->sora->StartStatsSampler(interval_ms);
+}
+void sora_stop_stats_sampler(void* p) {
+  auto wsora = (SoraWrapper*)p;
+  wsora->sora->StopStatsSampler();
+}
+int sora_read_stats_samples(void* p, sora_stats_sample_t* buf, int size) {
+  auto wsora = (SoraWrapper*)p;
+  return wsora->sora->ReadStatsSamples(buf, size);
+}
+
 void sora_send_message(void* p, const char* label, void* buf, int size) {
   auto wsora = (SoraWrapper*)p;
   const char* s = (const char*)buf;
@@ -313,26 +695,51 @@ void sora_send_message(void* p, const char* label, void* buf, int size) {
 
 unity_bool_t sora_device_enum_video_capturer(device_enum_cb_t f,
                                              void* userdata) {
-  return sora_unity_sdk::DeviceList::EnumVideoCapturer(
+  return sora_unity_sdk::DeviceRegistry::Instance().Enum(
+      sora_unity_sdk::DeviceKind::kVideoCapturer,
       [f, userdata](std::string device_name, std::string unique_name) {
         f(device_name.c_str(), unique_name.c_str(), userdata);
       });
 }
 unity_bool_t sora_device_enum_audio_recording(device_enum_cb_t f,
                                               void* userdata) {
-  return sora_unity_sdk::DeviceList::EnumAudioRecording(
+  return sora_unity_sdk::DeviceRegistry::Instance().Enum(
+      sora_unity_sdk::DeviceKind::kAudioRecording,
       [f, userdata](std::string device_name, std::string unique_name) {
         f(device_name.c_str(), unique_name.c_str(), userdata);
       });
 }
 unity_bool_t sora_device_enum_audio_playout(device_enum_cb_t f,
                                             void* userdata) {
-  return sora_unity_sdk::DeviceList::EnumAudioPlayout(
+  return sora_unity_sdk::DeviceRegistry::Instance().Enum(
+      sora_unity_sdk::DeviceKind::kAudioPlayout,
       [f, userdata](std::string device_name, std::string unique_name) {
         f(device_name.c_str(), unique_name.c_str(), userdata);
       });
 }
 
+void sora_set_on_device_change(void* p,
+                               device_change_cb_t f,
+                               void* userdata) {
+  auto wsora = (SoraWrapper*)p;
+  if (f == nullptr) {
+    wsora->sora->SetOnDeviceChange(nullptr);
+    return;
+  }
+  wsora->sora->SetOnDeviceChange(
+      [f, userdata](int kind) { f(kind, userdata); });
+}
+
+void sora_refresh_devices() {
+  sora_unity_sdk::DeviceRegistry::Instance().RequestRefresh();
+}
+
+void sora_device_registry_set_fake_devices(const char* json) {
+  auto devices =
+      jsonif::from_json<sora_conf::internal::FakeDevices>(std::string(json));
+  sora_unity_sdk::DeviceRegistry::Instance().SetFakeDevices(devices);
+}
+
 void sora_setenv(const char* name, const char* value) {
 #if defined(SORA_UNITY_SDK_WINDOWS)
   _putenv_s(name, value);
@@ -358,57 +765,22 @@ void sora_set_video_enabled(void* p, unity_bool_t enabled) {
   wsora->sora->SetVideoEnabled(enabled);
 }
 
-// get_*_signaling_url_size() から get_*_signaling_url() までの間に値が変わった場合、
-// 落ちることは無いが、文字列が切り詰められる可能性があるので注意
-int sora_get_selected_signaling_url_size(void* p) {
-  auto wsora = (SoraWrapper*)p;
-  return wsora->sora->GetSelectedSignalingURL().size();
-}
-int sora_get_connected_signaling_url_size(void* p) {
+void* sora_get_selected_signaling_url(void* p) {
   auto wsora = (SoraWrapper*)p;
-  return wsora->sora->GetConnectedSignalingURL().size();
+  return CreateResult(wsora->sora->GetSelectedSignalingURL());
 }
-void sora_get_selected_signaling_url(void* p, void* buf, int size) {
+void* sora_get_connected_signaling_url(void* p) {
   auto wsora = (SoraWrapper*)p;
-  std::string str = wsora->sora->GetSelectedSignalingURL();
-  std::memcpy(buf, str.c_str(), std::min(size, (int)str.size()));
+  return CreateResult(wsora->sora->GetConnectedSignalingURL());
 }
-void sora_get_connected_signaling_url(void* p, void* buf, int size) {
-  auto wsora = (SoraWrapper*)p;
-  std::string str = wsora->sora->GetConnectedSignalingURL();
-  std::memcpy(buf, str.c_str(), std::min(size, (int)str.size()));
+void sora_set_video_codec_capability_cache_file(const char* path) {
+  sora_unity_sdk::VideoCodecCapabilityCache::Instance().SetCacheFile(path);
 }
-static std::optional<sora::VideoCodecCapability> g_video_codec_capability;
-int sora_get_video_codec_capability_size(const char* config) {
+void* sora_get_video_codec_capability(const char* config) {
   auto c = jsonif::from_json<sora_conf::internal::VideoCodecCapabilityConfig>(
       config);
-  auto cc = sora_unity_sdk::ConvertToVideoCodecCapabilityConfigWithSession(c);
-  auto capability = sora::GetVideoCodecCapability(cc);
-  auto vcc = sora_unity_sdk::ConvertToInternalVideoCodecCapability(capability);
-  auto result = jsonif::to_json(vcc);
-  g_video_codec_capability = capability;
-  return (int)result.size();
-}
-void sora_get_video_codec_capability(const char* config, void* buf, int size) {
-  sora::VideoCodecCapability capability;
-  // 今の実装は sora_get_video_codec_capability_size → sora_get_video_codec_capability の順で呼ぶのは確定しているので、
-  // sora_get_video_codec_capability_size で取得した capability を流用する
-  if (g_video_codec_capability) {
-    capability = *g_video_codec_capability;
-    g_video_codec_capability.reset();
-  } else {
-    // 普通に調べる
-    auto c = jsonif::from_json<sora_conf::internal::VideoCodecCapabilityConfig>(
-        config);
-    auto cc = sora_unity_sdk::ConvertToVideoCodecCapabilityConfigWithSession(c);
-    capability = sora::GetVideoCodecCapability(cc);
-  }
-  auto vcc = sora_unity_sdk::ConvertToInternalVideoCodecCapability(capability);
-  auto result = jsonif::to_json(vcc);
-  if (size < (int)result.size()) {
-    return;
-  }
-  std::memcpy(buf, result.c_str(), result.size());
+  return CreateResult(
+      sora_unity_sdk::VideoCodecCapabilityCache::Instance().Get(c));
 }
 unity_bool_t sora_video_codec_preference_has_implementation(
     const char* self,
@@ -421,8 +793,8 @@ unity_bool_t sora_video_codec_preference_has_implementation(
              ? 1
              : 0;
 }
-int sora_video_codec_preference_merge_size(const char* self,
-                                           const char* preference) {
+void* sora_video_codec_preference_merge(const char* self,
+                                        const char* preference) {
   auto selfobj = sora_unity_sdk::ConvertToVideoCodecPreference(
       jsonif::from_json<sora_conf::internal::VideoCodecPreference>(self));
   auto preferenceobj = sora_unity_sdk::ConvertToVideoCodecPreference(
@@ -430,27 +802,9 @@ int sora_video_codec_preference_merge_size(const char* self,
   selfobj.Merge(preferenceobj);
   auto selfinternal =
       sora_unity_sdk::ConvertToInternalVideoCodecPreference(selfobj);
-  auto json = jsonif::to_json(selfinternal);
-  return (int)json.size();
+  return CreateResult(jsonif::to_json(selfinternal));
 }
-void sora_video_codec_preference_merge(const char* self,
-                                       const char* preference,
-                                       void* buf,
-                                       int size) {
-  auto selfobj = sora_unity_sdk::ConvertToVideoCodecPreference(
-      jsonif::from_json<sora_conf::internal::VideoCodecPreference>(self));
-  auto preferenceobj = sora_unity_sdk::ConvertToVideoCodecPreference(
-      jsonif::from_json<sora_conf::internal::VideoCodecPreference>(preference));
-  selfobj.Merge(preferenceobj);
-  auto selfinternal =
-      sora_unity_sdk::ConvertToInternalVideoCodecPreference(selfobj);
-  auto json = jsonif::to_json(selfinternal);
-  if (size < (int)json.size()) {
-    return;
-  }
-  std::memcpy(buf, json.c_str(), json.size());
-}
-int sora_create_video_codec_preference_from_implementation_size(
+void* sora_create_video_codec_preference_from_implementation(
     const char* capability,
     const char* implementation) {
   auto vcc = sora_unity_sdk::ConvertToVideoCodecCapability(
@@ -459,81 +813,29 @@ int sora_create_video_codec_preference_from_implementation_size(
       vcc, boost::json::value_to<sora::VideoCodecImplementation>(
                boost::json::value(implementation)));
   auto rinternal = sora_unity_sdk::ConvertToInternalVideoCodecPreference(r);
-  auto json = jsonif::to_json(rinternal);
-  return (int)json.size();
+  return CreateResult(jsonif::to_json(rinternal));
 }
-void sora_create_video_codec_preference_from_implementation(
-    const char* capability,
-    const char* implementation,
-    void* buf,
-    int size) {
-  auto vcc = sora_unity_sdk::ConvertToVideoCodecCapability(
-      jsonif::from_json<sora_conf::internal::VideoCodecCapability>(capability));
-  auto r = sora::CreateVideoCodecPreferenceFromImplementation(
-      vcc, boost::json::value_to<sora::VideoCodecImplementation>(
-               boost::json::value(implementation)));
-  auto rinternal = sora_unity_sdk::ConvertToInternalVideoCodecPreference(r);
-  auto json = jsonif::to_json(rinternal);
-  if (size < (int)json.size()) {
-    return;
-  }
-  std::memcpy(buf, json.c_str(), json.size());
-}
-int sora_video_codec_capability_to_json_size(const char* self) {
-  auto capability = sora_unity_sdk::ConvertToVideoCodecCapability(
-      jsonif::from_json<sora_conf::internal::VideoCodecCapability>(self));
-  auto json = boost::json::serialize(boost::json::value_from(capability));
-  return (int)json.size();
-}
-void sora_video_codec_capability_to_json(const char* self,
-                                         void* buf,
-                                         int size) {
+void* sora_video_codec_capability_to_json(const char* self) {
   auto capability = sora_unity_sdk::ConvertToVideoCodecCapability(
       jsonif::from_json<sora_conf::internal::VideoCodecCapability>(self));
-  auto json = boost::json::serialize(boost::json::value_from(capability));
-  if (size < (int)json.size()) {
-    return;
-  }
-  std::memcpy(buf, json.c_str(), json.size());
+  return CreateResult(
+      boost::json::serialize(boost::json::value_from(capability)));
 }
-int sora_video_codec_preference_to_json_size(const char* self) {
+void* sora_video_codec_preference_to_json(const char* self) {
   auto preference = sora_unity_sdk::ConvertToVideoCodecPreference(
       jsonif::from_json<sora_conf::internal::VideoCodecPreference>(self));
-  auto json = boost::json::serialize(boost::json::value_from(preference));
-  return (int)json.size();
-}
-void sora_video_codec_preference_to_json(const char* self,
-                                         void* buf,
-                                         int size) {
-  auto preference = sora_unity_sdk::ConvertToVideoCodecPreference(
-      jsonif::from_json<sora_conf::internal::VideoCodecPreference>(self));
-  auto json = boost::json::serialize(boost::json::value_from(preference));
-  if (size < (int)json.size()) {
-    return;
-  }
-  std::memcpy(buf, json.c_str(), json.size());
+  return CreateResult(
+      boost::json::serialize(boost::json::value_from(preference)));
 }
 
 // MediaStreamTrack
-int sora_media_stream_track_get_kind_size(void* p) {
-  auto track = (webrtc::MediaStreamTrackInterface*)p;
-  std::string kind = track->kind();
-  return (int)kind.size();
-}
-void sora_media_stream_track_get_kind(void* p, void* buf, int size) {
-  auto track = (webrtc::MediaStreamTrackInterface*)p;
-  std::string kind = track->kind();
-  std::memcpy(buf, kind.c_str(), std::min(size, (int)kind.size()));
-}
-int sora_media_stream_track_get_id_size(void* p) {
+void* sora_media_stream_track_get_kind(void* p) {
   auto track = (webrtc::MediaStreamTrackInterface*)p;
-  std::string id = track->id();
-  return (int)id.size();
+  return CreateResult(track->kind());
 }
-void sora_media_stream_track_get_id(void* p, void* buf, int size) {
+void* sora_media_stream_track_get_id(void* p) {
   auto track = (webrtc::MediaStreamTrackInterface*)p;
-  std::string id = track->id();
-  std::memcpy(buf, id.c_str(), std::min(size, (int)id.size()));
+  return CreateResult(track->id());
 }
 
 // AudioTrackSink
@@ -624,17 +926,10 @@ static sora_conf::internal::RtpReceiverInfo get_rtp_receiver_info(
   return info;
 }
 }
-int sora_rtp_receiver_get_info_size(void* p) {
-  auto info =
-      get_rtp_receiver_info(static_cast<webrtc::RtpReceiverInterface*>(p));
-  auto json = jsonif::to_json(info);
-  return (int)json.size();
-}
-void sora_rtp_receiver_get_info(void* p, void* buf, int size) {
+void* sora_rtp_receiver_get_info(void* p) {
   auto info =
       get_rtp_receiver_info(static_cast<webrtc::RtpReceiverInterface*>(p));
-  auto json = jsonif::to_json(info);
-  std::memcpy(buf, json.c_str(), std::min(size, (int)json.size()));
+  return CreateResult(jsonif::to_json(info));
 }
 
 struct AudioOutputHelperImpl : public sora::AudioChangeRouteObserver {
@@ -686,6 +981,7 @@ SoraUnitySdk_UnityPluginUnload()
 UnityPluginUnload()
 #endif
 {
+  sora_unity_sdk::DeviceRegistry::Instance().Shutdown();
   sora_unity_sdk::UnityContext::Instance().Shutdown();
 }
 }
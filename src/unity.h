@@ -37,8 +37,35 @@ typedef void (*disconnect_cb_t)(int error_code,
                                 void* userdata);
 typedef void (*data_channel_cb_t)(const char* reason, void* userdata);
 typedef void (*capturer_frame_cb_t)(const char* data, void* userdata);
+typedef void (*add_video_source_cb_t)(int source_id,
+                                      ptrid_t video_sink_id,
+                                      void* userdata);
+typedef void (*switch_camera_cb_t)(unity_bool_t success,
+                                   const char* message,
+                                   void* userdata);
+
+// 文字列を返す関数の結果
+UNITY_INTERFACE_EXPORT const void* sora_result_data(void* result);
+UNITY_INTERFACE_EXPORT int sora_result_size(void* result);
+UNITY_INTERFACE_EXPORT void sora_result_destroy(void* result);
+
+// Unity を使わずにネイティブのホストからプラグインを動かす場合に、
+// UnityPluginLoad/UnityPluginUnload の代わりに呼ぶ。
+// sora_create より前に sora_headless_load を呼んでおくこと。
+// SORA_HEADLESS_RENDERER_OPENGL_CORE の場合、Unity カメラのキャプチャに
+// ホスト側で作成した OpenGL コンテキストを使う。
+enum {
+  SORA_HEADLESS_RENDERER_NULL = 0,
+  SORA_HEADLESS_RENDERER_OPENGL_CORE = 1,
+};
+UNITY_INTERFACE_EXPORT void sora_headless_load(int renderer);
+UNITY_INTERFACE_EXPORT void sora_headless_unload();
 
 UNITY_INTERFACE_EXPORT void* sora_create();
+// グラフィックスデバイスが無い環境（-batchmode -nographics など）でも Sora を作成する。
+// Unity からグラフィックスデバイスが渡されていない場合はダミーのものを使うので、
+// Unity カメラのキャプチャやテクスチャへの描画は利用できない。
+UNITY_INTERFACE_EXPORT void* sora_create_headless();
 UNITY_INTERFACE_EXPORT void sora_set_on_add_track(void* p,
                                                   track_cb_t on_add_track,
                                                   void* userdata);
@@ -76,16 +103,208 @@ UNITY_INTERFACE_EXPORT void sora_set_on_data_channel(
 UNITY_INTERFACE_EXPORT void sora_set_on_capturer_frame(void* p,
                                                        capturer_frame_cb_t f,
                                                        void* userdata);
+UNITY_INTERFACE_EXPORT void sora_set_on_switch_camera(void* p,
+                                                      switch_camera_cb_t f,
+                                                      void* userdata);
+UNITY_INTERFACE_EXPORT void sora_set_on_add_video_source(
+    void* p,
+    add_video_source_cb_t f,
+    void* userdata);
 UNITY_INTERFACE_EXPORT void sora_dispatch_events(void* p);
 UNITY_INTERFACE_EXPORT void sora_connect(void* p, const char* config);
 UNITY_INTERFACE_EXPORT void sora_disconnect(void* p);
+UNITY_INTERFACE_EXPORT void* sora_shared_context_create(const char* config);
+UNITY_INTERFACE_EXPORT void sora_shared_context_destroy(void* shared_context);
+// 共有コンテキストの音量は全ての接続に影響する
+UNITY_INTERFACE_EXPORT unity_bool_t
+sora_shared_context_set_speaker_volume(void* shared_context, double volume);
+UNITY_INTERFACE_EXPORT unity_bool_t
+sora_shared_context_set_microphone_volume(void* shared_context, double volume);
+UNITY_INTERFACE_EXPORT void sora_connect_with_shared_context(
+    void* p,
+    void* shared_context,
+    const char* config);
+
+// sora_prepare の各フェーズにかかった時間（マイクロ秒）
+typedef struct sora_prepare_timings_t {
+  // SoraClientContext（スレッド、PeerConnectionFactory、ADM）の作成
+  int64_t context_us;
+  // ADM の初期化
+  int64_t adm_us;
+  // キャプチャラの作成
+  int64_t capturer_us;
+  // 送信トラックの作成
+  int64_t tracks_us;
+  int64_t total_us;
+} sora_prepare_timings_t;
+UNITY_INTERFACE_EXPORT unity_bool_t sora_prepare(void* p, const char* config);
+UNITY_INTERFACE_EXPORT unity_bool_t
+sora_prepare_with_shared_context(void* p,
+                                 void* shared_context,
+                                 const char* config);
+UNITY_INTERFACE_EXPORT void sora_get_prepare_timings(
+    void* p,
+    sora_prepare_timings_t* timings);
+
+// sora_read_connect_timeline で取得できるイベントの種類
+enum {
+  SORA_TIMELINE_CONNECT_START = 0,
+  SORA_TIMELINE_CONTEXT_CREATED = 1,
+  SORA_TIMELINE_ADM_INITIALIZED = 2,
+  SORA_TIMELINE_CAPTURER_STARTED = 3,
+  // WebSocket の接続を開始した時刻
+  SORA_TIMELINE_SIGNALING_START = 4,
+  SORA_TIMELINE_OFFER_RECEIVED = 5,
+  // ICE と DTLS の接続が完了した時刻
+  SORA_TIMELINE_PEER_CONNECTED = 6,
+  SORA_TIMELINE_FIRST_AUDIO_RTP = 7,
+  SORA_TIMELINE_FIRST_VIDEO_RTP = 8,
+  // 以下は video_sink_id 毎に記録される
+  SORA_TIMELINE_FIRST_FRAME_DECODED = 9,
+  SORA_TIMELINE_FIRST_TEXTURE_UPDATE = 10,
+};
+typedef struct sora_timeline_event_t {
+  int32_t type;
+  // SORA_TIMELINE_FIRST_FRAME_DECODED, SORA_TIMELINE_FIRST_TEXTURE_UPDATE 以外は 0
+  ptrid_t video_sink_id;
+  // 単調増加するクロックでの時刻（マイクロ秒）
+  int64_t timestamp_us;
+} sora_timeline_event_t;
+// 記録したイベントを buf に最大 size 個コピーし、イベントの総数を返す
+UNITY_INTERFACE_EXPORT int sora_read_connect_timeline(
+    void* p,
+    sora_timeline_event_t* buf,
+    int size);
 UNITY_INTERFACE_EXPORT void sora_switch_camera(void* p, const char* config);
+// 接続中に映像ソースを追加する。config は VideoSourceConfig の JSON。
+// 戻り値はソースの ID で、失敗した場合は 0 を返す。
+UNITY_INTERFACE_EXPORT int sora_add_video_source(void* p, const char* config);
+UNITY_INTERFACE_EXPORT unity_bool_t sora_remove_video_source(void* p,
+                                                             int source_id);
+// 送信する映像ソースを切り替える。0 を指定すると接続時の映像に戻す
+UNITY_INTERFACE_EXPORT unity_bool_t
+sora_set_sending_video_source(void* p, int source_id);
+// Unity カメラやテクスチャの内容が変わったことを通知する。0 を指定すると接続時の映像
+UNITY_INTERFACE_EXPORT unity_bool_t
+sora_mark_video_source_dirty(void* p, int source_id);
+// 送信中の映像のエンコードパラメータを変更する。json は VideoEncodingParameters の JSON。
+// 変更は非同期に行われ、再ネゴシエーションは発生しない。
+UNITY_INTERFACE_EXPORT unity_bool_t
+sora_set_video_encoding_parameters(void* p, const char* json);
+// 現在のエンコードパラメータを VideoEncodingParameters の JSON で返す
+UNITY_INTERFACE_EXPORT void* sora_get_video_encoding_parameters(void* p);
+// 受信している映像の描画サイズに合わせて、受信する rid を自動で切り替える。
+// config は ReceiveQualityControllerConfig の JSON。
+// 判定と rid の変更は sora_dispatch_events の中で行う。
+UNITY_INTERFACE_EXPORT void sora_start_receive_quality_controller(
+    void* p,
+    const char* config);
+UNITY_INTERFACE_EXPORT void sora_stop_receive_quality_controller(void* p);
+UNITY_INTERFACE_EXPORT void sora_set_video_sink_hint(void* p,
+                                                     ptrid_t video_sink_id,
+                                                     unity_bool_t visible,
+                                                     unity_bool_t focused);
 UNITY_INTERFACE_EXPORT void* sora_get_texture_update_callback();
 UNITY_INTERFACE_EXPORT void sora_destroy(void* sora);
 
 UNITY_INTERFACE_EXPORT void* sora_get_render_callback();
+
+// 受信した映像をネイティブのテクスチャに直接アップロードする。
+// 登録したテクスチャは sora_get_native_texture_update_callback のイベントで
+// 新しいフレームが来ていた時だけまとめて更新される。
+// 今のところ Ubuntu の OpenGL Core のみ対応していて、それ以外では 0 を返す。
+UNITY_INTERFACE_EXPORT unity_bool_t
+sora_register_native_texture(ptrid_t video_sink_id,
+                             void* native_texture,
+                             int width,
+                             int height);
+UNITY_INTERFACE_EXPORT void sora_unregister_native_texture(
+    ptrid_t video_sink_id,
+    void* native_texture);
+// 1 枚のテクスチャをセルに区切って、複数の受信映像を書き込むアトラスとして登録する。
+// rects は x, y, width, height をセル毎に並べたもので、
+// video_sink_ids[i] の映像が rects[i * 4] から始まる領域に書き込まれる。
+// 同じテクスチャで呼び直した場合はレイアウトを置き換える。
+UNITY_INTERFACE_EXPORT unity_bool_t
+sora_register_native_texture_atlas(void* native_texture,
+                                   int width,
+                                   int height,
+                                   const ptrid_t* video_sink_ids,
+                                   const int* rects,
+                                   int count);
+UNITY_INTERFACE_EXPORT void sora_unregister_native_texture_atlas(
+    void* native_texture);
+// video_sink_id のセルのテクスチャ座標を x, y, width, height の順で uv に書き込む
+UNITY_INTERFACE_EXPORT unity_bool_t
+sora_get_native_texture_atlas_uv(void* native_texture,
+                                 ptrid_t video_sink_id,
+                                 float* uv);
+UNITY_INTERFACE_EXPORT void* sora_get_native_texture_update_callback();
+
+// 受信した映像を CPU から読むために、video_sink_id の最新のフレームを参照する。
+// 成功した場合は frame に各面のポインタを書き込んでハンドルを返し、失敗した場合は NULL を返す。
+// ハンドルを sora_unlock_video_frame に渡すまで、ポインタの指す内容は書き換えられない。
+// I420 と NV12 のフレームはコピーせずにそのまま返し、それ以外は I420 に変換して返す。
+// downscaled を指定した場合は sora_set_video_frame_downscale で指定した大きさに
+// 縮小したフレームを返す。
+enum {
+  SORA_VIDEO_FRAME_FORMAT_I420 = 0,
+  SORA_VIDEO_FRAME_FORMAT_NV12 = 1,
+};
+typedef struct sora_video_frame_t {
+  // 新しいフレームが来るたびに増える
+  uint64_t serial;
+  int32_t width;
+  int32_t height;
+  int32_t format;
+  // I420 の場合は Y, U, V の順で、NV12 の場合は Y, UV の順で data_y と data_u に入る
+  const uint8_t* data_y;
+  const uint8_t* data_u;
+  const uint8_t* data_v;
+  int32_t stride_y;
+  int32_t stride_u;
+  int32_t stride_v;
+} sora_video_frame_t;
+UNITY_INTERFACE_EXPORT void* sora_lock_video_frame(ptrid_t video_sink_id,
+                                                   unity_bool_t downscaled,
+                                                   sora_video_frame_t* frame);
+UNITY_INTERFACE_EXPORT void sora_unlock_video_frame(void* handle);
+// sora_lock_video_frame やフレームのコールバックで受け取ったハンドルの参照を増やす。
+// 増やした参照は sora_unlock_video_frame で解放する。
+UNITY_INTERFACE_EXPORT void sora_retain_video_frame(void* handle);
+
+// 他のネイティブプラグインが C# を経由せずにフレームを受け取るためのコールバック。
+// video_sink_id は受信した映像でも、自分が送信している映像でも良い。
+// f は新しいフレームが来るたびにデコーダ（送信している映像の場合はキャプチャラ）の
+// スレッドから呼ばれる。frame と handle はコールバックの中でだけ有効で、
+// コールバックの後も使う場合は sora_retain_video_frame で参照を増やしておく。
+// 戻り値はコールバックの ID で、失敗した場合は 0 を返す。
+// sora_remove_video_frame_callback から戻った後は f は呼ばれない。
+// f の中から sora_add_video_frame_callback や sora_remove_video_frame_callback を
+// 呼んでも良い。
+// トラックが削除された場合は何もしなくても f は呼ばれなくなる。
+typedef void (*video_frame_cb_t)(const sora_video_frame_t* frame,
+                                 int64_t timestamp_us,
+                                 void* handle,
+                                 void* userdata);
+UNITY_INTERFACE_EXPORT int sora_add_video_frame_callback(ptrid_t video_sink_id,
+                                                         video_frame_cb_t f,
+                                                         void* userdata);
+UNITY_INTERFACE_EXPORT void sora_remove_video_frame_callback(
+    ptrid_t video_sink_id,
+    int callback_id);
+// 新しいフレームが来るたびに、ワーカースレッドで width x height に縮小したフレームを作る。
+// 0 を指定すると縮小を止める。
+UNITY_INTERFACE_EXPORT void sora_set_video_frame_downscale(
+    ptrid_t video_sink_id,
+    int width,
+    int height);
 UNITY_INTERFACE_EXPORT int sora_get_render_callback_event_id(void* p);
 
+// manual_video_sink を指定して接続した場合に、受信した映像のトラックの VideoSink を作る。
+// no_video_decode を指定していた場合は、ここからデコードを始める。
+// 既に作っている場合はその VideoSinkId を返し、失敗した場合は 0 を返す。
+UNITY_INTERFACE_EXPORT ptrid_t sora_add_video_sink(void* p, void* track);
 UNITY_INTERFACE_EXPORT void* sora_get_video_track_from_video_sink_id(
     void* p,
     ptrid_t video_sink_id);
@@ -114,6 +333,47 @@ UNITY_INTERFACE_EXPORT void sora_get_stats(void* p,
                                            stats_cb_t f,
                                            void* userdata);
 
+// sora_get_filtered_stats で返される統計情報の１レコード分のヘッダ
+typedef struct sora_stats_record_t {
+  // StatsFilter.types のインデックス（types が空の場合は常に 0）
+  int32_t type;
+  // ssrc を持たない統計情報の場合は 0
+  uint32_t ssrc;
+  int64_t timestamp_us;
+} sora_stats_record_t;
+// values は num_records * num_fields 個の行優先の配列で、
+// 値が存在しないフィールドは NaN になる
+typedef void (*filtered_stats_cb_t)(const sora_stats_record_t* records,
+                                    int num_records,
+                                    const double* values,
+                                    int num_fields,
+                                    void* userdata);
+UNITY_INTERFACE_EXPORT void sora_get_filtered_stats(void* p,
+                                                    const char* filter,
+                                                    filtered_stats_cb_t f,
+                                                    void* userdata);
+
+// sora_start_stats_sampler で定期的に計算される、送受信ストリーム毎の値
+// 前回のサンプルとの差分から計算できない値は NaN になる
+typedef struct sora_stats_sample_t {
+  int64_t timestamp_us;
+  double bitrate_bps;
+  double framerate;
+  double packet_loss_percent;
+  // 受信ストリームのみ
+  double jitter_buffer_delay_ms;
+  uint32_t ssrc;
+  // 0: audio, 1: video
+  int32_t kind;
+  // 0: inbound, 1: outbound
+  int32_t direction;
+} sora_stats_sample_t;
+UNITY_INTERFACE_EXPORT void sora_start_stats_sampler(void* p, int interval_ms);
+UNITY_INTERFACE_EXPORT void sora_stop_stats_sampler(void* p);
+UNITY_INTERFACE_EXPORT int sora_read_stats_samples(void* p,
+                                                   sora_stats_sample_t* buf,
+                                                   int size);
+
 UNITY_INTERFACE_EXPORT void sora_send_message(void* p,
                                               const char* label,
                                               void* buf,
@@ -128,6 +388,25 @@ UNITY_INTERFACE_EXPORT unity_bool_t
 sora_device_enum_audio_recording(device_enum_cb_t f, void* userdata);
 UNITY_INTERFACE_EXPORT unity_bool_t
 sora_device_enum_audio_playout(device_enum_cb_t f, void* userdata);
+// sora_set_on_device_change でコールバックを設定している間は、OS のデバイスの抜き差しの通知を受け取り、
+// デバイスの一覧はキャッシュされて、通知があった時だけバックグラウンドで更新される。
+// 変化があった場合は sora_set_on_device_change で設定したコールバックが
+// sora_dispatch_events のタイミングで呼ばれる。
+enum {
+  SORA_DEVICE_KIND_VIDEO_CAPTURER = 0,
+  SORA_DEVICE_KIND_AUDIO_RECORDING = 1,
+  SORA_DEVICE_KIND_AUDIO_PLAYOUT = 2,
+};
+typedef void (*device_change_cb_t)(int kind, void* userdata);
+UNITY_INTERFACE_EXPORT void sora_set_on_device_change(void* p,
+                                                      device_change_cb_t f,
+                                                      void* userdata);
+// OS の通知を受け取れないプラットフォーム (Android) 向けに、
+// デバイスを列挙し直して変化があれば通知する
+UNITY_INTERFACE_EXPORT void sora_refresh_devices();
+// 実際のデバイスの代わりに、JSON (FakeDevices) で指定したデバイスを列挙するようにする
+UNITY_INTERFACE_EXPORT void sora_device_registry_set_fake_devices(
+    const char* json);
 UNITY_INTERFACE_EXPORT void sora_setenv(const char* name, const char* value);
 
 UNITY_INTERFACE_EXPORT unity_bool_t sora_get_audio_enabled(void* p);
@@ -137,58 +416,33 @@ UNITY_INTERFACE_EXPORT unity_bool_t sora_get_video_enabled(void* p);
 UNITY_INTERFACE_EXPORT void sora_set_video_enabled(void* p,
                                                    unity_bool_t enabled);
 
-UNITY_INTERFACE_EXPORT int sora_get_selected_signaling_url_size(void* p);
-UNITY_INTERFACE_EXPORT int sora_get_connected_signaling_url_size(void* p);
-UNITY_INTERFACE_EXPORT void sora_get_selected_signaling_url(void* p,
-                                                            void* buf,
-                                                            int size);
-UNITY_INTERFACE_EXPORT void sora_get_connected_signaling_url(void* p,
-                                                             void* buf,
-                                                             int size);
-UNITY_INTERFACE_EXPORT int sora_get_video_codec_capability_size(
+// 以下の文字列を返す関数は、結果を sora_result_data/sora_result_size で取り出し、
+// sora_result_destroy で破棄すること
+UNITY_INTERFACE_EXPORT void* sora_get_selected_signaling_url(void* p);
+UNITY_INTERFACE_EXPORT void* sora_get_connected_signaling_url(void* p);
+// 指定したファイルにビデオコーデックの対応状況をキャッシュし、次回起動時に利用する
+UNITY_INTERFACE_EXPORT void sora_set_video_codec_capability_cache_file(
+    const char* path);
+UNITY_INTERFACE_EXPORT void* sora_get_video_codec_capability(
     const char* config);
-UNITY_INTERFACE_EXPORT void sora_get_video_codec_capability(const char* config,
-                                                            void* buf,
-                                                            int size);
 UNITY_INTERFACE_EXPORT unity_bool_t
 sora_video_codec_preference_has_implementation(const char* self,
                                                const char* implementation);
-UNITY_INTERFACE_EXPORT int sora_video_codec_preference_merge_size(
+UNITY_INTERFACE_EXPORT void* sora_video_codec_preference_merge(
     const char* self,
     const char* preference);
-UNITY_INTERFACE_EXPORT void sora_video_codec_preference_merge(
-    const char* self,
-    const char* preference,
-    void* buf,
-    int size);
-UNITY_INTERFACE_EXPORT int
-sora_create_video_codec_preference_from_implementation_size(
-    const char* capability,
-    const char* implementation);
-UNITY_INTERFACE_EXPORT void
+UNITY_INTERFACE_EXPORT void*
 sora_create_video_codec_preference_from_implementation(
     const char* capability,
-    const char* implementation,
-    void* buf,
-    int size);
-UNITY_INTERFACE_EXPORT int sora_video_codec_capability_to_json_size(
+    const char* implementation);
+UNITY_INTERFACE_EXPORT void* sora_video_codec_capability_to_json(
     const char* self);
-UNITY_INTERFACE_EXPORT void
-sora_video_codec_capability_to_json(const char* self, void* buf, int size);
-UNITY_INTERFACE_EXPORT int sora_video_codec_preference_to_json_size(
+UNITY_INTERFACE_EXPORT void* sora_video_codec_preference_to_json(
     const char* self);
-UNITY_INTERFACE_EXPORT void
-sora_video_codec_preference_to_json(const char* self, void* buf, int size);
 
 // MediaStreamTrack
-UNITY_INTERFACE_EXPORT int sora_media_stream_track_get_kind_size(void* p);
-UNITY_INTERFACE_EXPORT void sora_media_stream_track_get_kind(void* p,
-                                                             void* buf,
-                                                             int size);
-UNITY_INTERFACE_EXPORT int sora_media_stream_track_get_id_size(void* p);
-UNITY_INTERFACE_EXPORT void sora_media_stream_track_get_id(void* p,
-                                                           void* buf,
-                                                           int size);
+UNITY_INTERFACE_EXPORT void* sora_media_stream_track_get_kind(void* p);
+UNITY_INTERFACE_EXPORT void* sora_media_stream_track_get_id(void* p);
 
 // AudioTrackSink
 typedef void (*audio_track_sink_on_data_cb_t)(
@@ -217,10 +471,7 @@ UNITY_INTERFACE_EXPORT void sora_audio_track_set_volume(void* track,
 UNITY_INTERFACE_EXPORT void* sora_rtp_transceiver_get_receiver(void* p);
 
 // RtpReceiver
-UNITY_INTERFACE_EXPORT int sora_rtp_receiver_get_info_size(void* p);
-UNITY_INTERFACE_EXPORT void sora_rtp_receiver_get_info(void* p,
-                                                       void* buf,
-                                                       int size);
+UNITY_INTERFACE_EXPORT void* sora_rtp_receiver_get_info(void* p);
 
 typedef void (*change_route_cb_t)(void* userdata);
 UNITY_INTERFACE_EXPORT void* sora_audio_output_helper_create(
@@ -4,7 +4,10 @@ namespace sora_unity_sdk {
 
 UnityCameraCapturer::UnityCameraCapturer(
     const UnityCameraCapturerConfig& config)
-    : sora::ScalableVideoTrackSource(config) {}
+    : sora::ScalableVideoTrackSource(config),
+      capture_on_mark_dirty_(config.capture_on_mark_dirty),
+      keepalive_interval_us_((int64_t)config.keepalive_interval_ms * 1000),
+      dirty_serial_(1) {}
 
 webrtc::scoped_refptr<UnityCameraCapturer> UnityCameraCapturer::Create(
     const UnityCameraCapturerConfig& config) {
@@ -17,6 +20,26 @@ webrtc::scoped_refptr<UnityCameraCapturer> UnityCameraCapturer::Create(
   return p;
 }
 
+webrtc::scoped_refptr<webrtc::I420Buffer>
+UnityCameraCapturer::Impl::ConvertToI420(const uint8_t* data,
+                                         int stride,
+                                         int width,
+                                         int height,
+                                         bool abgr) {
+  int abs_height = height < 0 ? -height : height;
+  webrtc::scoped_refptr<webrtc::I420Buffer> i420_buffer =
+      pool_.CreateI420Buffer(width, abs_height);
+  if (i420_buffer == nullptr) {
+    RTC_LOG(LS_WARNING) << "No I420 buffer available in the pool";
+    return nullptr;
+  }
+  auto convert = abgr ? libyuv::ABGRToI420 : libyuv::ARGBToI420;
+  convert(data, stride, i420_buffer->MutableDataY(), i420_buffer->StrideY(),
+          i420_buffer->MutableDataU(), i420_buffer->StrideU(),
+          i420_buffer->MutableDataV(), i420_buffer->StrideV(), width, height);
+  return i420_buffer;
+}
+
 void UnityCameraCapturer::OnRender() {
   std::lock_guard<std::mutex> guard(mutex_);
   if (stopped_) {
@@ -26,15 +49,38 @@ void UnityCameraCapturer::OnRender() {
 #if defined(SORA_UNITY_SDK_WINDOWS) || defined(SORA_UNITY_SDK_MACOS) || \
     defined(SORA_UNITY_SDK_IOS) || defined(SORA_UNITY_SDK_ANDROID) ||   \
     defined(SORA_UNITY_SDK_UBUNTU)
-  auto i420_buffer = capturer_->Capture();
-  if (!i420_buffer) {
-    return;
+  int64_t now_us = clock_->TimeInMicroseconds();
+  webrtc::scoped_refptr<webrtc::I420Buffer> i420_buffer;
+  uint64_t serial =
+      capture_on_mark_dirty_ ? dirty_serial_.load() : ++render_serial_;
+  if (serial <= sent_serial_) {
+    // 内容が変わっていないので読み出しも変換もせず、
+    // 一定間隔で前回の映像を送り直すだけにする
+    if (last_buffer_ == nullptr ||
+        now_us - last_frame_us_ < keepalive_interval_us_) {
+      return;
+    }
+    i420_buffer = last_buffer_;
+  } else {
+    // 読み出しが非同期なバックエンドは結果が出るまで数フレームかかるので、
+    // MarkDirty() の後にコピーした内容が取れるまで読み出しを続ける。
+    // それより前の内容が取れた場合も、新しい映像なので送っておく
+    uint64_t captured_serial = 0;
+    i420_buffer = capturer_->Capture(serial, &captured_serial);
+    if (!i420_buffer || captured_serial <= sent_serial_) {
+      return;
+    }
+    sent_serial_ = captured_serial;
+    if (capture_on_mark_dirty_) {
+      last_buffer_ = i420_buffer;
+    }
   }
+  last_frame_us_ = now_us;
 
   auto video_frame = webrtc::VideoFrame::Builder()
                          .set_video_frame_buffer(i420_buffer)
                          .set_rotation(webrtc::kVideoRotation_0)
-                         .set_timestamp_us(clock_->TimeInMicroseconds())
+                         .set_timestamp_us(now_us)
                          .build();
   this->OnFrame(video_frame);
 #endif
@@ -44,11 +90,21 @@ void UnityCameraCapturer::OnFrame(const webrtc::VideoFrame& frame) {
   OnCapturedFrame(frame);
 }
 
+void UnityCameraCapturer::MarkDirty() {
+  dirty_serial_++;
+}
+
 void UnityCameraCapturer::Stop() {
   std::lock_guard<std::mutex> guard(mutex_);
   stopped_ = true;
 }
 
+void UnityCameraCapturer::ReleaseRetiredResources(UnityContext* context) {
+#if defined(SORA_UNITY_SDK_ANDROID) || defined(SORA_UNITY_SDK_UBUNTU)
+  VulkanImpl::ReleaseRetired(context);
+#endif
+}
+
 bool UnityCameraCapturer::Init(UnityContext* context,
                                void* unity_camera_texture,
                                int width,
@@ -78,7 +134,7 @@ bool UnityCameraCapturer::Init(UnityContext* context,
 #endif
       break;
     case kUnityGfxRendererVulkan:
-#ifdef SORA_UNITY_SDK_ANDROID
+#if defined(SORA_UNITY_SDK_ANDROID) || defined(SORA_UNITY_SDK_UBUNTU)
       RTC_LOG(LS_INFO) << "Init UnityCameraCapturer with VulkanImpl";
       capturer_.reset(new VulkanImpl());
 #endif
@@ -1,10 +1,15 @@
 #ifndef SORA_UNITY_SDK_UNITY_CAMERA_CAPTURER_H_INCLUDED
 #define SORA_UNITY_SDK_UNITY_CAMERA_CAPTURER_H_INCLUDED
 
+#include <atomic>
+#include <mutex>
+#include <vector>
+
 // WebRTC
 #include <api/media_stream_interface.h>
 #include <api/scoped_refptr.h>
 #include <api/video/i420_buffer.h>
+#include <common_video/include/video_frame_buffer_pool.h>
 #include <libyuv.h>
 #include <rtc_base/logging.h>
 #include <rtc_base/ref_counted_object.h>
@@ -15,7 +20,7 @@
 
 #include "unity_context.h"
 
-#ifdef SORA_UNITY_SDK_ANDROID
+#if defined(SORA_UNITY_SDK_ANDROID) || defined(SORA_UNITY_SDK_UBUNTU)
 #include <vulkan/vulkan.h>
 #endif
 
@@ -26,6 +31,10 @@ struct UnityCameraCapturerConfig : sora::ScalableVideoTrackSourceConfig {
   void* unity_camera_texture;
   int width;
   int height;
+  // true の場合、MarkDirty() が呼ばれた時だけテクスチャを読み出す。
+  // それ以外のフレームでは、keepalive_interval_ms 毎に前回の映像を送り直す。
+  bool capture_on_mark_dirty = false;
+  int keepalive_interval_ms = 1000;
 };
 
 class UnityCameraCapturer
@@ -39,7 +48,29 @@ class UnityCameraCapturer
                       void* camera_texture,
                       int width,
                       int height) = 0;
-    virtual webrtc::scoped_refptr<webrtc::I420Buffer> Capture() = 0;
+    // serial はテクスチャの内容を表す番号で、内容が変わるたびに増える。
+    // バッファを返した場合は、それが何番の内容かを captured_serial に設定する。
+    // 読み出しが非同期なバックエンドは、同じ番号のコピーを重ねて積まない。
+    virtual webrtc::scoped_refptr<webrtc::I420Buffer> Capture(
+        uint64_t serial,
+        uint64_t* captured_serial) = 0;
+
+   protected:
+    // 1 ピクセル 32bit のデータを、コピーせずにそのまま I420 に変換する。
+    // height に負の値を指定すると上下反転しながら変換する。
+    // abgr が true の場合はメモリ上で R, G, B, A の順、false の場合は B, G, R, A の順。
+    // 変換先のバッファはプールから取るので、毎フレームのメモリ確保は発生しない。
+    webrtc::scoped_refptr<webrtc::I420Buffer> ConvertToI420(
+        const uint8_t* data,
+        int stride,
+        int width,
+        int height,
+        bool abgr);
+
+   private:
+    // エンコーダがフレームを持っている間は再利用できないので、少し余裕を持たせておく
+    static constexpr size_t kMaxPooledBuffers = 8;
+    webrtc::VideoFrameBufferPool pool_{false, kMaxPooledBuffers};
   };
 
 #ifdef SORA_UNITY_SDK_WINDOWS
@@ -55,7 +86,9 @@ class UnityCameraCapturer
               void* camera_texture,
               int width,
               int height) override;
-    webrtc::scoped_refptr<webrtc::I420Buffer> Capture() override;
+    webrtc::scoped_refptr<webrtc::I420Buffer> Capture(
+        uint64_t serial,
+        uint64_t* captured_serial) override;
   };
 
   class D3D12Impl : public Impl {
@@ -81,7 +114,9 @@ class UnityCameraCapturer
               void* camera_texture,
               int width,
               int height) override;
-    webrtc::scoped_refptr<webrtc::I420Buffer> Capture() override;
+    webrtc::scoped_refptr<webrtc::I420Buffer> Capture(
+        uint64_t serial,
+        uint64_t* captured_serial) override;
   };
 #endif
 
@@ -92,33 +127,98 @@ class UnityCameraCapturer
     void* frame_texture_;
     int width_;
     int height_;
+    std::unique_ptr<uint8_t[]> buf_;
 
    public:
     bool Init(UnityContext* context,
               void* camera_texture,
               int width,
               int height) override;
-    webrtc::scoped_refptr<webrtc::I420Buffer> Capture() override;
+    webrtc::scoped_refptr<webrtc::I420Buffer> Capture(
+        uint64_t serial,
+        uint64_t* captured_serial) override;
   };
 #endif
 
-#ifdef SORA_UNITY_SDK_ANDROID
+#if defined(SORA_UNITY_SDK_ANDROID) || defined(SORA_UNITY_SDK_UBUNTU)
+  // Unity のコマンドバッファにテクスチャからバッファへのコピーを積み、
+  // GPU の処理が終わったバッファから順に I420 に変換する。
+  // 読み出しを待たないので、送信される映像は数フレーム遅れる。
+  // GPU が無い環境では、VK_ICD_FILENAMES で Mesa の lavapipe を指定して
+  // Unity を -force-vulkan で起動すれば動作を確認できる。
   class VulkanImpl : public Impl {
-    UnityContext* context_;
-    void* camera_texture_;
-    VkImage image_ = VK_NULL_HANDLE;
-    VkDeviceMemory memory_ = VK_NULL_HANDLE;
-    VkCommandPool pool_ = VK_NULL_HANDLE;
-    int width_;
-    int height_;
+    // Ubuntu では libvulkan をリンクしないので、
+    // 関数は Unity が使っている Vulkan ローダから取得する
+    struct Functions {
+      PFN_vkGetPhysicalDeviceMemoryProperties
+          GetPhysicalDeviceMemoryProperties = nullptr;
+      PFN_vkCreateBuffer CreateBuffer = nullptr;
+      PFN_vkDestroyBuffer DestroyBuffer = nullptr;
+      PFN_vkGetBufferMemoryRequirements GetBufferMemoryRequirements = nullptr;
+      PFN_vkAllocateMemory AllocateMemory = nullptr;
+      PFN_vkFreeMemory FreeMemory = nullptr;
+      PFN_vkBindBufferMemory BindBufferMemory = nullptr;
+      PFN_vkMapMemory MapMemory = nullptr;
+      PFN_vkUnmapMemory UnmapMemory = nullptr;
+      PFN_vkInvalidateMappedMemoryRanges InvalidateMappedMemoryRanges =
+          nullptr;
+      PFN_vkCmdCopyImageToBuffer CmdCopyImageToBuffer = nullptr;
+      PFN_vkCmdPipelineBarrier CmdPipelineBarrier = nullptr;
+    };
+
+    struct Slot {
+      VkBuffer buffer = VK_NULL_HANDLE;
+      VkDeviceMemory memory = VK_NULL_HANDLE;
+      uint8_t* mapped = nullptr;
+      VkFormat format = VK_FORMAT_UNDEFINED;
+      // コピーを積んだ Unity のフレーム番号。
+      // UnityVulkanRecordingState::safeFrameNumber がこれ以上になれば読み出せる
+      unsigned long long frame_number = 0;
+      // コピーした時のテクスチャの内容の番号
+      uint64_t serial = 0;
+      bool pending = false;
+    };
+    static constexpr int kRingSize = 3;
+
+    UnityContext* context_ = nullptr;
+    void* camera_texture_ = nullptr;
+    int width_ = 0;
+    int height_ = 0;
+    VkDevice device_ = VK_NULL_HANDLE;
+    Functions vk_;
+    Slot slots_[kRingSize];
+    bool coherent_ = false;
+    int write_index_ = 0;
+    int read_index_ = 0;
+    // 最後にコピーを積んだテクスチャの内容の番号
+    uint64_t recorded_serial_ = 0;
+
+    // 破棄した時点でコピーが GPU で処理中かもしれないバッファ。
+    // Unity のコマンドバッファに積んだコピーは後から実行されるので、
+    // safeFrameNumber が frame_number を越えるまでレンダースレッドで解放を待つ
+    struct Retired {
+      VkDevice device;
+      Functions vk;
+      std::vector<Slot> slots;
+      unsigned long long frame_number;
+    };
+    static std::mutex retired_mutex_;
+    static std::vector<Retired> retired_;
+
+    webrtc::scoped_refptr<webrtc::I420Buffer> Read(Slot& slot);
+    static void DestroySlot(VkDevice device, const Functions& vk, Slot& slot);
 
    public:
     ~VulkanImpl() override;
+    // レンダースレッドから呼ぶこと
+    static void ReleaseRetired(UnityContext* context);
     bool Init(UnityContext* context,
               void* camera_texture,
               int width,
               int height) override;
-    webrtc::scoped_refptr<webrtc::I420Buffer> Capture() override;
+    webrtc::scoped_refptr<webrtc::I420Buffer> Capture(
+        uint64_t serial,
+        uint64_t* captured_serial) override;
   };
 #endif
 
@@ -130,6 +230,7 @@ class UnityCameraCapturer
     int height_;
     unsigned int fbo_ = 0;
     bool initialized_ = false;
+    std::unique_ptr<uint8_t[]> buf_;
 
    public:
     ~OpenglImpl() override;
@@ -137,7 +238,9 @@ class UnityCameraCapturer
               void* camera_texture,
               int width,
               int height) override;
-    webrtc::scoped_refptr<webrtc::I420Buffer> Capture() override;
+    webrtc::scoped_refptr<webrtc::I420Buffer> Capture(
+        uint64_t serial,
+        uint64_t* captured_serial) override;
   };
 #endif
 
@@ -145,6 +248,18 @@ class UnityCameraCapturer
   std::mutex mutex_;
   bool stopped_ = false;
 
+  bool capture_on_mark_dirty_;
+  int64_t keepalive_interval_us_;
+  // MarkDirty() のたびに増える、テクスチャの内容の番号
+  std::atomic<uint64_t> dirty_serial_;
+  // 以下は OnRender() を呼ぶスレッドだけが触る
+  // capture_on_mark_dirty が false の場合に、OnRender() のたびに増える番号
+  uint64_t render_serial_ = 0;
+  // 最後に送った映像の内容の番号
+  uint64_t sent_serial_ = 0;
+  webrtc::scoped_refptr<webrtc::I420Buffer> last_buffer_;
+  int64_t last_frame_us_ = 0;
+
  public:
   static webrtc::scoped_refptr<UnityCameraCapturer> Create(
       const UnityCameraCapturerConfig& config);
@@ -153,8 +268,16 @@ class UnityCameraCapturer
 
   void OnRender();
 
+  // テクスチャの内容が変わったことを通知する。
+  // capture_on_mark_dirty が true の場合、次の OnRender() でテクスチャを読み出す。
+  void MarkDirty();
+
   void Stop();
 
+  // 破棄したキャプチャラのうち、GPU の処理が終わったリソースを解放する。
+  // レンダースレッドから呼ぶこと
+  static void ReleaseRetiredResources(UnityContext* context);
+
   void OnFrame(const webrtc::VideoFrame& frame) override;
 
  private:
@@ -39,7 +39,9 @@ bool UnityCameraCapturer::D3D11Impl::Init(UnityContext* context,
 }
 
 webrtc::scoped_refptr<webrtc::I420Buffer>
-UnityCameraCapturer::D3D11Impl::Capture() {
+UnityCameraCapturer::D3D11Impl::Capture(uint64_t serial,
+                                        uint64_t* captured_serial) {
+  *captured_serial = serial;
   D3D11_MAPPED_SUBRESOURCE resource;
 
   auto dc = context_->GetD3D11DeviceContext();
@@ -59,32 +61,11 @@ UnityCameraCapturer::D3D11Impl::Capture() {
     return nullptr;
   }
 
-  // Windows の場合は座標系の関係で上下反転してるので、頑張って元の向きに戻す
-  // TODO(melpon): Graphics.Blit を使って効率よく反転させる
-  // (ref: https://github.com/Unity-Technologies/com.unity.webrtc/blob/a526753e0c18d681d20f3eb9878b9c28442e2bfb/Runtime/Scripts/WebRTC.cs#L264-L268)
-  std::unique_ptr<uint8_t[]> buf(new uint8_t[width_ * height_ * 4]);
-  for (int i = 0; i < height_; i++) {
-    std::memcpy(buf.get() + width_ * 4 * i,
-                ((const uint8_t*)resource.pData) +
-                    resource.RowPitch * (height_ - i - 1),
-                width_ * 4);
-  }
-
-  // I420 に変換して VideoFrame 作って OnFrame 呼び出し
-  //RTC_LOG(LS_INFO) << "GOT FRAME: pData=0x" << resource.pData
-  //                 << " RowPitch=" << resource.RowPitch
-  //                 << " DepthPitch=" << resource.DepthPitch;
-  webrtc::scoped_refptr<webrtc::I420Buffer> i420_buffer =
-      webrtc::I420Buffer::Create(width_, height_);
-  //libyuv::ARGBToI420((const uint8_t*)resource.pData, resource.RowPitch,
-  //                   i420_buffer->MutableDataY(), i420_buffer->StrideY(),
-  //                   i420_buffer->MutableDataU(), i420_buffer->StrideU(),
-  //                   i420_buffer->MutableDataV(), i420_buffer->StrideV(),
-  //                   width_, height_);
-  libyuv::ARGBToI420(buf.get(), width_ * 4, i420_buffer->MutableDataY(),
-                     i420_buffer->StrideY(), i420_buffer->MutableDataU(),
-                     i420_buffer->StrideU(), i420_buffer->MutableDataV(),
-                     i420_buffer->StrideV(), width_, height_);
+  // Windows の場合は座標系の関係で上下反転してるので、
+  // 高さを負の値にして反転しながらマップしたメモリから直接変換する
+  auto i420_buffer =
+      ConvertToI420((const uint8_t*)resource.pData, resource.RowPitch, width_,
+                    -height_, false);
 
   dc->Unmap((ID3D11Resource*)frame_texture_, 0);
 
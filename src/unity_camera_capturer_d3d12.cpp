@@ -134,7 +134,9 @@ bool UnityCameraCapturer::D3D12Impl::Init(UnityContext* context,
 }
 
 webrtc::scoped_refptr<webrtc::I420Buffer>
-UnityCameraCapturer::D3D12Impl::Capture() {
+UnityCameraCapturer::D3D12Impl::Capture(uint64_t serial,
+                                        uint64_t* captured_serial) {
+  *captured_serial = serial;
   // コマンドリストの準備
   cmd_allocator_->Reset();
   cmd_list_->Reset(cmd_allocator_, nullptr);
@@ -203,22 +205,11 @@ UnityCameraCapturer::D3D12Impl::Capture() {
     return nullptr;
   }
 
-  // Windows の場合は座標系の関係で上下反転してるので、頑張って元の向きに戻す
-  std::unique_ptr<uint8_t[]> buf(new uint8_t[width_ * height_ * 4]);
-  const uint8_t* base = static_cast<const uint8_t*>(data);
-  const size_t pitch = readback_buffer_row_pitch_;
-  for (int y = 0; y < height_; ++y) {
-    const uint8_t* row = base + pitch * (height_ - 1 - y);
-    std::memcpy(buf.get() + width_ * 4 * y, row, width_ * 4);
-  }
-
-  // ARGB -> I420 変換
-  webrtc::scoped_refptr<webrtc::I420Buffer> i420_buffer =
-      webrtc::I420Buffer::Create(width_, height_);
-  libyuv::ARGBToI420(buf.get(), width_ * 4, i420_buffer->MutableDataY(),
-                     i420_buffer->StrideY(), i420_buffer->MutableDataU(),
-                     i420_buffer->StrideU(), i420_buffer->MutableDataV(),
-                     i420_buffer->StrideV(), width_, height_);
+  // Windows の場合は座標系の関係で上下反転してるので、
+  // 高さを負の値にして反転しながらマップしたメモリから直接変換する
+  auto i420_buffer =
+      ConvertToI420(static_cast<const uint8_t*>(data),
+                    (int)readback_buffer_row_pitch_, width_, -height_, false);
 
   // writeback するデータは無いので空範囲を指定する
   const D3D12_RANGE written_range = {0, 0};
@@ -59,7 +59,9 @@ bool UnityCameraCapturer::MetalImpl::Init(UnityContext* context,
 }
 
 webrtc::scoped_refptr<webrtc::I420Buffer>
-UnityCameraCapturer::MetalImpl::Capture() {
+UnityCameraCapturer::MetalImpl::Capture(uint64_t serial,
+                                        uint64_t* captured_serial) {
+  *captured_serial = serial;
   auto camera_tex = (id<MTLTexture>)camera_texture_;
   auto tex = (id<MTLTexture>)frame_texture_;
   auto graphics = context_->GetInterfaces()->Get<IUnityGraphicsMetal>();
@@ -88,26 +90,19 @@ UnityCameraCapturer::MetalImpl::Capture() {
   [blit endEncoding];
   blit = nil;
 
-  std::unique_ptr<uint8_t[]> buf(new uint8_t[width_ * height_ * 4]);
+  // 読み出し先は使い回す
+  if (buf_ == nullptr) {
+    buf_.reset(new uint8_t[width_ * height_ * 4]);
+  }
   auto region = MTLRegionMake2D(0, 0, width_, height_);
-  [tex getBytes:buf.get()
+  [tex getBytes:buf_.get()
       bytesPerRow:width_ * 4
        fromRegion:region
       mipmapLevel:0];
 
-  // Metal の場合は座標系の関係で上下反転してるので、頑張って元の向きに戻す
-  std::unique_ptr<uint8_t[]> buf2(new uint8_t[width_ * height_ * 4]);
-  for (int i = 0; i < height_; i++) {
-    std::memcpy(buf2.get() + width_ * 4 * i,
-                buf.get() + width_ * 4 * (height_ - i - 1), width_ * 4);
-  }
-
-  webrtc::scoped_refptr<webrtc::I420Buffer> i420_buffer =
-      webrtc::I420Buffer::Create(width_, height_);
-  libyuv::ARGBToI420(buf2.get(), width_ * 4, i420_buffer->MutableDataY(),
-                     i420_buffer->StrideY(), i420_buffer->MutableDataU(),
-                     i420_buffer->StrideU(), i420_buffer->MutableDataV(),
-                     i420_buffer->StrideV(), width_, height_);
+  // Metal の場合は座標系の関係で上下反転してるので、高さを負の値にして反転しながら変換する
+  auto i420_buffer =
+      ConvertToI420(buf_.get(), width_ * 4, width_, -height_, false);
 
   return i420_buffer;
 }
@@ -40,7 +40,9 @@ bool UnityCameraCapturer::OpenglImpl::Init(UnityContext* context,
 #define GL_ERRCHECK(name) GL_ERRCHECK_(name, nullptr)
 
 webrtc::scoped_refptr<webrtc::I420Buffer>
-UnityCameraCapturer::OpenglImpl::Capture() {
+UnityCameraCapturer::OpenglImpl::Capture(uint64_t serial,
+                                         uint64_t* captured_serial) {
+  *captured_serial = serial;
   // Init 関数とは別のスレッドから呼ばれることがあるので、
   // ここに初期化処理を入れる
   if (!initialized_) {
@@ -60,26 +62,16 @@ UnityCameraCapturer::OpenglImpl::Capture() {
   glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
   GL_ERRCHECK("glBindFramebuffer");
 
-  std::unique_ptr<uint8_t[]> buf(new uint8_t[width_ * height_ * 4]());
-
-  glReadPixels(0, 0, width_, height_, GL_RGBA, GL_UNSIGNED_BYTE, buf.get());
-  GL_ERRCHECK("glReadPixels");
-
-  // OpenGL の座標は上下反転してるので、頑張って元の向きに戻す
-  std::unique_ptr<uint8_t[]> buf2(new uint8_t[width_ * height_ * 4]);
-  for (int i = 0; i < height_; i++) {
-    std::memcpy(buf2.get() + width_ * 4 * i,
-                buf.get() + width_ * 4 * (height_ - i - 1), width_ * 4);
+  // 読み出し先は使い回す
+  if (buf_ == nullptr) {
+    buf_.reset(new uint8_t[width_ * height_ * 4]());
   }
 
-  webrtc::scoped_refptr<webrtc::I420Buffer> i420_buffer =
-      webrtc::I420Buffer::Create(width_, height_);
-  libyuv::ABGRToI420(buf2.get(), width_ * 4, i420_buffer->MutableDataY(),
-                     i420_buffer->StrideY(), i420_buffer->MutableDataU(),
-                     i420_buffer->StrideU(), i420_buffer->MutableDataV(),
-                     i420_buffer->StrideV(), width_, height_);
+  glReadPixels(0, 0, width_, height_, GL_RGBA, GL_UNSIGNED_BYTE, buf_.get());
+  GL_ERRCHECK("glReadPixels");
 
-  return i420_buffer;
+  // OpenGL の座標は上下反転してるので、高さを負の値にして反転しながら変換する
+  return ConvertToI420(buf_.get(), width_ * 4, width_, -height_, true);
 }
 
 }  // namespace sora_unity_sdk
@@ -112,6 +112,11 @@ void UnityContext::Init(IUnityInterfaces* ifs) {
   webrtc::LogMessage::LogTimestamps();
   webrtc::LogMessage::LogThreads();
 
+  // 既に初期化されていた場合は、登録したままのシンクを外してから作り直す
+  if (log_sink_ != nullptr) {
+    webrtc::LogMessage::RemoveLogToStream(log_sink_.get());
+    log_sink_.reset();
+  }
   log_sink_.reset(new webrtc::FileRotatingLogSink("./", "webrtc_logs",
                                                   kDefaultMaxLogFileSize, 10));
   if (!log_sink_->Init()) {
@@ -1,18 +1,123 @@
 #include "unity_renderer.h"
 
+#include <algorithm>
 #include <thread>
 
 // libwebrtc
+#include <common_video/include/video_frame_buffer_pool.h>
 #include <rtc_base/logging.h>
+#include <rtc_base/time_utils.h>
+
+// Boost
+#include <boost/asio/post.hpp>
+#include <boost/asio/thread_pool.hpp>
 
 namespace sora_unity_sdk {
 
+// UnityRenderer::Sink::Downscaler
+
+// 全ての Sink の縮小をこのスレッドプールで行う
+static boost::asio::thread_pool& GetDownscalePool() {
+  static boost::asio::thread_pool pool(
+      std::max(1, std::min((int)std::thread::hardware_concurrency() / 2, 4)));
+  return pool;
+}
+
+// デコーダのスレッドを止めないように、縮小はワーカースレッドで行う。
+// 縮小が追いつかない場合は途中のフレームを捨てて最新のフレームだけを縮小する。
+class UnityRenderer::Sink::Downscaler
+    : public std::enable_shared_from_this<Downscaler> {
+ public:
+  Downscaler(int width, int height) : width_(width), height_(height) {}
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+
+  void Post(webrtc::scoped_refptr<webrtc::VideoFrameBuffer> frame_buffer,
+            uint64_t serial) {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      next_ = std::move(frame_buffer);
+      next_serial_ = serial;
+      if (running_) {
+        return;
+      }
+      running_ = true;
+    }
+    auto self = shared_from_this();
+    boost::asio::post(GetDownscalePool(), [self]() { self->Run(); });
+  }
+
+  webrtc::scoped_refptr<webrtc::VideoFrameBuffer> Get(uint64_t* serial) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    *serial = latest_serial_;
+    return latest_;
+  }
+
+ private:
+  void Run() {
+    while (true) {
+      webrtc::scoped_refptr<webrtc::VideoFrameBuffer> frame_buffer;
+      uint64_t serial;
+      {
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (next_ == nullptr) {
+          running_ = false;
+          return;
+        }
+        frame_buffer = std::move(next_);
+        next_ = nullptr;
+        serial = next_serial_;
+      }
+
+      // I420 の場合は ToI420 でコピーは発生しない
+      auto i420 = frame_buffer->ToI420();
+      // 呼び出し側が全てのバッファを参照している場合はこのフレームを捨てる
+      auto scaled = pool_.CreateI420Buffer(width_, height_);
+      if (i420 == nullptr || scaled == nullptr) {
+        continue;
+      }
+      scaled->ScaleFrom(*i420);
+
+      std::lock_guard<std::mutex> guard(mutex_);
+      latest_ = scaled;
+      latest_serial_ = serial;
+    }
+  }
+
+  const int width_;
+  const int height_;
+  std::mutex mutex_;
+  bool running_ = false;
+  webrtc::scoped_refptr<webrtc::VideoFrameBuffer> next_;
+  uint64_t next_serial_ = 0;
+  webrtc::scoped_refptr<webrtc::VideoFrameBuffer> latest_;
+  uint64_t latest_serial_ = 0;
+  // Run の中からしか触らない
+  webrtc::VideoFrameBufferPool pool_{false, 4};
+};
+
 // UnityRenderer::Sink
 
-UnityRenderer::Sink::Sink(webrtc::VideoTrackInterface* track) : track_(track) {
+UnityRenderer::Sink::Sink(webrtc::VideoTrackInterface* track,
+                          std::shared_ptr<ConnectTimeline> timeline,
+                          int idle_frames,
+                          std::function<void(bool)> on_demand_changed)
+    : track_(track),
+      timeline_(timeline),
+      idle_frames_(idle_frames),
+      on_demand_changed_(std::move(on_demand_changed)) {
   RTC_LOG(LS_INFO) << "[" << (void*)this << "] Sink::Sink";
   deleting_ = false;
   updating_ = false;
+  frame_recorded_ = false;
+  texture_width_ = 0;
+  texture_height_ = 0;
+  texture_updated_us_ = 0;
+  frames_since_demand_ = 0;
+  idle_ = false;
+  has_frame_callbacks_ = false;
+  frame_callbacks_thread_ = std::thread::id();
   ptrid_ = IdPointer::Instance().Register(this);
   track_->AddOrUpdateSink(this, webrtc::VideoSinkWants());
 }
@@ -38,17 +143,282 @@ void UnityRenderer::Sink::SetTrack(webrtc::VideoTrackInterface* track) {
 }
 
 webrtc::scoped_refptr<webrtc::VideoFrameBuffer>
-UnityRenderer::Sink::GetFrameBuffer() {
+UnityRenderer::Sink::GetFrameBuffer(uint64_t* serial) {
   std::lock_guard<std::mutex> guard(mutex_);
+  *serial = frame_serial_;
   return frame_buffer_;
 }
-void UnityRenderer::Sink::SetFrameBuffer(
+uint64_t UnityRenderer::Sink::SetFrameBuffer(
     webrtc::scoped_refptr<webrtc::VideoFrameBuffer> v) {
-  std::lock_guard<std::mutex> guard(mutex_);
-  frame_buffer_ = v;
+  std::shared_ptr<Downscaler> downscaler;
+  uint64_t serial;
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    frame_buffer_ = v;
+    frame_serial_ += 1;
+    downscaler = downscaler_;
+    serial = frame_serial_;
+  }
+  if (downscaler != nullptr) {
+    downscaler->Post(v, serial);
+  }
+  return serial;
+}
+
+webrtc::scoped_refptr<webrtc::VideoFrameBuffer>
+UnityRenderer::Sink::GetLatestFrame(bool downscaled, uint64_t* serial) {
+  // CPU から読んでいる間は描画されていなくてもデコードを止めない
+  NotifyRenderDemand();
+  if (!downscaled) {
+    return GetFrameBuffer(serial);
+  }
+  std::shared_ptr<Downscaler> downscaler;
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    downscaler = downscaler_;
+  }
+  if (downscaler == nullptr) {
+    return nullptr;
+  }
+  return downscaler->Get(serial);
+}
+
+int UnityRenderer::Sink::AddFrameCallback(video_frame_cb_t f,
+                                          void* userdata) {
+  std::lock_guard<std::mutex> guard(frame_callbacks_mutex_);
+  int callback_id = next_frame_callback_id_++;
+  frame_callbacks_.push_back({callback_id, f, userdata});
+  has_frame_callbacks_ = true;
+  return callback_id;
+}
+
+void UnityRenderer::Sink::RemoveFrameCallback(int callback_id) {
+  {
+    std::lock_guard<std::mutex> guard(frame_callbacks_mutex_);
+    frame_callbacks_.erase(
+        std::remove_if(frame_callbacks_.begin(), frame_callbacks_.end(),
+                       [callback_id](const FrameCallback& c) {
+                         return c.id == callback_id;
+                       }),
+        frame_callbacks_.end());
+    has_frame_callbacks_ = !frame_callbacks_.empty();
+  }
+  // 呼び出し中のコールバックが終わるまでここで待つ。
+  // コールバックの中から呼ばれた場合は、待つと終わらなくなるので待たない
+  // （呼び出し中の一覧に残っていても、CallFrameCallbacks が呼ぶ前に確認する）
+  if (frame_callbacks_thread_ != std::this_thread::get_id()) {
+    std::lock_guard<std::mutex> guard(frame_callbacks_call_mutex_);
+  }
+}
+
+bool UnityRenderer::Sink::HasFrameCallback(int callback_id) {
+  std::lock_guard<std::mutex> guard(frame_callbacks_mutex_);
+  return std::any_of(frame_callbacks_.begin(), frame_callbacks_.end(),
+                     [callback_id](const FrameCallback& c) {
+                       return c.id == callback_id;
+                     });
+}
+
+void UnityRenderer::Sink::CallFrameCallbacks(
+    const webrtc::scoped_refptr<webrtc::VideoFrameBuffer>& frame_buffer,
+    uint64_t serial,
+    int64_t timestamp_us) {
+  std::lock_guard<std::mutex> call_guard(frame_callbacks_call_mutex_);
+  {
+    std::lock_guard<std::mutex> guard(frame_callbacks_mutex_);
+    // 毎フレーム確保しないように、コピー先を使い回す
+    calling_frame_callbacks_.assign(frame_callbacks_.begin(),
+                                    frame_callbacks_.end());
+  }
+  if (calling_frame_callbacks_.empty()) {
+    return;
+  }
+  sora_video_frame_t frame;
+  auto mapped = MapFrameBuffer(frame_buffer, serial, &frame);
+  if (mapped == nullptr) {
+    return;
+  }
+  frame_callbacks_thread_ = std::this_thread::get_id();
+  // コールバックの中でだけ有効なハンドルとして渡す。
+  // 保持したい場合は sora_retain_video_frame で参照を増やしてもらう
+  for (const auto& c : calling_frame_callbacks_) {
+    // 前のコールバックの中で削除されていれば呼ばない
+    if (!HasFrameCallback(c.id)) {
+      continue;
+    }
+    c.f(&frame, timestamp_us, (void*)mapped.get(), c.userdata);
+  }
+  frame_callbacks_thread_ = std::thread::id();
+}
+
+webrtc::scoped_refptr<webrtc::VideoFrameBuffer>
+UnityRenderer::Sink::MapFrameBuffer(
+    webrtc::scoped_refptr<webrtc::VideoFrameBuffer> frame_buffer,
+    uint64_t serial,
+    sora_video_frame_t* frame) {
+  if (frame_buffer->type() != webrtc::VideoFrameBuffer::Type::kI420 &&
+      frame_buffer->type() != webrtc::VideoFrameBuffer::Type::kNV12) {
+    frame_buffer = frame_buffer->ToI420();
+    if (frame_buffer == nullptr) {
+      return nullptr;
+    }
+  }
+
+  frame->serial = serial;
+  frame->width = frame_buffer->width();
+  frame->height = frame_buffer->height();
+  if (frame_buffer->type() == webrtc::VideoFrameBuffer::Type::kNV12) {
+    auto nv12 = frame_buffer->GetNV12();
+    frame->format = SORA_VIDEO_FRAME_FORMAT_NV12;
+    frame->data_y = nv12->DataY();
+    frame->data_u = nv12->DataUV();
+    frame->data_v = nullptr;
+    frame->stride_y = nv12->StrideY();
+    frame->stride_u = nv12->StrideUV();
+    frame->stride_v = 0;
+  } else {
+    auto i420 = frame_buffer->GetI420();
+    frame->format = SORA_VIDEO_FRAME_FORMAT_I420;
+    frame->data_y = i420->DataY();
+    frame->data_u = i420->DataU();
+    frame->data_v = i420->DataV();
+    frame->stride_y = i420->StrideY();
+    frame->stride_u = i420->StrideU();
+    frame->stride_v = i420->StrideV();
+  }
+  return frame_buffer;
+}
+
+void UnityRenderer::Sink::SetDownscale(int width, int height) {
+  std::shared_ptr<Downscaler> downscaler;
+  webrtc::scoped_refptr<webrtc::VideoFrameBuffer> frame_buffer;
+  uint64_t serial;
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (width <= 0 || height <= 0) {
+      downscaler_ = nullptr;
+      return;
+    }
+    if (downscaler_ != nullptr && downscaler_->width() == width &&
+        downscaler_->height() == height) {
+      return;
+    }
+    downscaler_ = std::make_shared<Downscaler>(width, height);
+    downscaler = downscaler_;
+    frame_buffer = frame_buffer_;
+    serial = frame_serial_;
+  }
+  // 次のフレームを待たずに、今のフレームを縮小しておく
+  if (frame_buffer != nullptr) {
+    downscaler->Post(frame_buffer, serial);
+  }
+}
+
+void UnityRenderer::Sink::ConvertToABGR(
+    webrtc::VideoFrameBuffer& frame_buffer,
+    uint8_t* dst,
+    int dst_stride,
+    int width,
+    int height,
+    webrtc::scoped_refptr<webrtc::I420Buffer>* scaled_buffer) {
+  // サイズが同じ NV12 は I420 を経由せずに直接変換する
+  if (frame_buffer.type() == webrtc::VideoFrameBuffer::Type::kNV12 &&
+      frame_buffer.width() == width && frame_buffer.height() == height) {
+    auto nv12 = frame_buffer.GetNV12();
+    libyuv::NV12ToABGR(nv12->DataY(), nv12->StrideY(), nv12->DataUV(),
+                       nv12->StrideUV(), dst, dst_stride, width, height);
+    return;
+  }
+
+  // I420 の場合 ToI420() は自分自身を返すので、サイズが同じならコピーは発生しない
+  webrtc::scoped_refptr<webrtc::I420BufferInterface> i420 =
+      frame_buffer.ToI420();
+  if (i420->width() != width || i420->height() != height) {
+    auto& scaled = *scaled_buffer;
+    if (scaled == nullptr || scaled->width() != width ||
+        scaled->height() != height) {
+      scaled = webrtc::I420Buffer::Create(width, height);
+    }
+    scaled->ScaleFrom(*i420);
+    i420 = scaled;
+  }
+  libyuv::I420ToABGR(i420->DataY(), i420->StrideY(), i420->DataU(),
+                     i420->StrideU(), i420->DataV(), i420->StrideV(),
+                     dst, dst_stride, width, height);
+}
+
+void UnityRenderer::Sink::NotifyRenderDemand() {
+  if (idle_frames_ > 0) {
+    frames_since_demand_ = 0;
+    if (idle_.exchange(false)) {
+      RTC_LOG(LS_INFO) << "[" << (void*)this << "] Sink: render demand resumed";
+      on_demand_changed_(true);
+    }
+  }
+}
+
+void UnityRenderer::Sink::RecordTextureUpdate(int width, int height) {
+  texture_width_ = width;
+  texture_height_ = height;
+  texture_updated_us_ = webrtc::TimeMicros();
+
+  // レンダースレッドからしか呼ばれないのでフラグはアトミックでなくて良い
+  if (timeline_ != nullptr && !texture_recorded_) {
+    texture_recorded_ = true;
+    timeline_->Record(SORA_TIMELINE_FIRST_TEXTURE_UPDATE, ptrid_);
+  }
+}
+
+webrtc::scoped_refptr<webrtc::VideoFrameBuffer>
+UnityRenderer::Sink::GetNewFrameForTexture(uint64_t* serial,
+                                           int width,
+                                           int height) {
+  if (deleting_) {
+    return nullptr;
+  }
+  updating_ = true;
+
+  NotifyRenderDemand();
+  uint64_t current_serial;
+  auto video_frame_buffer = GetFrameBuffer(&current_serial);
+  if (video_frame_buffer) {
+    RecordTextureUpdate(width, height);
+    if (current_serial == *serial) {
+      video_frame_buffer = nullptr;
+    } else {
+      *serial = current_serial;
+    }
+  }
+
+  updating_ = false;
+  return video_frame_buffer;
+}
+
+TextureStats UnityRenderer::Sink::GetTextureStats() const {
+  TextureStats stats;
+  stats.width = texture_width_;
+  stats.height = texture_height_;
+  stats.updated_us = texture_updated_us_;
+  return stats;
 }
 
 void UnityRenderer::Sink::OnFrame(const webrtc::VideoFrame& frame) {
+  // 他のプラグインがフレームを受け取っている間は描画されていなくてもデコードを止めない
+  if (has_frame_callbacks_) {
+    NotifyRenderDemand();
+  }
+  if (idle_frames_ > 0) {
+    if (frames_since_demand_.fetch_add(1) + 1 >= idle_frames_ &&
+        !idle_.exchange(true)) {
+      RTC_LOG(LS_INFO) << "[" << (void*)this << "] Sink: no render demand";
+      on_demand_changed_(false);
+    }
+    // 描画されていないので変換しない
+    if (idle_) {
+      return;
+    }
+  }
+
   webrtc::scoped_refptr<webrtc::VideoFrameBuffer> frame_buffer =
       frame.video_frame_buffer();
 
@@ -58,7 +428,14 @@ void UnityRenderer::Sink::OnFrame(const webrtc::VideoFrame& frame) {
     frame_buffer = frame_buffer->ToI420();
   }
 
-  SetFrameBuffer(frame_buffer);
+  uint64_t serial = SetFrameBuffer(frame_buffer);
+  if (has_frame_callbacks_) {
+    CallFrameCallbacks(frame_buffer, serial, frame.timestamp_us());
+  }
+
+  if (timeline_ != nullptr && !frame_recorded_.exchange(true)) {
+    timeline_->Record(SORA_TIMELINE_FIRST_FRAME_DECODED, ptrid_);
+  }
 }
 
 void UnityRenderer::Sink::TextureUpdateCallback(int eventID, void* data) {
@@ -83,24 +460,37 @@ void UnityRenderer::Sink::TextureUpdateCallback(int eventID, void* data) {
       return;
     }
     p->updating_ = true;
+
+    p->NotifyRenderDemand();
     //RTC_LOG(LS_INFO) << "[" << (void*)p
     //                 << "] Sink::TextureUpdateCallback Begin Start";
-    auto video_frame_buffer = p->GetFrameBuffer();
+    uint64_t serial;
+    auto video_frame_buffer = p->GetFrameBuffer(&serial);
     if (!video_frame_buffer) {
       return;
     }
 
     // UpdateTextureBegin: Generate and return texture image data.
-    webrtc::scoped_refptr<webrtc::I420Buffer> i420_buffer =
-        webrtc::I420Buffer::Create(params->width, params->height);
-    i420_buffer->ScaleFrom(*video_frame_buffer->ToI420());
-    delete[] p->temp_buf_;
-    p->temp_buf_ = new uint8_t[params->width * params->height * 4];
-    libyuv::I420ToABGR(
-        i420_buffer->DataY(), i420_buffer->StrideY(), i420_buffer->DataU(),
-        i420_buffer->StrideU(), i420_buffer->DataV(), i420_buffer->StrideV(),
-        p->temp_buf_, params->width * 4, params->width, params->height);
-    params->texData = p->temp_buf_;
+    // 映像のフレームレートよりも Unity のフレームレートの方が高いことが多いので、
+    // 新しいフレームが来ていなければ前回の変換結果を返す
+    int width = (int)params->width;
+    int height = (int)params->height;
+    if (serial != p->converted_serial_ || width != p->converted_width_ ||
+        height != p->converted_height_) {
+      size_t size = (size_t)width * height * 4;
+      if (p->temp_buf_size_ < size) {
+        p->temp_buf_.reset(new uint8_t[size]);
+        p->temp_buf_size_ = size;
+      }
+      ConvertToABGR(*video_frame_buffer, p->temp_buf_.get(), width * 4, width,
+                    height, &p->scaled_buffer_);
+      p->converted_serial_ = serial;
+      p->converted_width_ = width;
+      p->converted_height_ = height;
+    }
+    params->texData = p->temp_buf_.get();
+
+    p->RecordTextureUpdate(width, height);
     //RTC_LOG(LS_INFO) << "[" << (void*)p
     //                 << "] Sink::TextureUpdateCallback Begin Finish";
   } else if (event == kUnityRenderingExtEventUpdateTextureEndV2) {
@@ -113,15 +503,19 @@ void UnityRenderer::Sink::TextureUpdateCallback(int eventID, void* data) {
       return;
     }
     //RTC_LOG(LS_INFO) << "[" << (void*)p << "] Sink::TextureUpdateCallback End";
-    delete[] p->temp_buf_;
-    p->temp_buf_ = nullptr;
     p->updating_ = false;
   }
 }
 
-ptrid_t UnityRenderer::AddTrack(webrtc::VideoTrackInterface* track) {
+UnityRenderer::UnityRenderer(std::shared_ptr<ConnectTimeline> timeline)
+    : timeline_(timeline) {}
+
+ptrid_t UnityRenderer::AddTrack(webrtc::VideoTrackInterface* track,
+                                int idle_frames,
+                                std::function<void(bool)> on_demand_changed) {
   RTC_LOG(LS_INFO) << "UnityRenderer::AddTrack";
-  std::unique_ptr<Sink> sink(new Sink(track));
+  std::unique_ptr<Sink> sink(new Sink(track, timeline_, idle_frames,
+                                      std::move(on_demand_changed)));
   auto sink_id = sink->GetSinkID();
   sinks_.push_back(std::make_pair(track, std::move(sink)));
   return sink_id;
@@ -180,4 +574,18 @@ ptrid_t UnityRenderer::GetVideoSinkId(
   return it->second->GetSinkID();
 }
 
+bool UnityRenderer::GetTextureStats(ptrid_t video_sink_id,
+                                    TextureStats* stats) const {
+  auto it =
+      std::find_if(sinks_.begin(), sinks_.end(),
+                   [video_sink_id](const VideoSinkVector::value_type& sink) {
+                     return sink.second->GetSinkID() == video_sink_id;
+                   });
+  if (it == sinks_.end()) {
+    return false;
+  }
+  *stats = it->second->GetTextureStats();
+  return true;
+}
+
 }  // namespace sora_unity_sdk
@@ -1,6 +1,11 @@
 #ifndef SORA_UNITY_SDK_UNITY_RENDERER_H_INCLUDED
 #define SORA_UNITY_SDK_UNITY_RENDERER_H_INCLUDED
 
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 // webrtc
 #include <api/media_stream_interface.h>
 #include <api/video/i420_buffer.h>
@@ -9,11 +14,21 @@
 #include <libyuv.h>
 
 // sora
+#include "connect_timeline.h"
 #include "id_pointer.h"
+#include "unity.h"
 #include "unity/IUnityRenderingExtensions.h"
 
 namespace sora_unity_sdk {
 
+// Unity 側で実際に更新されているテクスチャの情報
+struct TextureStats {
+  int width = 0;
+  int height = 0;
+  // 最後にテクスチャを更新した時刻。一度も更新していない場合は 0
+  int64_t updated_us = 0;
+};
+
 class UnityRenderer {
  public:
   class Sink : public webrtc::VideoSinkInterface<webrtc::VideoFrame> {
@@ -21,19 +36,111 @@ class UnityRenderer {
     ptrid_t ptrid_;
     std::mutex mutex_;
     webrtc::scoped_refptr<webrtc::VideoFrameBuffer> frame_buffer_;
-    uint8_t* temp_buf_ = nullptr;
+    // OnFrame のたびに増える。mutex_ で保護する
+    uint64_t frame_serial_ = 0;
+    // 以下はレンダースレッドだけが触る。
+    // テクスチャの更新のたびに確保し直さないように使い回し、
+    // フレームもサイズも変わっていない場合は前回の変換結果をそのまま返す。
+    std::unique_ptr<uint8_t[]> temp_buf_;
+    size_t temp_buf_size_ = 0;
+    webrtc::scoped_refptr<webrtc::I420Buffer> scaled_buffer_;
+    uint64_t converted_serial_ = 0;
+    int converted_width_ = 0;
+    int converted_height_ = 0;
     std::atomic<bool> deleting_;
     std::atomic<bool> updating_;
+    std::shared_ptr<ConnectTimeline> timeline_;
+    std::atomic<bool> frame_recorded_;
+    bool texture_recorded_ = false;
+    // レンダースレッドで書き込み、Unity スレッドで読む
+    std::atomic<int> texture_width_;
+    std::atomic<int> texture_height_;
+    std::atomic<int64_t> texture_updated_us_;
+    // idle_frames_ フレームの間テクスチャの更新が無ければ、描画されていないとみなす。
+    // 0 の場合は判定しない
+    int idle_frames_;
+    std::function<void(bool)> on_demand_changed_;
+    std::atomic<int> frames_since_demand_;
+    std::atomic<bool> idle_;
+    // CPU から読むための縮小したフレームを作る。mutex_ で保護する
+    class Downscaler;
+    std::shared_ptr<Downscaler> downscaler_;
+    // 他のネイティブプラグインにフレームを渡すコールバック
+    struct FrameCallback {
+      int id;
+      video_frame_cb_t f;
+      void* userdata;
+    };
+    std::mutex frame_callbacks_mutex_;
+    std::vector<FrameCallback> frame_callbacks_;
+    int next_frame_callback_id_ = 1;
+    std::atomic<bool> has_frame_callbacks_;
+    // コールバックの中から Add/RemoveFrameCallback を呼べるように、
+    // frame_callbacks_mutex_ ではなくこちらを持ったままコールバックを呼ぶ。
+    // calling_frame_callbacks_ は呼び出す一覧のコピーで、これで保護する
+    std::mutex frame_callbacks_call_mutex_;
+    std::vector<FrameCallback> calling_frame_callbacks_;
+    std::atomic<std::thread::id> frame_callbacks_thread_;
 
    public:
-    Sink(webrtc::VideoTrackInterface* track);
+    Sink(webrtc::VideoTrackInterface* track,
+         std::shared_ptr<ConnectTimeline> timeline,
+         int idle_frames = 0,
+         std::function<void(bool)> on_demand_changed = nullptr);
     ~Sink();
     ptrid_t GetSinkID() const;
     void SetTrack(webrtc::VideoTrackInterface* track);
+    TextureStats GetTextureStats() const;
+    // テクスチャ更新コールバックを使わずに、レンダースレッドから直接テクスチャを更新する時に使う。
+    // serial の時点から新しいフレームが来ていれば、そのフレームを返して serial を更新する。
+    // 来ていなければ nullptr を返す。
+    webrtc::scoped_refptr<webrtc::VideoFrameBuffer>
+    GetNewFrameForTexture(uint64_t* serial, int width, int height);
+
+    // CPU から映像を読むために、最新のフレームとその serial を返す。
+    // 返したフレームは参照を持っている間は書き換えられない。
+    // downscaled が true の場合は SetDownscale で指定した大きさに縮小したフレームを返す。
+    webrtc::scoped_refptr<webrtc::VideoFrameBuffer> GetLatestFrame(
+        bool downscaled,
+        uint64_t* serial);
+    // 新しいフレームが来るたびに、ワーカースレッドで width x height に縮小したフレームを作る。
+    // 0 を指定すると縮小を止める
+    void SetDownscale(int width, int height);
+    // 新しいフレームが来るたびに、デコーダのスレッドから f を呼ぶ。
+    // RemoveFrameCallback から戻った後は f は呼ばれない。
+    // f の中から AddFrameCallback と RemoveFrameCallback を呼んでも良い。
+    int AddFrameCallback(video_frame_cb_t f, void* userdata);
+    void RemoveFrameCallback(int callback_id);
+    // frame_buffer の各面を frame に書き込み、そのメモリを持っているバッファを返す。
+    // I420 と NV12 以外は I420 に変換したバッファを返す。失敗した場合は nullptr を返す
+    static webrtc::scoped_refptr<webrtc::VideoFrameBuffer> MapFrameBuffer(
+        webrtc::scoped_refptr<webrtc::VideoFrameBuffer> frame_buffer,
+        uint64_t serial,
+        sora_video_frame_t* frame);
+
+    // frame_buffer を width x height に拡縮して、dst に RGBA で書き込む。
+    // scaled_buffer は拡縮用の作業バッファで、呼び出し側で使い回す。
+    // 作業バッファさえ別にすれば、複数のスレッドから同時に呼んでも良い。
+    static void ConvertToABGR(
+        webrtc::VideoFrameBuffer& frame_buffer,
+        uint8_t* dst,
+        int dst_stride,
+        int width,
+        int height,
+        webrtc::scoped_refptr<webrtc::I420Buffer>* scaled_buffer);
 
    private:
-    webrtc::scoped_refptr<webrtc::VideoFrameBuffer> GetFrameBuffer();
-    void SetFrameBuffer(webrtc::scoped_refptr<webrtc::VideoFrameBuffer> v);
+    webrtc::scoped_refptr<webrtc::VideoFrameBuffer> GetFrameBuffer(
+        uint64_t* serial);
+    uint64_t SetFrameBuffer(
+        webrtc::scoped_refptr<webrtc::VideoFrameBuffer> v);
+    bool HasFrameCallback(int callback_id);
+    void CallFrameCallbacks(
+        const webrtc::scoped_refptr<webrtc::VideoFrameBuffer>& frame_buffer,
+        uint64_t serial,
+        int64_t timestamp_us);
+    void NotifyRenderDemand();
+    void RecordTextureUpdate(int width, int height);
 
    public:
     void OnFrame(const webrtc::VideoFrame& frame) override;
@@ -46,15 +153,25 @@ class UnityRenderer {
       std::pair<webrtc::VideoTrackInterface*, std::unique_ptr<Sink>>>
       VideoSinkVector;
   VideoSinkVector sinks_;
+  std::shared_ptr<ConnectTimeline> timeline_;
 
  public:
-  ptrid_t AddTrack(webrtc::VideoTrackInterface* track);
+  // timeline を指定すると、各 Sink の最初のフレームとテクスチャ更新の時刻を記録する
+  explicit UnityRenderer(std::shared_ptr<ConnectTimeline> timeline = nullptr);
+
+  // idle_frames を指定すると、その間テクスチャが更新されなかった時に on_demand_changed(false) を、
+  // その後でテクスチャが更新された時に on_demand_changed(true) を呼ぶ。
+  // on_demand_changed はデコーダのスレッドやレンダースレッドから呼ばれる。
+  ptrid_t AddTrack(webrtc::VideoTrackInterface* track,
+                   int idle_frames = 0,
+                   std::function<void(bool)> on_demand_changed = nullptr);
   ptrid_t RemoveTrack(webrtc::VideoTrackInterface* track);
   void ReplaceTrack(webrtc::VideoTrackInterface* oldTrack,
                     webrtc::VideoTrackInterface* newTrack);
   webrtc::VideoTrackInterface* GetVideoTrackFromVideoSinkId(
       ptrid_t video_sink_id) const;
   ptrid_t GetVideoSinkId(webrtc::VideoTrackInterface* track) const;
+  bool GetTextureStats(ptrid_t video_sink_id, TextureStats* stats) const;
 };
 
 }  // namespace sora_unity_sdk
@@ -0,0 +1,266 @@
+#include "video_codec_capability_cache.h"
+#include "sora_version.h"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// WebRTC
+#include <rtc_base/logging.h>
+
+// Boost
+#include <boost/json.hpp>
+
+#ifdef SORA_UNITY_SDK_WINDOWS
+#include <dxgi.h>
+#include <wrl.h>
+#endif
+
+#include "converter.h"
+
+namespace sora_unity_sdk {
+
+#if defined(SORA_UNITY_SDK_UBUNTU)
+// ファイルが差し替えられたことを検出できるように、シンボリックリンクを解決した
+// パス（バージョンが含まれる）とサイズ、更新日時を追加する
+static void AppendFileFingerprint(std::stringstream& ss,
+                                  const std::filesystem::path& path) {
+  std::error_code ec;
+  auto resolved = std::filesystem::canonical(path, ec);
+  if (ec) {
+    return;
+  }
+  auto size = std::filesystem::file_size(resolved, ec);
+  if (ec) {
+    return;
+  }
+  auto mtime = std::filesystem::last_write_time(resolved, ec);
+  if (ec) {
+    return;
+  }
+  ss << resolved.string() << ":" << size << ":"
+     << mtime.time_since_epoch().count() << ";";
+}
+
+// ハードウェアエンコーダやデコーダが使うライブラリを探すディレクトリ
+static std::vector<std::string> GetLibraryDirectories() {
+  std::vector<std::string> dirs;
+  auto append_env = [&dirs](const char* name) {
+    const char* value = std::getenv(name);
+    if (value == nullptr) {
+      return;
+    }
+    std::stringstream ss(value);
+    std::string dir;
+    while (std::getline(ss, dir, ':')) {
+      if (!dir.empty()) {
+        dirs.push_back(dir);
+      }
+    }
+  };
+  append_env("LD_LIBRARY_PATH");
+  append_env("LIBVA_DRIVERS_PATH");
+  for (const char* dir : {
+           "/usr/lib/x86_64-linux-gnu",
+           "/usr/lib/x86_64-linux-gnu/dri",
+           "/usr/lib64",
+           "/usr/lib64/dri",
+           "/usr/lib",
+           "/usr/lib/dri",
+           "/usr/local/lib",
+           "/opt/amdgpu/lib/x86_64-linux-gnu",
+           "/opt/intel/oneapi/vpl/latest/lib",
+       }) {
+    dirs.push_back(dir);
+  }
+  return dirs;
+}
+#endif
+
+// GPU ドライバが更新されたら、利用できるエンコーダやデコーダが変わる可能性があるので、
+// ドライバのバージョンを識別できる文字列を作っておく
+static std::string GetDriverFingerprint() {
+  std::stringstream ss;
+#if defined(SORA_UNITY_SDK_WINDOWS)
+  Microsoft::WRL::ComPtr<IDXGIFactory1> factory;
+  if (SUCCEEDED(CreateDXGIFactory1(IID_PPV_ARGS(&factory)))) {
+    Microsoft::WRL::ComPtr<IDXGIAdapter1> adapter;
+    for (UINT i = 0;
+         factory->EnumAdapters1(i, adapter.ReleaseAndGetAddressOf()) !=
+         DXGI_ERROR_NOT_FOUND;
+         i++) {
+      DXGI_ADAPTER_DESC1 desc;
+      if (FAILED(adapter->GetDesc1(&desc))) {
+        continue;
+      }
+      LARGE_INTEGER umd_version = {};
+      adapter->CheckInterfaceSupport(__uuidof(IDXGIDevice), &umd_version);
+      ss << std::hex << desc.VendorId << ":" << desc.DeviceId << ":"
+         << umd_version.QuadPart << ";";
+    }
+  }
+#elif defined(SORA_UNITY_SDK_UBUNTU)
+  std::ifstream ifs("/proc/driver/nvidia/version");
+  std::string line;
+  if (std::getline(ifs, line)) {
+    ss << line << ";";
+  }
+  // Intel と AMD の DRM ドライバはカーネルに含まれるので、カーネルのバージョンで判断する
+  std::ifstream osrelease("/proc/sys/kernel/osrelease");
+  if (std::getline(osrelease, line)) {
+    ss << line << ";";
+  }
+  for (const char* name : {"LIBVA_DRIVER_NAME", "LIBVA_DRIVERS_PATH"}) {
+    const char* value = std::getenv(name);
+    ss << name << "=" << (value != nullptr ? value : "") << ";";
+  }
+  // Intel VPL, libva と VA-API ドライバ, AMD AMF, NVIDIA のユーザモードライブラリ
+  const char* kLibraries[] = {
+      "libvpl.so.2",
+      "libmfx-gen.so.1.2",
+      "libva.so.2",
+      "libva-drm.so.2",
+      "iHD_drv_video.so",
+      "i965_drv_video.so",
+      "radeonsi_drv_video.so",
+      "libamfrt64.so.1",
+      "libcuda.so.1",
+      "libnvidia-encode.so.1",
+      "libnvcuvid.so.1",
+  };
+  auto dirs = GetLibraryDirectories();
+  for (const char* library : kLibraries) {
+    for (const auto& dir : dirs) {
+      std::error_code ec;
+      auto path = std::filesystem::path(dir) / library;
+      if (std::filesystem::exists(path, ec)) {
+        AppendFileFingerprint(ss, path);
+        break;
+      }
+    }
+  }
+#endif
+  return ss.str();
+}
+
+static std::string GetEnvironment() {
+  static const std::string environment =
+      std::string(SORA_UNITY_SDK_VERSION " " SORA_UNITY_SDK_COMMIT_SHORT " ") +
+      GetDriverFingerprint();
+  return environment;
+}
+
+VideoCodecCapabilityCache& VideoCodecCapabilityCache::Instance() {
+  static VideoCodecCapabilityCache cache;
+  return cache;
+}
+
+void VideoCodecCapabilityCache::SetCacheFile(const std::string& path) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  cache_file_ = path;
+  Load();
+}
+
+std::string VideoCodecCapabilityCache::Get(
+    const sora_conf::internal::VideoCodecCapabilityConfig& config) {
+  std::lock_guard<std::mutex> guard(mutex_);
+
+  // 同時に呼ばれた場合もロックを取ったまま調べるので、同じ設定で二重に調べることは無い
+  auto key = jsonif::to_json(config) + "\n" + GetFingerprint(config);
+  auto it = entries_.find(key);
+  if (it != entries_.end()) {
+    return it->second;
+  }
+
+  auto cc = ConvertToVideoCodecCapabilityConfigWithSession(config);
+  auto capability = sora::GetVideoCodecCapability(cc);
+  auto result =
+      jsonif::to_json(ConvertToInternalVideoCodecCapability(capability));
+  entries_[key] = result;
+  Save();
+  return result;
+}
+
+std::string VideoCodecCapabilityCache::GetFingerprint(
+    const sora_conf::internal::VideoCodecCapabilityConfig& config) {
+  // OpenH264 のライブラリが差し替えられた場合に検出できるように、サイズと更新日時を含める
+  if (!config.has_openh264_path()) {
+    return "";
+  }
+  std::error_code ec;
+  auto size = std::filesystem::file_size(config.openh264_path, ec);
+  if (ec) {
+    return "";
+  }
+  auto mtime = std::filesystem::last_write_time(config.openh264_path, ec);
+  if (ec) {
+    return "";
+  }
+  return std::to_string(size) + ":" +
+         std::to_string(mtime.time_since_epoch().count());
+}
+
+void VideoCodecCapabilityCache::Load() {
+  if (cache_file_.empty()) {
+    return;
+  }
+  std::ifstream ifs(cache_file_, std::ios::binary);
+  if (!ifs) {
+    return;
+  }
+  std::stringstream ss;
+  ss << ifs.rdbuf();
+
+  boost::system::error_code ec;
+  auto v = boost::json::parse(ss.str(), ec);
+  if (ec || !v.is_object()) {
+    RTC_LOG(LS_WARNING) << "Invalid video codec capability cache: "
+                        << cache_file_;
+    return;
+  }
+  const auto& obj = v.as_object();
+  auto environment = obj.if_contains("environment");
+  auto entries = obj.if_contains("entries");
+  if (environment == nullptr || !environment->is_string() ||
+      entries == nullptr || !entries->is_object()) {
+    return;
+  }
+  // SDK やドライバが変わっていたら、キャッシュは全て捨てる
+  if (environment->as_string() != GetEnvironment()) {
+    RTC_LOG(LS_INFO) << "Video codec capability cache is outdated: "
+                     << cache_file_;
+    return;
+  }
+  for (const auto& kv : entries->as_object()) {
+    if (kv.value().is_string()) {
+      entries_.emplace(std::string(kv.key()),
+                       std::string(kv.value().as_string()));
+    }
+  }
+}
+
+void VideoCodecCapabilityCache::Save() {
+  if (cache_file_.empty()) {
+    return;
+  }
+  boost::json::object entries;
+  for (const auto& kv : entries_) {
+    entries[kv.first] = kv.second;
+  }
+  boost::json::object obj;
+  obj["environment"] = GetEnvironment();
+  obj["entries"] = std::move(entries);
+
+  std::ofstream ofs(cache_file_, std::ios::binary | std::ios::trunc);
+  if (!ofs) {
+    RTC_LOG(LS_WARNING) << "Failed to write video codec capability cache: "
+                        << cache_file_;
+    return;
+  }
+  ofs << boost::json::serialize(obj);
+}
+
+}  // namespace sora_unity_sdk
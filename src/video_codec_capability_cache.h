@@ -0,0 +1,40 @@
+#ifndef SORA_UNITY_SDK_VIDEO_CODEC_CAPABILITY_CACHE_H_INCLUDED
+#define SORA_UNITY_SDK_VIDEO_CODEC_CAPABILITY_CACHE_H_INCLUDED
+
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "sora_conf_internal.json.h"
+
+namespace sora_unity_sdk {
+
+// sora::GetVideoCodecCapability() はドライバやライブラリを実際にロードして調べるので時間がかかる。
+// そのため VideoCodecCapabilityConfig 毎に結果をプロセス全体でキャッシュする。
+//
+// SetCacheFile() でファイルを指定すると、ディスクにもキャッシュを保存して次回起動時に利用する。
+// ディスクのキャッシュは SDK のバージョン、OpenH264 のライブラリ、GPU ドライバのバージョンが
+// 変わった場合は破棄される。
+class VideoCodecCapabilityCache {
+ public:
+  static VideoCodecCapabilityCache& Instance();
+
+  void SetCacheFile(const std::string& path);
+  // sora_conf::internal::VideoCodecCapability の JSON 文字列を返す
+  std::string Get(const sora_conf::internal::VideoCodecCapabilityConfig& config);
+
+ private:
+  std::string GetFingerprint(
+      const sora_conf::internal::VideoCodecCapabilityConfig& config);
+  void Load();
+  void Save();
+
+  std::mutex mutex_;
+  std::string cache_file_;
+  // キーは VideoCodecCapabilityConfig とフィンガープリントを合わせたもの
+  std::map<std::string, std::string> entries_;
+};
+
+}  // namespace sora_unity_sdk
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef SORA_UNITY_SDK_TEST_FAKE_VIDEO_TRACK_H_INCLUDED
+#define SORA_UNITY_SDK_TEST_FAKE_VIDEO_TRACK_H_INCLUDED
+
+#include <cstring>
+#include <mutex>
+#include <string>
+
+// WebRTC
+#include <api/media_stream_interface.h>
+#include <api/notifier.h>
+#include <api/video/i420_buffer.h>
+#include <api/video/nv12_buffer.h>
+#include <api/video/video_frame.h>
+
+namespace sora_unity_sdk {
+
+// PeerConnection を使わずに UnityRenderer::Sink にフレームを渡すためのトラック
+class FakeVideoTrack
+    : public webrtc::Notifier<webrtc::VideoTrackInterface> {
+ public:
+  std::string kind() const override { return kVideoKind; }
+  std::string id() const override { return "fake"; }
+  bool enabled() const override { return true; }
+  bool set_enabled(bool enable) override { return true; }
+  TrackState state() const override { return kLive; }
+  webrtc::VideoTrackSourceInterface* GetSource() const override {
+    return nullptr;
+  }
+
+  void AddOrUpdateSink(webrtc::VideoSinkInterface<webrtc::VideoFrame>* sink,
+                       const webrtc::VideoSinkWants& wants) override {
+    std::lock_guard<std::mutex> guard(mutex_);
+    sink_ = sink;
+  }
+  void RemoveSink(
+      webrtc::VideoSinkInterface<webrtc::VideoFrame>* sink) override {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (sink_ == sink) {
+      sink_ = nullptr;
+    }
+  }
+
+  // デコーダのスレッドの代わりにフレームを渡す
+  void Deliver(webrtc::scoped_refptr<webrtc::VideoFrameBuffer> buffer,
+               int64_t timestamp_us) {
+    auto frame = webrtc::VideoFrame::Builder()
+                     .set_video_frame_buffer(buffer)
+                     .set_timestamp_us(timestamp_us)
+                     .build();
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (sink_ != nullptr) {
+      sink_->OnFrame(frame);
+    }
+  }
+
+ private:
+  std::mutex mutex_;
+  webrtc::VideoSinkInterface<webrtc::VideoFrame>* sink_ = nullptr;
+};
+
+// 全体を y, u, v で塗り潰したフレームを作る
+inline webrtc::scoped_refptr<webrtc::I420Buffer>
+CreateI420(int width, int height, uint8_t y, uint8_t u, uint8_t v) {
+  auto buffer = webrtc::I420Buffer::Create(width, height);
+  std::memset(buffer->MutableDataY(), y,
+              buffer->StrideY() * buffer->height());
+  std::memset(buffer->MutableDataU(), u,
+              buffer->StrideU() * buffer->ChromaHeight());
+  std::memset(buffer->MutableDataV(), v,
+              buffer->StrideV() * buffer->ChromaHeight());
+  return buffer;
+}
+
+inline webrtc::scoped_refptr<webrtc::NV12Buffer>
+CreateNV12(int width, int height, uint8_t y, uint8_t u, uint8_t v) {
+  auto buffer = webrtc::NV12Buffer::Create(width, height);
+  std::memset(buffer->MutableDataY(), y,
+              buffer->StrideY() * buffer->height());
+  uint8_t* uv = buffer->MutableDataUV();
+  for (int i = 0; i < buffer->StrideUV() * buffer->ChromaHeight(); i += 2) {
+    uv[i] = u;
+    uv[i + 1] = v;
+  }
+  return buffer;
+}
+
+}  // namespace sora_unity_sdk
+
+#endif
@@ -0,0 +1,281 @@
+// UnityRenderer::Sink の OnFrame と TextureUpdateCallback のベンチマーク。
+//
+// 合成した I420, NV12, kNative のフレームを Sink に渡し、Unity と同じ
+// Begin/End の順でテクスチャ更新コールバックを呼んで、1 フレームあたりの時間、
+// operator new で確保したバイト数、スループットを出力する。
+//
+// I420Buffer などのピクセルデータは AlignedMalloc で確保されるので、
+// 確保したバイト数には含まれない。含まれるのはテクスチャ用のバッファや
+// バッファのオブジェクトなど、operator new を経由する確保だけ。
+//
+// 使い方: SoraUnitySdkRendererBenchmark [倍率]
+// 倍率を指定すると、各ケースで処理するピクセル数をその倍にする（既定は 1）。
+// テクスチャ用のバッファが合計 1GiB を超えるケース（4K を 64 個）は飛ばす。
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+// WebRTC
+#include <api/video/i420_buffer.h>
+#include <api/video/video_frame_buffer.h>
+#include <rtc_base/logging.h>
+
+#include "fake_video_track.h"
+#include "unity.h"
+#include "unity/IUnityRenderingExtensions.h"
+#include "unity_renderer.h"
+
+namespace {
+
+std::atomic<uint64_t> g_allocated_bytes{0};
+std::atomic<uint64_t> g_allocations{0};
+
+void* CountedAlloc(std::size_t size) {
+  g_allocated_bytes += size;
+  g_allocations++;
+  void* p = std::malloc(size == 0 ? 1 : size);
+  if (p == nullptr) {
+    std::abort();
+  }
+  return p;
+}
+
+}  // namespace
+
+// テクスチャ更新のたびに確保していないかを見るために、operator new を数える
+void* operator new(std::size_t size) {
+  return CountedAlloc(size);
+}
+void* operator new[](std::size_t size) {
+  return CountedAlloc(size);
+}
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+void operator delete[](void* p) noexcept {
+  std::free(p);
+}
+void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+void operator delete[](void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
+namespace sora_unity_sdk {
+
+namespace {
+
+// ハードウェアデコーダの出力の代わり。
+// 実際のネイティブバッファと同じく、ToI420() のたびにコピーを作る
+class FakeNativeBuffer : public webrtc::VideoFrameBuffer {
+ public:
+  explicit FakeNativeBuffer(webrtc::scoped_refptr<webrtc::I420Buffer> i420)
+      : i420_(i420) {}
+
+  Type type() const override { return Type::kNative; }
+  int width() const override { return i420_->width(); }
+  int height() const override { return i420_->height(); }
+  webrtc::scoped_refptr<webrtc::I420BufferInterface> ToI420() override {
+    return webrtc::I420Buffer::Copy(*i420_);
+  }
+
+ private:
+  webrtc::scoped_refptr<webrtc::I420Buffer> i420_;
+};
+
+enum class FrameType { kI420, kNV12, kNative };
+
+const char* FrameTypeToString(FrameType type) {
+  switch (type) {
+    case FrameType::kI420:
+      return "I420";
+    case FrameType::kNV12:
+      return "NV12";
+    case FrameType::kNative:
+      return "kNative";
+  }
+  return "";
+}
+
+webrtc::scoped_refptr<webrtc::VideoFrameBuffer> CreateFrame(FrameType type,
+                                                            int width,
+                                                            int height,
+                                                            uint8_t y) {
+  switch (type) {
+    case FrameType::kI420:
+      return CreateI420(width, height, y, 128, 128);
+    case FrameType::kNV12:
+      return CreateNV12(width, height, y, 128, 128);
+    case FrameType::kNative:
+      return webrtc::make_ref_counted<FakeNativeBuffer>(
+          CreateI420(width, height, y, 128, 128));
+  }
+  return nullptr;
+}
+
+typedef void(UNITY_INTERFACE_API* TextureUpdateFunc)(int, void*);
+
+struct Case {
+  FrameType type;
+  int width;
+  int height;
+  // テクスチャの大きさ。フレームと違う場合は拡縮が入る
+  int texture_width;
+  int texture_height;
+  int sinks;
+};
+
+struct Result {
+  int frames = 0;
+  double on_frame_ns = 0;
+  double update_ns = 0;
+  double bytes_per_frame = 0;
+  double allocations_per_frame = 0;
+  double frames_per_sec = 0;
+};
+
+int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+Result Run(const Case& c, double scale) {
+  std::vector<webrtc::scoped_refptr<FakeVideoTrack>> tracks;
+  UnityRenderer renderer;
+  std::vector<ptrid_t> ids;
+  for (int i = 0; i < c.sinks; i++) {
+    tracks.push_back(webrtc::make_ref_counted<FakeVideoTrack>());
+    ids.push_back(renderer.AddTrack(tracks.back().get()));
+  }
+
+  // 毎回新しいフレームとして変換させるために、2 つのフレームを交互に渡す
+  webrtc::scoped_refptr<webrtc::VideoFrameBuffer> frames[2] = {
+      CreateFrame(c.type, c.width, c.height, 64),
+      CreateFrame(c.type, c.width, c.height, 192),
+  };
+
+  auto update = (TextureUpdateFunc)sora_get_texture_update_callback();
+  UnityRenderingExtTextureUpdateParamsV2 params = {};
+  params.format = kUnityRenderingExtFormatR8G8B8A8_UNorm;
+  params.width = c.texture_width;
+  params.height = c.texture_height;
+  params.bpp = 4;
+
+  // 1 ケースで処理するピクセル数がおおよそ同じになるように回数を決める
+  const double kPixelsPerCase = 2e9 * scale;
+  int iterations = (int)(kPixelsPerCase / ((double)c.width * c.height *
+                                           c.sinks));
+  if (iterations < 5) {
+    iterations = 5;
+  }
+
+  int64_t on_frame_ns = 0;
+  int64_t update_ns = 0;
+  uint64_t allocated_bytes = 0;
+  uint64_t allocations = 0;
+  int64_t timestamp_us = 0;
+  // 最初の 1 回はバッファを確保するので計測しない
+  for (int n = -1; n < iterations; n++) {
+    auto frame = frames[(n + 1) % 2];
+    uint64_t bytes_before = g_allocated_bytes;
+    uint64_t allocations_before = g_allocations;
+    int64_t t0 = NowNs();
+    for (auto& track : tracks) {
+      track->Deliver(frame, ++timestamp_us);
+    }
+    int64_t t1 = NowNs();
+    for (ptrid_t id : ids) {
+      params.userData = id;
+      params.texData = nullptr;
+      update(kUnityRenderingExtEventUpdateTextureBeginV2, &params);
+      update(kUnityRenderingExtEventUpdateTextureEndV2, &params);
+    }
+    int64_t t2 = NowNs();
+    if (n >= 0) {
+      on_frame_ns += t1 - t0;
+      update_ns += t2 - t1;
+      allocated_bytes += g_allocated_bytes - bytes_before;
+      allocations += g_allocations - allocations_before;
+    }
+  }
+
+  Result r;
+  r.frames = iterations * c.sinks;
+  r.on_frame_ns = (double)on_frame_ns / r.frames;
+  r.update_ns = (double)update_ns / r.frames;
+  r.bytes_per_frame = (double)allocated_bytes / r.frames;
+  r.allocations_per_frame = (double)allocations / r.frames;
+  r.frames_per_sec = r.frames * 1e9 / (double)(on_frame_ns + update_ns);
+  return r;
+}
+
+}  // namespace
+
+}  // namespace sora_unity_sdk
+
+int main(int argc, char* argv[]) {
+  using namespace sora_unity_sdk;
+
+  double scale = argc >= 2 ? std::atof(argv[1]) : 1.0;
+  if (scale <= 0) {
+    scale = 1.0;
+  }
+  webrtc::LogMessage::LogToDebug(webrtc::LS_NONE);
+
+  struct Size {
+    const char* name;
+    int width;
+    int height;
+  };
+  const Size kSizes[] = {
+      {"360p", 640, 360},
+      {"720p", 1280, 720},
+      {"1080p", 1920, 1080},
+      {"4K", 3840, 2160},
+  };
+  const FrameType kTypes[] = {FrameType::kI420, FrameType::kNV12,
+                              FrameType::kNative};
+  const int kSinks[] = {1, 16, 64};
+  const double kMaxTextureBytes = 1024.0 * 1024 * 1024;
+
+  std::printf(
+      "type,size,texture,sinks,frames,on_frame_ns,update_ns,total_ns,"
+      "bytes_per_frame,allocs_per_frame,frames_per_sec\n");
+  for (FrameType type : kTypes) {
+    for (const Size& size : kSizes) {
+      // テクスチャがフレームと同じ大きさの場合と、半分の大きさの場合
+      for (int divisor : {1, 2}) {
+        for (int sinks : kSinks) {
+          Case c = {type,
+                    size.width,
+                    size.height,
+                    size.width / divisor,
+                    size.height / divisor,
+                    sinks};
+          // Sink 毎にテクスチャ用のバッファを持つので、大きすぎるものは飛ばす
+          if ((double)c.texture_width * c.texture_height * 4 * sinks >
+              kMaxTextureBytes) {
+            continue;
+          }
+          Result r = Run(c, scale);
+          std::printf("%s,%s,%dx%d,%d,%d,%.0f,%.0f,%.0f,%.1f,%.2f,%.1f\n",
+                      FrameTypeToString(type), size.name, c.texture_width,
+                      c.texture_height, sinks, r.frames, r.on_frame_ns,
+                      r.update_ns, r.on_frame_ns + r.update_ns,
+                      r.bytes_per_frame, r.allocations_per_frame,
+                      r.frames_per_sec);
+          std::fflush(stdout);
+        }
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,719 @@
+// Unity を使わずに、HeadlessUnityInterfaces を通してプラグインを動かすテスト。
+//
+// Unity のレンダースレッドの代わりに、テクスチャ更新コールバックと
+// レンダリングイベントをループで呼び出して、Sink とテクスチャの状態を確認する。
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// WebRTC
+#include <api/environment/environment_factory.h>
+#include <api/frame_transformer_interface.h>
+#include <api/units/time_delta.h>
+#include <api/units/timestamp.h>
+#include <api/video/encoded_image.h>
+#include <api/video/video_frame_metadata.h>
+#include <api/video_codecs/video_codec.h>
+#include <api/video_codecs/video_decoder.h>
+#include <api/video_codecs/video_encoder.h>
+#include <api/video_codecs/video_encoder_factory.h>
+#include <modules/video_coding/include/video_error_codes.h>
+
+#include "decode_gate.h"
+#include "device_registry.h"
+#include "fake_video_track.h"
+#include "receive_quality_controller.h"
+#include "shared_encoder_factory.h"
+#include "unity.h"
+#include "unity/IUnityRenderingExtensions.h"
+#include "unity_context.h"
+#include "unity_renderer.h"
+
+#define CHECK(cond)                                                      \
+  do {                                                                   \
+    if (!(cond)) {                                                       \
+      std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__,        \
+                   __LINE__, #cond);                                     \
+      sora_unity_sdk::g_failures++;                                      \
+    }                                                                    \
+  } while (false)
+
+namespace sora_unity_sdk {
+
+int g_failures = 0;
+
+namespace {
+
+typedef void(UNITY_INTERFACE_API* TextureUpdateFunc)(int, void*);
+typedef void(UNITY_INTERFACE_API* RenderEventFunc)(int);
+
+// Unity が CommandBuffer.IssuePluginCustomTextureUpdateV2 で行う呼び出しと同じ
+void* UpdateTexture(ptrid_t video_sink_id, int width, int height) {
+  auto f = (TextureUpdateFunc)sora_get_texture_update_callback();
+  UnityRenderingExtTextureUpdateParamsV2 params = {};
+  params.userData = video_sink_id;
+  params.format = kUnityRenderingExtFormatR8G8B8A8_UNorm;
+  params.width = width;
+  params.height = height;
+  params.bpp = 4;
+  f(kUnityRenderingExtEventUpdateTextureBeginV2, &params);
+  void* tex_data = params.texData;
+  f(kUnityRenderingExtEventUpdateTextureEndV2, &params);
+  return tex_data;
+}
+
+// BT.601 の (81, 90, 240) はほぼ赤になる
+bool IsRed(const void* tex_data, int width, int height) {
+  auto p = static_cast<const uint8_t*>(tex_data);
+  for (int i = 0; i < width * height; i++, p += 4) {
+    if (p[0] < 230 || p[1] > 30 || p[2] > 30 || p[3] != 255) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void TestHeadlessRenderEvent() {
+  CHECK(UnityContext::Instance().IsInitialized());
+  void* sora = sora_create();
+  CHECK(sora != nullptr);
+  if (sora == nullptr) {
+    return;
+  }
+  auto f = (RenderEventFunc)sora_get_render_callback();
+  int event_id = sora_get_render_callback_event_id(sora);
+  // 接続していない状態でもレンダリングイベントは安全に呼べる
+  for (int i = 0; i < 10; i++) {
+    f(event_id);
+    sora_dispatch_events(sora);
+  }
+  sora_destroy(sora);
+  // 破棄した後の ID は無視される
+  f(event_id);
+}
+
+void TestTextureUpdate() {
+  auto track = webrtc::make_ref_counted<FakeVideoTrack>();
+  UnityRenderer renderer;
+  ptrid_t id = renderer.AddTrack(track.get());
+  CHECK(id != 0);
+
+  // フレームが来るまではテクスチャを更新しない
+  CHECK(UpdateTexture(id, 64, 32) == nullptr);
+
+  track->Deliver(CreateI420(64, 32, 81, 90, 240), 1000);
+  void* tex_data = UpdateTexture(id, 64, 32);
+  CHECK(tex_data != nullptr && IsRed(tex_data, 64, 32));
+
+  TextureStats stats;
+  CHECK(renderer.GetTextureStats(id, &stats));
+  CHECK(stats.width == 64 && stats.height == 32 && stats.updated_us != 0);
+
+  // 新しいフレームが無ければ同じバッファを返す
+  CHECK(UpdateTexture(id, 64, 32) == tex_data);
+
+  // テクスチャの大きさが違う場合は拡縮する
+  tex_data = UpdateTexture(id, 32, 16);
+  CHECK(tex_data != nullptr && IsRed(tex_data, 32, 16));
+
+  // NV12 は I420 を経由せずに変換する
+  track->Deliver(CreateNV12(64, 32, 81, 90, 240), 2000);
+  tex_data = UpdateTexture(id, 64, 32);
+  CHECK(tex_data != nullptr && IsRed(tex_data, 64, 32));
+
+  // 削除した Sink の ID は無視される
+  CHECK(renderer.RemoveTrack(track.get()) == id);
+  CHECK(UpdateTexture(id, 64, 32) == nullptr);
+}
+
+void TestRenderDemand() {
+  auto track = webrtc::make_ref_counted<FakeVideoTrack>();
+  UnityRenderer renderer;
+  std::vector<bool> demands;
+  ptrid_t id = renderer.AddTrack(track.get(), 3, [&demands](bool demanded) {
+    demands.push_back(demanded);
+  });
+
+  // テクスチャが更新されないまま 3 フレーム来たら描画されていないとみなす
+  for (int i = 0; i < 3; i++) {
+    track->Deliver(CreateI420(16, 16, 81, 90, 240), i);
+  }
+  CHECK(demands == std::vector<bool>({false}));
+
+  // 描画されていない間のフレームは変換しない
+  track->Deliver(CreateI420(16, 16, 81, 90, 240), 3);
+  CHECK(demands == std::vector<bool>({false}));
+
+  // テクスチャが更新されたら再開する
+  UpdateTexture(id, 16, 16);
+  CHECK(demands == std::vector<bool>({false, true}));
+  track->Deliver(CreateI420(16, 16, 81, 90, 240), 4);
+  void* tex_data = UpdateTexture(id, 16, 16);
+  CHECK(tex_data != nullptr && IsRed(tex_data, 16, 16));
+}
+
+struct CallbackState {
+  ptrid_t id;
+  // 呼ばれた時に削除するコールバックの ID
+  std::vector<int> remove_ids;
+  int called;
+};
+
+void OnFrameCallback(const sora_video_frame_t* frame,
+                     int64_t timestamp_us,
+                     void* handle,
+                     void* userdata) {
+  auto state = static_cast<CallbackState*>(userdata);
+  state->called++;
+  for (int callback_id : state->remove_ids) {
+    sora_remove_video_frame_callback(state->id, callback_id);
+  }
+}
+
+// コールバックの中から追加や削除を呼んでもデッドロックせず、
+// 削除したコールバックはその時点から呼ばれないこと
+void TestFrameCallbackReentrancy() {
+  auto track = webrtc::make_ref_counted<FakeVideoTrack>();
+  UnityRenderer renderer;
+  ptrid_t id = renderer.AddTrack(track.get());
+
+  CallbackState first = {id, {}, 0};
+  CallbackState second = {id, {}, 0};
+  int first_id = sora_add_video_frame_callback(id, OnFrameCallback, &first);
+  int second_id = sora_add_video_frame_callback(id, OnFrameCallback, &second);
+  CHECK(first_id != 0 && second_id != 0);
+  first.remove_ids = {first_id, second_id};
+
+  track->Deliver(CreateI420(16, 16, 81, 90, 240), 1);
+  track->Deliver(CreateI420(16, 16, 81, 90, 240), 2);
+  CHECK(first.called == 1);
+  CHECK(second.called == 0);
+
+  // 削除した Sink の ID は無視される
+  renderer.RemoveTrack(track.get());
+  CHECK(sora_add_video_frame_callback(id, OnFrameCallback, &first) == 0);
+}
+
+// 列挙した回数を数えるフェイクのバックエンド
+class CountingDeviceBackend : public FakeDeviceBackend {
+ public:
+  std::optional<std::vector<DeviceInfo>> Enum(DeviceKind kind) override {
+    count_++;
+    return FakeDeviceBackend::Enum(kind);
+  }
+  int count() const { return count_; }
+
+ private:
+  std::atomic<int> count_{0};
+};
+
+sora_conf::internal::FakeDevices CreateFakeDevices(
+    std::vector<std::string> video_capturers) {
+  sora_conf::internal::FakeDevices devices;
+  for (const auto& name : video_capturers) {
+    sora_conf::internal::FakeDevices::Device d;
+    d.device_name = name;
+    d.unique_name = name + "-id";
+    devices.video_capturers.push_back(d);
+  }
+  return devices;
+}
+
+std::vector<std::string> EnumVideoCapturers(DeviceRegistry& registry) {
+  std::vector<std::string> names;
+  registry.Enum(DeviceKind::kVideoCapturer,
+                [&names](std::string device_name, std::string) {
+                  names.push_back(device_name);
+                });
+  return names;
+}
+
+// バックグラウンドのスレッドから呼ばれるリスナーを待つ
+bool WaitFor(std::function<bool()> cond) {
+  for (int i = 0; i < 200; i++) {
+    if (cond()) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return cond();
+}
+
+// リスナーがいない間は毎回列挙し、いる間はキャッシュを使う
+void TestDeviceRegistryCache() {
+  auto backend = std::make_shared<CountingDeviceBackend>();
+  backend->SetDevices(CreateFakeDevices({"camera"}));
+  DeviceRegistry registry(backend);
+
+  CHECK(EnumVideoCapturers(registry) == std::vector<std::string>({"camera"}));
+  CHECK(EnumVideoCapturers(registry) == std::vector<std::string>({"camera"}));
+  CHECK(backend->count() == 2);
+
+  int id = registry.AddListener([](DeviceKind) {});
+  CHECK(EnumVideoCapturers(registry) == std::vector<std::string>({"camera"}));
+  CHECK(backend->count() == 3);
+  for (int i = 0; i < 5; i++) {
+    CHECK(EnumVideoCapturers(registry) ==
+          std::vector<std::string>({"camera"}));
+  }
+  CHECK(backend->count() == 3);
+
+  // リスナーがいなくなったらキャッシュを捨てて、また毎回列挙する
+  registry.RemoveListener(id);
+  EnumVideoCapturers(registry);
+  EnumVideoCapturers(registry);
+  CHECK(backend->count() == 5);
+}
+
+// フェイクのデバイスを変えると、変化した種類の通知がちょうど 1 回届く
+void TestDeviceRegistryChangeEvent() {
+  DeviceRegistry registry(std::make_shared<CountingDeviceBackend>());
+  std::mutex mutex;
+  std::vector<DeviceKind> events;
+  int id = registry.AddListener([&](DeviceKind kind) {
+    std::lock_guard<std::mutex> guard(mutex);
+    events.push_back(kind);
+  });
+  auto get_events = [&]() {
+    std::lock_guard<std::mutex> guard(mutex);
+    return events;
+  };
+  // 一度列挙した種類だけが通知の対象になる
+  CHECK(EnumVideoCapturers(registry).empty());
+
+  registry.SetFakeDevices(CreateFakeDevices({"camera"}));
+  CHECK(WaitFor([&]() { return !get_events().empty(); }));
+  // 遅れて重複した通知が来ないことを確認する
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  CHECK(get_events() ==
+        std::vector<DeviceKind>({DeviceKind::kVideoCapturer}));
+  CHECK(EnumVideoCapturers(registry) == std::vector<std::string>({"camera"}));
+
+  // 変化が無ければ通知しない
+  registry.SetFakeDevices(CreateFakeDevices({"camera"}));
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  CHECK(get_events().size() == 1);
+
+  registry.RemoveListener(id);
+}
+
+// ReceiveQualityController::Update() に与える入力と、期待するリクエスト
+struct ReceiveQualityStep {
+  enum Hint { kNone, kVisible, kInvisible, kFocused };
+
+  int64_t now_ms;
+  Hint hint;
+  // false の場合はテクスチャの情報が取れなかったことにする
+  bool has_stats;
+  int height;
+  // 0 の場合は一度もテクスチャを更新していない
+  int64_t updated_ms;
+  // リクエストしない場合は nullptr
+  const char* expected_rid;
+};
+
+// interval 1000ms, r0 180p, r1 360p, invisible_timeout 2000ms, stable_count 2
+void TestReceiveQualityController() {
+  typedef ReceiveQualityStep S;
+  const S steps[] = {
+      // 同じ rid が stable_count 回続くまではリクエストしない
+      {1000, S::kNone, true, 720, 1000, nullptr},
+      // interval が経過するまでは決め直さない
+      {1500, S::kNone, true, 720, 1500, nullptr},
+      {2000, S::kNone, true, 720, 2000, "r2"},
+      // 途中で別の rid に戻ったら数え直す
+      {3000, S::kNone, true, 240, 3000, nullptr},
+      {4000, S::kNone, true, 720, 4000, nullptr},
+      {5000, S::kNone, true, 240, 5000, nullptr},
+      {6000, S::kNone, true, 240, 6000, "r1"},
+      {7000, S::kNone, true, 240, 6000, nullptr},
+      // invisible_timeout の間テクスチャが更新されなければ r0 にする
+      {9000, S::kNone, true, 240, 6000, nullptr},
+      {10000, S::kNone, true, 240, 6000, "r0"},
+      // ヒントは interval も stable_count も待たずに反映する
+      {10100, S::kFocused, true, 120, 10100, "r2"},
+      {10200, S::kNone, true, 120, 10200, nullptr},
+      {10300, S::kInvisible, true, 720, 10300, "r0"},
+      {10400, S::kVisible, true, 720, 10400, "r2"},
+      // テクスチャの情報が取れない映像は描画されていないとみなす
+      {11400, S::kNone, false, 0, 0, nullptr},
+      {12400, S::kNone, false, 0, 0, "r0"},
+      // 一度も更新されていないテクスチャも同じ
+      {13400, S::kNone, true, 720, 0, nullptr},
+      {14400, S::kNone, true, 720, 14400, nullptr},
+      {15400, S::kNone, true, 720, 15400, "r2"},
+  };
+
+  sora_conf::internal::ReceiveQualityControllerConfig config;
+  ReceiveQualityController controller(config);
+  const ptrid_t sink_id = 1;
+  controller.AddSink(sink_id, "connection-1");
+  // connection_id が分からない映像はリクエストの対象にしない
+  controller.AddSink(2, "");
+
+  int failures = g_failures;
+  for (const auto& step : steps) {
+    switch (step.hint) {
+      case S::kNone:
+        break;
+      case S::kVisible:
+        controller.SetHint(sink_id, true, false);
+        break;
+      case S::kInvisible:
+        controller.SetHint(sink_id, false, false);
+        break;
+      case S::kFocused:
+        controller.SetHint(sink_id, true, true);
+        break;
+    }
+    auto requests = controller.Update(
+        step.now_ms * 1000, [&step](ptrid_t, TextureStats* stats) {
+          if (!step.has_stats) {
+            return false;
+          }
+          stats->width = step.height * 16 / 9;
+          stats->height = step.height;
+          stats->updated_us = step.updated_ms * 1000;
+          return true;
+        });
+    if (step.expected_rid == nullptr) {
+      CHECK(requests.empty());
+    } else {
+      CHECK(requests.size() == 1);
+      if (requests.size() == 1) {
+        CHECK(requests[0].first == "connection-1");
+        CHECK(requests[0].second == step.expected_rid);
+      }
+    }
+    if (g_failures != failures) {
+      std::fprintf(stderr, "ReceiveQualityController: failed at %lld ms\n",
+                   (long long)step.now_ms);
+      return;
+    }
+  }
+}
+
+// デコードした回数を数えるだけのデコーダ
+class CountingDecoderFactory : public webrtc::VideoDecoderFactory {
+ public:
+  explicit CountingDecoderFactory(int* decoded) : decoded_(decoded) {}
+
+  std::vector<webrtc::SdpVideoFormat> GetSupportedFormats() const override {
+    return {webrtc::SdpVideoFormat("VP8")};
+  }
+  std::unique_ptr<webrtc::VideoDecoder> Create(
+      const webrtc::Environment& env,
+      const webrtc::SdpVideoFormat& format) override {
+    return std::make_unique<Decoder>(decoded_);
+  }
+
+ private:
+  class Decoder : public webrtc::VideoDecoder {
+   public:
+    explicit Decoder(int* decoded) : decoded_(decoded) {}
+    bool Configure(const Settings& settings) override { return true; }
+    int32_t Decode(const webrtc::EncodedImage& input_image,
+                   int64_t render_time_ms) override {
+      (*decoded_)++;
+      return WEBRTC_VIDEO_CODEC_OK;
+    }
+    int32_t RegisterDecodeCompleteCallback(
+        webrtc::DecodedImageCallback* callback) override {
+      return WEBRTC_VIDEO_CODEC_OK;
+    }
+    int32_t Release() override { return WEBRTC_VIDEO_CODEC_OK; }
+
+   private:
+    int* decoded_;
+  };
+  int* decoded_;
+};
+
+// 受信したエンコード済みフレームの代わり
+class FakeTransformableVideoFrame
+    : public webrtc::TransformableVideoFrameInterface {
+ public:
+  FakeTransformableVideoFrame(uint32_t ssrc, bool key_frame)
+      : ssrc_(ssrc), key_frame_(key_frame) {
+    static const uint8_t kPayload[] = {0x9d, 0x01, 0x2a, 0x10,
+                                       0x00, 0x10, 0x00};
+    data_.assign(kPayload, kPayload + sizeof(kPayload));
+  }
+
+  webrtc::ArrayView<const uint8_t> GetData() const override { return data_; }
+  void SetData(webrtc::ArrayView<const uint8_t> data) override {
+    data_.assign(data.begin(), data.end());
+  }
+  uint8_t GetPayloadType() const override { return 96; }
+  uint32_t GetSsrc() const override { return ssrc_; }
+  uint32_t GetTimestamp() const override { return 0; }
+  void SetRTPTimestamp(uint32_t timestamp) override {}
+  std::string GetMimeType() const override { return "video/VP8"; }
+  std::optional<webrtc::Timestamp> ReceiveTime() const override {
+    return std::nullopt;
+  }
+  std::optional<webrtc::Timestamp> CaptureTime() const override {
+    return std::nullopt;
+  }
+  std::optional<webrtc::TimeDelta> SenderCaptureTimeOffset() const override {
+    return std::nullopt;
+  }
+  bool IsKeyFrame() const override { return key_frame_; }
+  webrtc::VideoFrameMetadata Metadata() const override {
+    return webrtc::VideoFrameMetadata();
+  }
+  void SetMetadata(const webrtc::VideoFrameMetadata& metadata) override {}
+
+ private:
+  uint32_t ssrc_;
+  bool key_frame_;
+  std::vector<uint8_t> data_;
+};
+
+// DecodeGate::Transform から渡されたフレームを受け取る
+class RecordingFrameCallback : public webrtc::TransformedFrameCallback {
+ public:
+  void OnTransformedFrame(
+      std::unique_ptr<webrtc::TransformableFrameInterface> frame) override {
+    frames_.push_back(std::move(frame));
+  }
+  std::vector<std::unique_ptr<webrtc::TransformableFrameInterface>>& frames() {
+    return frames_;
+  }
+
+ private:
+  std::vector<std::unique_ptr<webrtc::TransformableFrameInterface>> frames_;
+};
+
+// 受信したフレームを DecodeGate::Transform に通し、
+// 受信ストリームに戻ってきたフレームをデコーダに渡す
+class GatedReceiver {
+ public:
+  static constexpr uint32_t kSsrc = 1234;
+
+  GatedReceiver(webrtc::scoped_refptr<DecodeGate> gate,
+                webrtc::VideoDecoder* decoder)
+      : gate_(gate),
+        decoder_(decoder),
+        callback_(webrtc::make_ref_counted<RecordingFrameCallback>()) {
+    gate_->RegisterTransformedFrameSinkCallback(callback_, kSsrc);
+  }
+  ~GatedReceiver() { gate_->UnregisterTransformedFrameSinkCallback(kSsrc); }
+
+  // フレームが戻ってこなかった場合は -1 を返す
+  int32_t Receive(bool key_frame) {
+    gate_->Transform(
+        std::make_unique<FakeTransformableVideoFrame>(kSsrc, key_frame));
+    // フレームを捨てるとキーフレームを要求されるので、必ず 1 つ戻ってくる
+    if (callback_->frames().size() != 1) {
+      callback_->frames().clear();
+      return -1;
+    }
+    auto frame = std::move(callback_->frames()[0]);
+    callback_->frames().clear();
+    auto data = frame->GetData();
+    webrtc::EncodedImage image;
+    image.SetEncodedData(
+        webrtc::EncodedImageBuffer::Create(data.data(), data.size()));
+    image._frameType = key_frame ? webrtc::VideoFrameType::kVideoFrameKey
+                                 : webrtc::VideoFrameType::kVideoFrameDelta;
+    return decoder_->Decode(image, 0);
+  }
+
+ private:
+  webrtc::scoped_refptr<DecodeGate> gate_;
+  webrtc::VideoDecoder* decoder_;
+  webrtc::scoped_refptr<RecordingFrameCallback> callback_;
+};
+
+// 止めている間もフレームは全てデコーダまで届き（フレームバッファが空にならないので
+// キーフレームは要求されない）、デコーダの手前で読み飛ばされることを確認する
+void TestDecodeGate() {
+  int decoded = 0;
+  DecodeGateVideoDecoderFactory factory(
+      std::make_unique<CountingDecoderFactory>(&decoded));
+  auto decoder = factory.Create(webrtc::CreateEnvironment(),
+                                webrtc::SdpVideoFormat("VP8"));
+  CHECK(decoder != nullptr);
+  if (decoder == nullptr) {
+    return;
+  }
+  auto gate = webrtc::make_ref_counted<DecodeGate>();
+  GatedReceiver receiver(gate, decoder.get());
+
+  // 止めていなければ全てデコードする
+  for (int i = 0; i < 3; i++) {
+    CHECK(receiver.Receive(i == 0) == WEBRTC_VIDEO_CODEC_OK);
+  }
+  CHECK(decoded == 3);
+
+  // 止めている間はキーフレームも含めて読み飛ばすが、エラーにはしない
+  gate->SetPaused(true);
+  for (int i = 0; i < 10; i++) {
+    CHECK(receiver.Receive(i % 5 == 0) == WEBRTC_VIDEO_CODEC_OK);
+  }
+  CHECK(decoded == 3);
+
+  // 再開した後はキーフレームが届くまで読み飛ばす
+  gate->SetPaused(false);
+  CHECK(receiver.Receive(false) == WEBRTC_VIDEO_CODEC_OK);
+  CHECK(decoded == 3);
+  CHECK(receiver.Receive(true) == WEBRTC_VIDEO_CODEC_OK);
+  CHECK(receiver.Receive(false) == WEBRTC_VIDEO_CODEC_OK);
+  CHECK(decoded == 5);
+}
+
+// no_video_decode で接続した時のように、最初から止めた状態で受信を始めた場合
+void TestNoVideoDecode() {
+  int decoded = 0;
+  DecodeGateVideoDecoderFactory factory(
+      std::make_unique<CountingDecoderFactory>(&decoded));
+  auto decoder = factory.Create(webrtc::CreateEnvironment(),
+                                webrtc::SdpVideoFormat("VP8"));
+  CHECK(decoder != nullptr);
+  if (decoder == nullptr) {
+    return;
+  }
+  auto gate = webrtc::make_ref_counted<DecodeGate>();
+  GatedReceiver receiver(gate, decoder.get());
+  gate->SetPaused(true);
+
+  // 最初のキーフレームを含めて、VideoSink を作るまでは全て読み飛ばす
+  for (int i = 0; i < 100; i++) {
+    CHECK(receiver.Receive(i % 30 == 0) == WEBRTC_VIDEO_CODEC_OK);
+  }
+  CHECK(decoded == 0);
+
+  // AddVideoSink で再開したら、次のキーフレームからデコードする
+  gate->SetPaused(false);
+  CHECK(receiver.Receive(false) == WEBRTC_VIDEO_CODEC_OK);
+  CHECK(decoded == 0);
+  CHECK(receiver.Receive(true) == WEBRTC_VIDEO_CODEC_OK);
+  CHECK(decoded == 1);
+}
+
+// InitEncode で渡された幅を記録するだけのエンコーダ
+class RecordingEncoderFactory : public webrtc::VideoEncoderFactory {
+ public:
+  explicit RecordingEncoderFactory(std::vector<int>* widths)
+      : widths_(widths) {}
+
+  std::vector<webrtc::SdpVideoFormat> GetSupportedFormats() const override {
+    return {webrtc::SdpVideoFormat("VP8")};
+  }
+  std::unique_ptr<webrtc::VideoEncoder> Create(
+      const webrtc::Environment& env,
+      const webrtc::SdpVideoFormat& format) override {
+    return std::make_unique<Encoder>(widths_);
+  }
+
+ private:
+  class Encoder : public webrtc::VideoEncoder {
+   public:
+    explicit Encoder(std::vector<int>* widths) : widths_(widths) {}
+    int32_t InitEncode(const webrtc::VideoCodec* codec_settings,
+                       const Settings& settings) override {
+      widths_->push_back(codec_settings->width);
+      return WEBRTC_VIDEO_CODEC_OK;
+    }
+    int32_t RegisterEncodeCompleteCallback(
+        webrtc::EncodedImageCallback* callback) override {
+      return WEBRTC_VIDEO_CODEC_OK;
+    }
+    int32_t Release() override { return WEBRTC_VIDEO_CODEC_OK; }
+    int32_t Encode(
+        const webrtc::VideoFrame& frame,
+        const std::vector<webrtc::VideoFrameType>* frame_types) override {
+      return WEBRTC_VIDEO_CODEC_OK;
+    }
+    void SetRates(const RateControlParameters& parameters) override {}
+
+   private:
+    std::vector<int>* widths_;
+  };
+  std::vector<int>* widths_;
+};
+
+webrtc::VideoCodec CreateVideoCodec(int width, int height) {
+  webrtc::VideoCodec codec;
+  codec.codecType = webrtc::kVideoCodecVP8;
+  codec.width = width;
+  codec.height = height;
+  codec.maxFramerate = 30;
+  codec.numberOfSimulcastStreams = 1;
+  codec.simulcastStream[0].width = width;
+  codec.simulcastStream[0].height = height;
+  codec.simulcastStream[0].maxFramerate = 30;
+  codec.simulcastStream[0].numberOfTemporalLayers = 1;
+  codec.simulcastStream[0].active = true;
+  return codec;
+}
+
+// VideoStreamEncoder は設定を変える時に Release してから InitEncode を呼ぶ。
+// 他の接続がいても、リーダーの新しい設定でエンコーダを初期化し直すこと
+void TestSharedVideoEncoderReinit() {
+  std::vector<int> widths;
+  SharedVideoEncoderFactory factory(
+      std::make_unique<RecordingEncoderFactory>(&widths));
+  auto env = webrtc::CreateEnvironment();
+  auto leader = factory.Create(env, webrtc::SdpVideoFormat("VP8"));
+  auto member = factory.Create(env, webrtc::SdpVideoFormat("VP8"));
+  webrtc::VideoEncoder::Settings settings(
+      webrtc::VideoEncoder::Capabilities(false), 1, 1200);
+
+  auto codec = CreateVideoCodec(640, 360);
+  CHECK(leader->InitEncode(&codec, settings) == WEBRTC_VIDEO_CODEC_OK);
+  CHECK(member->InitEncode(&codec, settings) == WEBRTC_VIDEO_CODEC_OK);
+  CHECK(widths == std::vector<int>({640}));
+
+  leader->Release();
+  codec = CreateVideoCodec(1280, 720);
+  CHECK(leader->InitEncode(&codec, settings) == WEBRTC_VIDEO_CODEC_OK);
+  CHECK(widths == std::vector<int>({640, 1280}));
+
+  // リーダー以外の違う設定では初期化し直さない
+  member->Release();
+  codec = CreateVideoCodec(320, 180);
+  CHECK(member->InitEncode(&codec, settings) == WEBRTC_VIDEO_CODEC_OK);
+  CHECK(widths == std::vector<int>({640, 1280}));
+
+  // 同じ設定で初期化し直した場合も何もしない
+  leader->Release();
+  codec = CreateVideoCodec(1280, 720);
+  CHECK(leader->InitEncode(&codec, settings) == WEBRTC_VIDEO_CODEC_OK);
+  CHECK(widths == std::vector<int>({640, 1280}));
+}
+
+}  // namespace
+
+}  // namespace sora_unity_sdk
+
+int main() {
+  sora_headless_load(SORA_HEADLESS_RENDERER_NULL);
+
+  sora_unity_sdk::TestHeadlessRenderEvent();
+  sora_unity_sdk::TestTextureUpdate();
+  sora_unity_sdk::TestRenderDemand();
+  sora_unity_sdk::TestFrameCallbackReentrancy();
+  sora_unity_sdk::TestDeviceRegistryCache();
+  sora_unity_sdk::TestDeviceRegistryChangeEvent();
+  sora_unity_sdk::TestReceiveQualityController();
+  sora_unity_sdk::TestDecodeGate();
+  sora_unity_sdk::TestNoVideoDecode();
+  sora_unity_sdk::TestSharedVideoEncoderReinit();
+
+  sora_headless_unload();
+
+  if (sora_unity_sdk::g_failures != 0) {
+    std::fprintf(stderr, "%d check(s) failed\n", sora_unity_sdk::g_failures);
+    return 1;
+  }
+  std::printf("All tests passed\n");
+  return 0;
+}